@@ -0,0 +1,136 @@
+#include "ExternalAudioBuffer.h"
+
+#include "common_audio/include/audio_util.h"
+#include "utils/AudioKernels.h"
+
+#include <algorithm>
+
+namespace tgcalls {
+
+namespace {
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+ExternalAudioBuffer::ExternalAudioBuffer(size_t targetFillLevel, size_t maxFillLevel) :
+_targetFillLevel(targetFillLevel),
+_maxFillLevel(std::max(maxFillLevel, targetFillLevel)) {
+    _samples.resize(roundUpToPowerOfTwo(_maxFillLevel + 1));
+    _mask = _samples.size() - 1;
+}
+
+template <typename Convert>
+size_t ExternalAudioBuffer::writeImpl(size_t count, Convert &&convert) {
+    const size_t writeIndex = _writeIndex.load(std::memory_order_relaxed);
+    const size_t readIndex = _readIndex.load(std::memory_order_acquire);
+    const size_t freeSpace = _samples.size() - (writeIndex - readIndex);
+    const size_t writeCount = std::min(count, freeSpace);
+    // On overflow the newest samples are kept, they continue with the next write
+    const size_t skipCount = count - writeCount;
+
+    const size_t offset = writeIndex & _mask;
+    const size_t firstPart = std::min(writeCount, _samples.size() - offset);
+    convert(skipCount, firstPart, _samples.data() + offset);
+    convert(skipCount + firstPart, writeCount - firstPart, _samples.data());
+
+    if (skipCount != 0) {
+        // What's buffered is older than the samples just dropped
+        _staleIndex.store(writeIndex, std::memory_order_relaxed);
+    }
+    _writeIndex.store(writeIndex + writeCount, std::memory_order_release);
+
+    _written.fetch_add(writeCount, std::memory_order_relaxed);
+    if (skipCount != 0) {
+        _overflowed.fetch_add(skipCount, std::memory_order_relaxed);
+    }
+    return writeCount;
+}
+
+size_t ExternalAudioBuffer::write(rtc::ArrayView<const int16_t> samples) {
+    return writeImpl(samples.size(), [&](size_t from, size_t count, float *to) {
+        webrtc::S16ToFloatS16(samples.data() + from, count, to);
+    });
+}
+
+size_t ExternalAudioBuffer::write(rtc::ArrayView<const float> samples) {
+    return writeImpl(samples.size(), [&](size_t from, size_t count, float *to) {
+        std::copy(samples.data() + from, samples.data() + from + count, to);
+    });
+}
+
+size_t ExternalAudioBuffer::available() const {
+    return _writeIndex.load(std::memory_order_acquire) - _readIndex.load(std::memory_order_relaxed);
+}
+
+size_t ExternalAudioBuffer::prepareRead(size_t count) {
+    const size_t readIndex = _readIndex.load(std::memory_order_relaxed);
+    size_t availableCount = _writeIndex.load(std::memory_order_acquire) - readIndex;
+
+    _averageFillLevel = _averageFillLevel * 0.95f + (float)availableCount * 0.05f;
+
+    size_t skip = 0;
+    // Published before the write index that acquired it
+    const size_t staleCount = _staleIndex.load(std::memory_order_relaxed) - readIndex;
+    if (staleCount <= availableCount && staleCount != 0) {
+        skip = staleCount;
+    }
+    if (availableCount - skip > _maxFillLevel) {
+        skip = availableCount - _maxFillLevel;
+    } else if (skip == 0 && _averageFillLevel > (float)(_targetFillLevel * 2) && availableCount > _targetFillLevel + count) {
+        // The producer is consistently ahead, drop at most 1% of the samples.
+        skip = std::min(availableCount - _targetFillLevel - count, std::max((size_t)1, count / 100));
+    }
+    if (skip != 0) {
+        _readIndex.store(readIndex + skip, std::memory_order_release);
+        _skipped.fetch_add(skip, std::memory_order_relaxed);
+        availableCount -= skip;
+    }
+    return availableCount;
+}
+
+size_t ExternalAudioBuffer::mixInto(float *inout, size_t count) {
+    const size_t readCount = std::min(count, prepareRead(count));
+    if (readCount == 0) {
+        return 0;
+    }
+    const size_t readIndex = _readIndex.load(std::memory_order_relaxed);
+    const size_t offset = readIndex & _mask;
+    const size_t firstPart = std::min(readCount, _samples.size() - offset);
+    addClampFloat(inout, _samples.data() + offset, firstPart, -32768.f, 32768.f);
+    addClampFloat(inout + firstPart, _samples.data(), readCount - firstPart, -32768.f, 32768.f);
+
+    _readIndex.store(readIndex + readCount, std::memory_order_release);
+    return readCount;
+}
+
+size_t ExternalAudioBuffer::read(int16_t *out, size_t count) {
+    const size_t readCount = std::min(count, prepareRead(count));
+    if (readCount == 0) {
+        return 0;
+    }
+    const size_t readIndex = _readIndex.load(std::memory_order_relaxed);
+    const size_t offset = readIndex & _mask;
+    const size_t firstPart = std::min(readCount, _samples.size() - offset);
+    webrtc::FloatS16ToS16(_samples.data() + offset, firstPart, out);
+    webrtc::FloatS16ToS16(_samples.data(), readCount - firstPart, out + firstPart);
+
+    _readIndex.store(readIndex + readCount, std::memory_order_release);
+    return readCount;
+}
+
+ExternalAudioBuffer::Stats ExternalAudioBuffer::getStats() const {
+    Stats stats;
+    stats.written = _written.load(std::memory_order_relaxed);
+    stats.overflowed = _overflowed.load(std::memory_order_relaxed);
+    stats.skipped = _skipped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace tgcalls
@@ -0,0 +1,74 @@
+#ifndef TGCALLS_EXTERNAL_AUDIO_BUFFER_H
+#define TGCALLS_EXTERNAL_AUDIO_BUFFER_H
+
+#include "api/array_view.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tgcalls {
+
+// Fixed-capacity single-producer/single-consumer ring of FloatS16 samples
+// for audio injected via addExternalAudioSamples. Neither side blocks or
+// moves memory. When the ring is full, the producer keeps the newest samples
+// of the write in the free space and marks everything buffered before them
+// as stale; the consumer skips the stale samples on its next read. The
+// consumer keeps the fill level near its target by skipping a small share of
+// samples when the producer clock runs ahead, and trims everything above
+// maxFillLevel.
+class ExternalAudioBuffer {
+public:
+    struct Stats {
+        uint64_t written = 0;
+        uint64_t overflowed = 0;
+        uint64_t skipped = 0;
+    };
+
+    explicit ExternalAudioBuffer(size_t targetFillLevel = 4800, size_t maxFillLevel = 2 * 48000);
+
+    ExternalAudioBuffer(const ExternalAudioBuffer &) = delete;
+    ExternalAudioBuffer &operator=(const ExternalAudioBuffer &) = delete;
+
+    // Producer side.
+    size_t write(rtc::ArrayView<const int16_t> samples);
+    size_t write(rtc::ArrayView<const float> samples);
+
+    // Consumer side.
+    size_t available() const;
+    // Adds up to count samples to inout, clamped to the FloatS16 range.
+    size_t mixInto(float *inout, size_t count);
+    size_t read(int16_t *out, size_t count);
+
+    Stats getStats() const;
+
+private:
+    // Returns the number of readable samples after drift correction.
+    size_t prepareRead(size_t count);
+    template <typename Convert>
+    size_t writeImpl(size_t count, Convert &&convert);
+
+private:
+    std::vector<float> _samples;
+    size_t _mask = 0;
+    size_t _targetFillLevel = 0;
+    size_t _maxFillLevel = 0;
+
+    alignas(64) std::atomic<size_t> _writeIndex{0};
+    // Samples before this index were overtaken by an overflow, set by the
+    // producer and applied by the consumer.
+    std::atomic<size_t> _staleIndex{0};
+    alignas(64) std::atomic<size_t> _readIndex{0};
+
+    // Consumer-owned.
+    float _averageFillLevel = 0.0f;
+
+    std::atomic<uint64_t> _written{0};
+    std::atomic<uint64_t> _overflowed{0};
+    std::atomic<uint64_t> _skipped{0};
+};
+
+} // namespace tgcalls
+
+#endif
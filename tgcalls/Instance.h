@@ -36,6 +36,15 @@ struct FilePath {
 #endif
 };
 
+// Limits applied to the frames a single video sink receives, 0 means no limit.
+// Frames are downscaled to fit maxWidth x maxHeight in display orientation
+// and dropped to stay under maxFramesPerSecond.
+struct VideoSinkOptions {
+	int maxWidth = 0;
+	int maxHeight = 0;
+	int maxFramesPerSecond = 0;
+};
+
 struct Proxy {
 	std::string host;
 	uint16_t port = 0;
@@ -189,6 +198,9 @@ public:
 
 	virtual bool supportsVideo() = 0;
 	virtual void setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) = 0;
+	virtual void setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+		setIncomingVideoOutput(sink);
+	}
 
 	virtual void setAudioInputDevice(std::string id) = 0;
 	virtual void setAudioOutputDevice(std::string id) = 0;
@@ -75,10 +75,9 @@ public:
 
 class AudioCapturePostProcessor : public webrtc::CustomProcessing {
 public:
-    AudioCapturePostProcessor(std::function<void(float)> updated, std::vector<float> *externalAudioSamples, webrtc::Mutex *externalAudioSamplesMutex) :
+    AudioCapturePostProcessor(std::function<void(float)> updated, ExternalAudioBuffer *externalAudioBuffer) :
     _updated(updated),
-    _externalAudioSamples(externalAudioSamples),
-    _externalAudioSamplesMutex(externalAudioSamplesMutex) {
+    _externalAudioBuffer(externalAudioBuffer) {
     }
 
     virtual ~AudioCapturePostProcessor() {
@@ -122,23 +121,7 @@ private:
             _updated(level);
         }
 
-        _externalAudioSamplesMutex->Lock();
-        if (!_externalAudioSamples->empty()) {
-            float *bufferData = buffer->channels()[0];
-            int takenSamples = 0;
-            for (int i = 0; i < _externalAudioSamples->size() && i < buffer->num_frames(); i++) {
-                float sample = (*_externalAudioSamples)[i];
-                sample += bufferData[i];
-                sample = std::min(sample, 32768.f);
-                sample = std::max(sample, -32768.f);
-                bufferData[i] = sample;
-                takenSamples++;
-            }
-            if (takenSamples != 0) {
-                _externalAudioSamples->erase(_externalAudioSamples->begin(), _externalAudioSamples->begin() + takenSamples);
-            }
-        }
-        _externalAudioSamplesMutex->Unlock();
+        _externalAudioBuffer->mixInto(buffer->channels()[0], buffer->num_frames());
     }
 
     virtual std::string ToString() const override {
@@ -154,8 +137,7 @@ private:
     int32_t _peakCount = 0;
     float _peak = 0;
 
-    std::vector<float> *_externalAudioSamples = nullptr;
-    webrtc::Mutex *_externalAudioSamplesMutex = nullptr;
+    ExternalAudioBuffer *_externalAudioBuffer = nullptr;
 };
 
 } // namespace
@@ -333,7 +315,7 @@ _enableHighBitrateVideo(enableHighBitrateVideo) {
             auto strong = this;
             strong->_currentMyAudioLevel = level;
         });
-    }, &_externalAudioSamples, &_externalAudioSamplesMutex);
+    }, &_externalAudioBuffer);
     builder.SetCapturePostProcessing(std::move(audioProcessor));
     peerConnectionFactoryDeps.audio_processing = builder.Create();
 
@@ -1128,17 +1110,7 @@ void MediaManager::addExternalAudioSamples(std::vector<uint8_t> &&samples) {
     if (samples.size() % 2 != 0) {
         return;
     }
-    _externalAudioSamplesMutex.Lock();
-
-    size_t previousSize = _externalAudioSamples.size();
-    _externalAudioSamples.resize(_externalAudioSamples.size() + samples.size() / 2);
-    webrtc::S16ToFloatS16((const int16_t *)samples.data(), samples.size() / 2, _externalAudioSamples.data() + previousSize);
-
-    if (_externalAudioSamples.size() > 2 * 48000) {
-        _externalAudioSamples.erase(_externalAudioSamples.begin(), _externalAudioSamples.begin() + (_externalAudioSamples.size() - 2 * 48000));
-    }
-
-    _externalAudioSamplesMutex.Unlock();
+    _externalAudioBuffer.write(rtc::ArrayView<const int16_t>((const int16_t *)samples.data(), samples.size() / 2));
 }
 
 MediaManager::NetworkInterfaceImpl::NetworkInterfaceImpl(MediaManager *mediaManager, bool isVideo) :
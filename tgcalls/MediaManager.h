@@ -14,6 +14,7 @@
 #include "Message.h"
 #include "VideoCaptureInterface.h"
 #include "Stats.h"
+#include "ExternalAudioBuffer.h"
 
 #include <functional>
 #include <memory>
@@ -185,8 +186,7 @@ private:
 
     std::vector<CallStatsBitrateRecord> _bitrateRecords;
 
-    std::vector<float> _externalAudioSamples;
-    webrtc::Mutex _externalAudioSamplesMutex;
+    ExternalAudioBuffer _externalAudioBuffer;
 };
 
 } // namespace tgcalls
@@ -2,12 +2,122 @@
 #define TGCALLS_THREAD_LOCAL_OBJECT_H
 
 #include "rtc_base/thread.h"
+#include "rtc_base/synchronization/mutex.h"
 
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 namespace tgcalls {
 
+// Type-erased void(T *) callable with inline storage for small functors,
+// so that queueing a typical capture list does not hit the heap.
+template <typename T>
+class ThreadLocalTask {
+public:
+	static constexpr size_t kInlineCapacity = 64;
+
+	template <
+		typename FunctorT,
+		typename Stored = std::decay_t<FunctorT>,
+		typename = std::enable_if_t<!std::is_same<Stored, ThreadLocalTask>::value>>
+	ThreadLocalTask(FunctorT &&functor) {
+		if constexpr (isStoredInline<Stored>()) {
+			new (&_storage) Stored(std::forward<FunctorT>(functor));
+			_ops = &kInlineOps<Stored>;
+		} else {
+			*reinterpret_cast<Stored **>(&_storage) = new Stored(std::forward<FunctorT>(functor));
+			_ops = &kHeapOps<Stored>;
+		}
+	}
+
+	ThreadLocalTask(ThreadLocalTask &&other) noexcept : _ops(other._ops) {
+		if (_ops) {
+			_ops->move(&other._storage, &_storage);
+			other._ops = nullptr;
+		}
+	}
+
+	ThreadLocalTask &operator=(ThreadLocalTask &&other) noexcept {
+		if (this != &other) {
+			reset();
+			_ops = other._ops;
+			if (_ops) {
+				_ops->move(&other._storage, &_storage);
+				other._ops = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	ThreadLocalTask(const ThreadLocalTask &) = delete;
+	ThreadLocalTask &operator=(const ThreadLocalTask &) = delete;
+
+	~ThreadLocalTask() {
+		reset();
+	}
+
+	void operator()(T *value) {
+		assert(_ops != nullptr);
+		_ops->invoke(&_storage, value);
+	}
+
+private:
+	struct Ops {
+		void (*invoke)(void *storage, T *value);
+		void (*move)(void *from, void *to);
+		void (*destroy)(void *storage);
+	};
+
+	template <typename Stored>
+	static constexpr bool isStoredInline() {
+		return sizeof(Stored) <= kInlineCapacity
+			&& alignof(Stored) <= alignof(std::max_align_t)
+			&& std::is_nothrow_move_constructible<Stored>::value;
+	}
+
+	template <typename Stored>
+	static constexpr Ops kInlineOps = {
+		[](void *storage, T *value) {
+			(*static_cast<Stored *>(storage))(value);
+		},
+		[](void *from, void *to) {
+			new (to) Stored(std::move(*static_cast<Stored *>(from)));
+			static_cast<Stored *>(from)->~Stored();
+		},
+		[](void *storage) {
+			static_cast<Stored *>(storage)->~Stored();
+		}
+	};
+
+	template <typename Stored>
+	static constexpr Ops kHeapOps = {
+		[](void *storage, T *value) {
+			(**static_cast<Stored **>(storage))(value);
+		},
+		[](void *from, void *to) {
+			*static_cast<Stored **>(to) = *static_cast<Stored **>(from);
+		},
+		[](void *storage) {
+			delete *static_cast<Stored **>(storage);
+		}
+	};
+
+	void reset() {
+		if (_ops) {
+			_ops->destroy(&_storage);
+			_ops = nullptr;
+		}
+	}
+
+	std::aligned_storage_t<kInlineCapacity, alignof(std::max_align_t)> _storage;
+	const Ops *_ops = nullptr;
+
+};
+
 template <typename T>
 class ThreadLocalObject {
 public:
@@ -37,6 +147,26 @@ public:
 		});
 	}
 
+	// Appends the functor to a per-object batch instead of posting it on its own.
+	// Calls made before the batch is drained share a single thread hop, and small
+	// functors are stored inline, so the steady state does not allocate.
+	// Ordering is only guaranteed relative to other performBatched() calls.
+	template <typename FunctorT>
+	void performBatched(FunctorT &&functor) {
+		bool shouldPost = false;
+		{
+			webrtc::MutexLock lock(&_valueHolder->_batchMutex);
+			_valueHolder->_pendingBatch.emplace_back(std::forward<FunctorT>(functor));
+			shouldPost = !_valueHolder->_isBatchPosted;
+			_valueHolder->_isBatchPosted = true;
+		}
+		if (shouldPost) {
+			_thread->PostTask([valueHolder = _valueHolder.get()]() {
+				valueHolder->drainBatch();
+			});
+		}
+	}
+
 	T *getSyncAssumingSameThread() {
 		assert(_thread->IsCurrent());
 		assert(_valueHolder->_value != nullptr);
@@ -46,6 +176,25 @@ public:
 private:
 	struct ValueHolder {
 		std::shared_ptr<T> _value;
+
+		webrtc::Mutex _batchMutex;
+		std::vector<ThreadLocalTask<T>> _pendingBatch;
+		std::vector<ThreadLocalTask<T>> _executingBatch;
+		bool _isBatchPosted = false;
+
+		void drainBatch() {
+			{
+				webrtc::MutexLock lock(&_batchMutex);
+				// Swapping keeps the capacity of both vectors alive between batches.
+				_executingBatch.swap(_pendingBatch);
+				_isBatchPosted = false;
+			}
+			assert(_value != nullptr);
+			for (auto &task : _executingBatch) {
+				task(_value.get());
+			}
+			_executingBatch.clear();
+		}
 	};
 
 	rtc::Thread *_thread = nullptr;
@@ -15,16 +15,16 @@ namespace {
 int AVIOContextImplRead(void *opaque, unsigned char *buffer, int bufferSize) {
     AVIOContextImpl *instance = static_cast<AVIOContextImpl *>(opaque);
 
-    int bytesToRead = std::min(bufferSize, ((int)instance->_fileData.size()) - instance->_fileReadPosition);
+    int64_t bytesToRead = std::min((int64_t)bufferSize, ((int64_t)instance->_fileData.size()) - instance->_fileReadPosition);
     if (bytesToRead < 0) {
         bytesToRead = 0;
     }
 
     if (bytesToRead > 0) {
-        memcpy(buffer, instance->_fileData.data() + instance->_fileReadPosition, bytesToRead);
+        memcpy(buffer, instance->_fileData.data() + instance->_fileReadPosition, (size_t)bytesToRead);
         instance->_fileReadPosition += bytesToRead;
 
-        return bytesToRead;
+        return (int)bytesToRead;
     } else {
         return AVERROR_EOF;
     }
@@ -40,25 +40,135 @@ int64_t AVIOContextImplSeek(void *opaque, int64_t offset, int whence) {
         if (seekOffset < 0) {
             seekOffset = 0;
         }
-        instance->_fileReadPosition = (int)seekOffset;
+        instance->_fileReadPosition = seekOffset;
         return seekOffset;
     }
 }
 
+bool hasCompleteCodecParameters(AVStream const *stream) {
+    AVCodecParameters const *codecParameters = stream->codecpar;
+    if (codecParameters->codec_id == AV_CODEC_ID_NONE) {
+        return false;
+    }
+
+    switch (codecParameters->codec_type) {
+        case AVMEDIA_TYPE_AUDIO: {
+#if LIBAVFORMAT_VERSION_MAJOR >= 59
+            const int channelCount = codecParameters->ch_layout.nb_channels;
+#else
+            const int channelCount = codecParameters->channels;
+#endif
+            // Audio parts take their duration from the stream
+            return codecParameters->sample_rate > 0 && channelCount > 0 && stream->duration > 0;
+        }
+        case AVMEDIA_TYPE_VIDEO: {
+            return codecParameters->width > 0 && codecParameters->height > 0;
+        }
+        default: {
+            return true;
+        }
+    }
+}
+
+}
+
+StreamingPartData::StreamingPartData(std::vector<uint8_t> &&data) :
+_block(std::make_shared<const std::vector<uint8_t>>(std::move(data))) {
+    _size = _block->size();
+}
+
+uint8_t const *StreamingPartData::data() const {
+    return _block ? _block->data() + _offset : nullptr;
+}
+
+size_t StreamingPartData::size() const {
+    return _size;
+}
+
+StreamingPartData StreamingPartData::slice(size_t offset, size_t size) const {
+    StreamingPartData result;
+    result._block = _block;
+    result._offset = _offset + std::min(offset, _size);
+    result._size = std::min(size, _size - std::min(offset, _size));
+    return result;
 }
 
 AVIOContextImpl::AVIOContextImpl(std::vector<uint8_t> &&fileData) :
+AVIOContextImpl(StreamingPartData(std::move(fileData)), Configuration()) {
+}
+
+AVIOContextImpl::AVIOContextImpl(StreamingPartData fileData, Configuration configuration) :
 _fileData(std::move(fileData)) {
-    _buffer.resize(4 * 1024);
-    _context = avio_alloc_context(_buffer.data(), (int)_buffer.size(), 0, this, &AVIOContextImplRead, NULL, &AVIOContextImplSeek);
+    // The context may reallocate its buffer, so it has to come from av_malloc
+    unsigned char *buffer = (unsigned char *)av_malloc(configuration.bufferSize);
+    if (!buffer) {
+        return;
+    }
+    _context = avio_alloc_context(buffer, configuration.bufferSize, 0, this, &AVIOContextImplRead, NULL, &AVIOContextImplSeek);
+    if (!_context) {
+        av_free(buffer);
+        return;
+    }
+    _context->direct = configuration.directReads ? 1 : 0;
 }
 
 AVIOContextImpl::~AVIOContextImpl() {
-    avio_context_free(&_context);
+    if (_context) {
+        av_freep(&_context->buffer);
+        avio_context_free(&_context);
+    }
 }
 
 AVIOContext *AVIOContextImpl::getContext() const {
     return _context;
 };
 
+AVFormatContext *openStreamingPartInput(AVIOContextImpl &ioContext, std::string const &container, AVMediaType mediaType) {
+    if (!ioContext.getContext()) {
+        return nullptr;
+    }
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 59
+    const
+#endif
+    AVInputFormat *inputFormat = av_find_input_format(container.c_str());
+    if (!inputFormat) {
+        return nullptr;
+    }
+
+    AVFormatContext *inputFormatContext = avformat_alloc_context();
+    if (!inputFormatContext) {
+        return nullptr;
+    }
+
+    inputFormatContext->pb = ioContext.getContext();
+
+    // Frees the context on failure
+    if (avformat_open_input(&inputFormatContext, "", inputFormat, nullptr) < 0) {
+        return nullptr;
+    }
+
+    bool needsProbing = true;
+    for (unsigned int i = 0; i < inputFormatContext->nb_streams; i++) {
+        AVStream *stream = inputFormatContext->streams[i];
+        if (mediaType != AVMEDIA_TYPE_UNKNOWN && stream->codecpar->codec_type != mediaType) {
+            continue;
+        }
+        if (!hasCompleteCodecParameters(stream)) {
+            needsProbing = true;
+            break;
+        }
+        needsProbing = false;
+    }
+
+    if (needsProbing) {
+        if (avformat_find_stream_info(inputFormatContext, nullptr) < 0) {
+            avformat_close_input(&inputFormatContext);
+            return nullptr;
+        }
+    }
+
+    return inputFormatContext;
+}
+
 }
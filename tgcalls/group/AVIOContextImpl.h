@@ -2,6 +2,8 @@
 #define TGCALLS_AVIOCONTEXTIMPL_H
 
 #include "absl/types/optional.h"
+#include <memory>
+#include <string>
 #include <vector>
 #include <stdint.h>
 
@@ -20,21 +22,53 @@ extern "C" {
 
 namespace tgcalls {
 
+// Range of an immutable, ref-counted block of broadcast part bytes. Copies and
+// slices share the block.
+class StreamingPartData {
+public:
+    StreamingPartData() = default;
+    explicit StreamingPartData(std::vector<uint8_t> &&data);
+
+    uint8_t const *data() const;
+    size_t size() const;
+
+    // |offset| and |size| are clamped to this range.
+    StreamingPartData slice(size_t offset, size_t size) const;
+
+private:
+    std::shared_ptr<const std::vector<uint8_t>> _block;
+    size_t _offset = 0;
+    size_t _size = 0;
+};
+
 class AVIOContextImpl {
+public:
+    struct Configuration {
+        int bufferSize = 32 * 1024;
+        // Reads that fit the destination, packet payloads mostly, skip the
+        // context buffer.
+        bool directReads = true;
+    };
+
 public:
     AVIOContextImpl(std::vector<uint8_t> &&fileData);
+    AVIOContextImpl(StreamingPartData fileData, Configuration configuration);
     ~AVIOContextImpl();
 
     AVIOContext *getContext() const;
 
 public:
-    std::vector<uint8_t> _fileData;
-    int _fileReadPosition = 0;
+    StreamingPartData _fileData;
+    int64_t _fileReadPosition = 0;
 
-    std::vector<uint8_t> _buffer;
     AVIOContext *_context = nullptr;
 };
 
+// Opens the |container| read through |ioContext|, nullptr on failure. Stream
+// probing is skipped when the container header already describes every stream
+// of |mediaType| completely, AVMEDIA_TYPE_UNKNOWN stands for all streams.
+AVFormatContext *openStreamingPartInput(AVIOContextImpl &ioContext, std::string const &container, AVMediaType mediaType);
+
 }
 
 #endif
@@ -1,6 +1,7 @@
 #include "AudioStreamingPart.h"
 
 #include "AudioStreamingPartInternal.h"
+#include "utils/AudioKernels.h"
 
 #include "rtc_base/logging.h"
 #include "rtc_base/third_party/base64/base64.h"
@@ -25,17 +26,14 @@ class AudioStreamingPartState {
 public:
     AudioStreamingPartState(std::vector<uint8_t> &&data, std::string const &container, bool isSingleChannel) :
     _isSingleChannel(isSingleChannel),
-    _parsedPart(std::move(data), container) {
-        if (_parsedPart.getChannelUpdates().size() == 0 && !isSingleChannel) {
-            _didReadToEnd = true;
-            return;
-        }
-
-        _remainingMilliseconds = _parsedPart.getDurationInMilliseconds();
+    _parsedPart(StreamingPartData(std::move(data)), container) {
+        initialize();
+    }
 
-        for (const auto &it : _parsedPart.getChannelUpdates()) {
-            _allSsrcs.insert(it.ssrc);
-        }
+    AudioStreamingPartState(std::shared_ptr<StreamingPartDemuxer> demuxer, bool isSingleChannel) :
+    _isSingleChannel(isSingleChannel),
+    _parsedPart(std::move(demuxer)) {
+        initialize();
     }
 
     ~AudioStreamingPartState() {
@@ -49,9 +47,9 @@ public:
         return _remainingMilliseconds;
     }
 
-    std::vector<AudioStreamingPart::StreamingPartChannel> get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder) {
+    bool get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<AudioStreamingPart::StreamingPartChannel> &channels) {
         if (_didReadToEnd) {
-            return {};
+            return false;
         }
 
         for (const auto &update : _parsedPart.getChannelUpdates()) {
@@ -63,47 +61,36 @@ public:
         auto readResult = _parsedPart.readPcm(persistentDecoder, _pcm10ms);
         if (readResult.numSamples <= 0) {
             _didReadToEnd = true;
-            return {};
+            return false;
         }
 
-        std::vector<AudioStreamingPart::StreamingPartChannel> resultChannels;
-
         if (_isSingleChannel) {
-            for (int i = 0; i < readResult.numChannels; i++) {
-                AudioStreamingPart::StreamingPartChannel emptyPart;
-                emptyPart.ssrc = i + 1;
-                resultChannels.push_back(emptyPart);
-            }
+            channels.resize(readResult.numChannels);
 
             for (int i = 0; i < readResult.numChannels; i++) {
-                auto channel = resultChannels.begin() + i;
-                int sourceChannelIndex = i;
-                for (int j = 0; j < readResult.numSamples; j++) {
-                    channel->pcmData.push_back(_pcm10ms[sourceChannelIndex + j * readResult.numChannels]);
-                }
-                channel->numSamples += readResult.numSamples;
+                auto &channel = channels[i];
+                channel.ssrc = i + 1;
+                channel.pcmData.resize(readResult.numSamples);
+                deinterleaveChannelInt16(_pcm10ms.data(), readResult.numChannels, i, readResult.numSamples, channel.pcmData.data());
+                channel.numSamples = readResult.numSamples;
             }
         } else {
-            for (const auto ssrc : _allSsrcs) {
-                AudioStreamingPart::StreamingPartChannel emptyPart;
-                emptyPart.ssrc = ssrc;
-                resultChannels.push_back(emptyPart);
-            }
+            channels.resize(_allSsrcs.size());
 
-            for (auto &channel : resultChannels) {
-                auto mappedChannelIndex = getCurrentMappedChannelIndex(channel.ssrc);
+            size_t channelIndex = 0;
+            for (const auto ssrc : _allSsrcs) {
+                auto &channel = channels[channelIndex];
+                channelIndex++;
 
+                channel.ssrc = ssrc;
+                auto mappedChannelIndex = getCurrentMappedChannelIndex(ssrc);
                 if (mappedChannelIndex) {
-                    int sourceChannelIndex = mappedChannelIndex.value();
-                    for (int j = 0; j < readResult.numSamples; j++) {
-                        channel.pcmData.push_back(_pcm10ms[sourceChannelIndex + j * readResult.numChannels]);
-                    }
-                    channel.numSamples += readResult.numSamples;
+                    channel.pcmData.resize(readResult.numSamples);
+                    deinterleaveChannelInt16(_pcm10ms.data(), readResult.numChannels, mappedChannelIndex.value(), readResult.numSamples, channel.pcmData.data());
+                    channel.numSamples = readResult.numSamples;
                 } else {
-                    for (int j = 0; j < readResult.numSamples; j++) {
-                        channel.pcmData.push_back(0);
-                    }
-                    channel.numSamples += readResult.numSamples;
+                    channel.pcmData.clear();
+                    channel.numSamples = 0;
                 }
             }
         }
@@ -114,10 +101,23 @@ public:
         }
         _frameIndex++;
 
-        return resultChannels;
+        return true;
     }
 
 private:
+    void initialize() {
+        if (_parsedPart.getChannelUpdates().size() == 0 && !_isSingleChannel) {
+            _didReadToEnd = true;
+            return;
+        }
+
+        _remainingMilliseconds = _parsedPart.getDurationInMilliseconds();
+
+        for (const auto &it : _parsedPart.getChannelUpdates()) {
+            _allSsrcs.insert(it.ssrc);
+        }
+    }
+
     absl::optional<int> getCurrentMappedChannelIndex(uint32_t ssrc) {
         for (const auto &it : _currentChannelMapping) {
             if (it.ssrc == ssrc) {
@@ -158,6 +158,10 @@ AudioStreamingPart::AudioStreamingPart(std::vector<uint8_t> &&data, std::string
     }
 }
 
+AudioStreamingPart::AudioStreamingPart(std::shared_ptr<StreamingPartDemuxer> demuxer, bool isSingleChannel) {
+    _state = new AudioStreamingPartState(std::move(demuxer), isSingleChannel);
+}
+
 AudioStreamingPart::~AudioStreamingPart() {
     if (_state) {
         delete _state;
@@ -172,10 +176,10 @@ int AudioStreamingPart::getRemainingMilliseconds() const {
     return _state ? _state->getRemainingMilliseconds() : 0;
 }
 
-std::vector<AudioStreamingPart::StreamingPartChannel> AudioStreamingPart::get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder) {
+bool AudioStreamingPart::get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<StreamingPartChannel> &channels) {
     return _state
-        ? _state->get10msPerChannel(persistentDecoder)
-        : std::vector<AudioStreamingPart::StreamingPartChannel>();
+        ? _state->get10msPerChannel(persistentDecoder, channels)
+        : false;
 }
 
 }
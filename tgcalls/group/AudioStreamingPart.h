@@ -2,6 +2,7 @@
 #define TGCALLS_AUDIO_STREAMING_PART_H
 
 #include "absl/types/optional.h"
+#include <memory>
 #include <vector>
 #include <string>
 #include <map>
@@ -12,6 +13,7 @@
 namespace tgcalls {
 
 class AudioStreamingPartState;
+class StreamingPartDemuxer;
 
 class AudioStreamingPart {
 public:
@@ -22,6 +24,7 @@ public:
     };
     
     explicit AudioStreamingPart(std::vector<uint8_t> &&data, std::string const &container, bool isSingleChannel);
+    explicit AudioStreamingPart(std::shared_ptr<StreamingPartDemuxer> demuxer, bool isSingleChannel);
     ~AudioStreamingPart();
     
     AudioStreamingPart(const AudioStreamingPart&) = delete;
@@ -34,7 +37,9 @@ public:
 
     std::map<std::string, int32_t> getEndpointMapping() const;
     int getRemainingMilliseconds() const;
-    std::vector<StreamingPartChannel> get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder);
+    // Writes the next 10 ms into |channels|, reusing their buffers, returns
+    // false at the end. Channels of SSRCs not heard in them have no samples.
+    bool get10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<StreamingPartChannel> &channels);
     
 private:
     AudioStreamingPartState *_state = nullptr;
@@ -1,4 +1,5 @@
 #include "AudioStreamingPartInternal.h"
+#include "utils/AudioKernels.h"
 
 #include "rtc_base/logging.h"
 #include "rtc_base/third_party/base64/base64.h"
@@ -9,6 +10,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+#include <algorithm>
 #include <string>
 #include <bitset>
 #include <set>
@@ -18,9 +20,8 @@ namespace tgcalls {
 
 namespace {
 
-int16_t sampleFloatToInt16(float sample) {
-  return av_clip_int16 (static_cast<int32_t>(lrint(sample*32767)));
-}
+// Largest Opus packet, 120 ms at 48 kHz.
+constexpr int kMaxOpusPacketSamples = 5760;
 
 uint32_t stringToUInt32(std::string const &string) {
     std::stringstream stringStream(string);
@@ -56,6 +57,16 @@ static absl::optional<uint32_t> readInt32(std::string const &data, int &offset)
     return value;
 }
 
+// Metadata keys are case-insensitive, as they are for av_dict_get.
+std::string toUpperAscii(std::string value) {
+    for (auto &c : value) {
+        if (c >= 'a' && c <= 'z') {
+            c = (char)(c - 'a' + 'A');
+        }
+    }
+    return value;
+}
+
 std::vector<AudioStreamingPartInternal::ChannelUpdate> parseChannelUpdates(std::string const &data, int &offset) {
     std::vector<AudioStreamingPartInternal::ChannelUpdate> result;
 
@@ -98,39 +109,35 @@ std::vector<AudioStreamingPartInternal::ChannelUpdate> parseChannelUpdates(std::
 
 }
 
-AudioStreamingPartInternal::AudioStreamingPartInternal(std::vector<uint8_t> &&fileData, std::string const &container) :
-_avIoContext(std::move(fileData)) {
-    int ret = 0;
-
-    _frame = av_frame_alloc();
+AudioStreamingPartInternal::AudioStreamingPartInternal(std::shared_ptr<StreamingPartDemuxer> demuxer) :
+_demuxer(std::move(demuxer)) {
+    openDemuxedStream();
+}
 
-#if LIBAVFORMAT_VERSION_MAJOR >= 59
-    const
-#endif
-    AVInputFormat *inputFormat = av_find_input_format(container.c_str());
-    if (!inputFormat) {
-        _didReadToEnd = true;
-        return;
+AudioStreamingPartInternal::AudioStreamingPartInternal(StreamingPartData data, std::string const &container) {
+    if (container == "ogg") {
+        _oggOpusPart = OggOpusStreamingPart::parse(data);
     }
-
-    _inputFormatContext = avformat_alloc_context();
-    if (!_inputFormatContext) {
-        _didReadToEnd = true;
+    if (!_oggOpusPart) {
+        _demuxer = std::make_shared<StreamingPartDemuxer>(std::move(data), container, AVMEDIA_TYPE_AUDIO);
+        openDemuxedStream();
         return;
     }
 
-    _inputFormatContext->pb = _avIoContext.getContext();
+    _channelCount = _oggOpusPart->head().channelCount;
+    _opusPreSkip = _oggOpusPart->head().preSkip;
+    _opusRemainingSamples = _oggOpusPart->getSampleCount();
+    _durationInMilliseconds = (int)(_opusRemainingSamples * 1000 / 48000);
 
-    if ((ret = avformat_open_input(&_inputFormatContext, "", inputFormat, nullptr)) < 0) {
-        _didReadToEnd = true;
-        return;
-    }
+    parseMetadata(_oggOpusPart->comments());
+}
 
-    if ((ret = avformat_find_stream_info(_inputFormatContext, nullptr)) < 0) {
-        _didReadToEnd = true;
+void AudioStreamingPartInternal::openDemuxedStream() {
+    _inputFormatContext = _demuxer->formatContext();
+    _frame = av_frame_alloc();
 
-        avformat_close_input(&_inputFormatContext);
-        _inputFormatContext = nullptr;
+    if (!_inputFormatContext) {
+        _didReadToEnd = true;
         return;
     }
 
@@ -146,47 +153,19 @@ _avIoContext(std::move(fileData)) {
         avcodec_parameters_copy(_audioCodecParameters, inCodecpar);
         
         _streamId = i;
+        _demuxer->addReader(i);
 
         _durationInMilliseconds = (int)(inStream->duration * av_q2d(inStream->time_base) * 1000);
 
         if (inStream->metadata) {
-            AVDictionaryEntry *entry = av_dict_get(inStream->metadata, "TG_META", nullptr, 0);
-            if (entry && entry->value) {
-                std::string result;
-                size_t data_used = 0;
-                std::string sourceBase64 = (const char *)entry->value;
-                rtc::Base64::Decode(sourceBase64, rtc::Base64::DO_LAX, &result, &data_used);
-
-                if (result.size() != 0) {
-                    int offset = 0;
-                    _channelUpdates = parseChannelUpdates(result, offset);
-                }
-            }
-
-            uint32_t videoChannelMask = 0;
-            entry = av_dict_get(inStream->metadata, "ACTIVE_MASK", nullptr, 0);
-            if (entry && entry->value) {
-                std::string sourceString = (const char *)entry->value;
-                videoChannelMask = stringToUInt32(sourceString);
-            }
-
-            std::vector<std::string> endpointList;
-            entry = av_dict_get(inStream->metadata, "ENDPOINTS", nullptr, 0);
-            if (entry && entry->value) {
-                std::string sourceString = (const char *)entry->value;
-                endpointList = splitString(sourceString, ' ');
-            }
-
-            std::bitset<32> videoChannels(videoChannelMask);
-            size_t endpointIndex = 0;
-            if (videoChannels.count() == endpointList.size()) {
-                for (size_t i = 0; i < videoChannels.size(); i++) {
-                    if (videoChannels[i]) {
-                        _endpointMapping.insert(std::make_pair(endpointList[endpointIndex], i));
-                        endpointIndex++;
-                    }
+            std::map<std::string, std::string> metadata;
+            AVDictionaryEntry *entry = nullptr;
+            while ((entry = av_dict_get(inStream->metadata, "", entry, AV_DICT_IGNORE_SUFFIX))) {
+                if (entry->key && entry->value) {
+                    metadata.insert(std::make_pair(toUpperAscii(entry->key), std::string(entry->value)));
                 }
             }
+            parseMetadata(metadata);
         }
 
         break;
@@ -197,13 +176,47 @@ _avIoContext(std::move(fileData)) {
     }
 }
 
+void AudioStreamingPartInternal::parseMetadata(std::map<std::string, std::string> const &metadata) {
+    auto entry = metadata.find("TG_META");
+    if (entry != metadata.end()) {
+        std::string result;
+        size_t data_used = 0;
+        rtc::Base64::Decode(entry->second, rtc::Base64::DO_LAX, &result, &data_used);
+
+        if (result.size() != 0) {
+            int offset = 0;
+            _channelUpdates = parseChannelUpdates(result, offset);
+        }
+    }
+
+    uint32_t videoChannelMask = 0;
+    entry = metadata.find("ACTIVE_MASK");
+    if (entry != metadata.end()) {
+        videoChannelMask = stringToUInt32(entry->second);
+    }
+
+    std::vector<std::string> endpointList;
+    entry = metadata.find("ENDPOINTS");
+    if (entry != metadata.end()) {
+        endpointList = splitString(entry->second, ' ');
+    }
+
+    std::bitset<32> videoChannels(videoChannelMask);
+    size_t endpointIndex = 0;
+    if (videoChannels.count() == endpointList.size()) {
+        for (size_t i = 0; i < videoChannels.size(); i++) {
+            if (videoChannels[i]) {
+                _endpointMapping.insert(std::make_pair(endpointList[endpointIndex], i));
+                endpointIndex++;
+            }
+        }
+    }
+}
+
 AudioStreamingPartInternal::~AudioStreamingPartInternal() {
     if (_frame) {
         av_frame_free(&_frame);
     }
-    if (_inputFormatContext) {
-        avformat_close_input(&_inputFormatContext);
-    }
     if (_audioCodecParameters) {
         avcodec_parameters_free(&_audioCodecParameters);
     }
@@ -277,6 +290,10 @@ void AudioStreamingPartInternal::fillPcmBuffer(AudioStreamingPartPersistentDecod
     if (_didReadToEnd) {
         return;
     }
+    if (_oggOpusPart) {
+        fillPcmBufferFromOpus(persistentDecoder);
+        return;
+    }
     if (!_inputFormatContext) {
         _didReadToEnd = true;
         return;
@@ -284,17 +301,12 @@ void AudioStreamingPartInternal::fillPcmBuffer(AudioStreamingPartPersistentDecod
 
     int ret = 0;
     while (true) {
-      ret = av_read_frame(_inputFormatContext, &_packet);
+      ret = _demuxer->readPacket(_streamId, &_packet);
       if (ret < 0) {
         _didReadToEnd = true;
         return;
       }
         
-      if (_packet.stream_index != _streamId) {
-        av_packet_unref(&_packet);
-        continue;
-      }
-        
       ret = persistentDecoder.decode(_audioCodecParameters, _inputFormatContext->streams[_streamId]->time_base, _packet, _frame);
       av_packet_unref(&_packet);
 
@@ -352,44 +364,23 @@ void AudioStreamingPartInternal::fillPcmBuffer(AudioStreamingPartPersistentDecod
     } break;
 
     case AV_SAMPLE_FMT_S16P: {
-        int16_t *to = _pcmBuffer.data();
-        for (int sample = 0; sample < _frame->nb_samples; ++sample) {
-#if LIBAVFORMAT_VERSION_MAJOR >= 59
-            for (int channel = 0; channel < _frame->ch_layout.nb_channels; ++channel) {
-#else
-            for (int channel = 0; channel < _frame->channels; ++channel) {
-#endif
-                int16_t *shortChannel = (int16_t*)_frame->data[channel];
-                *to++ = shortChannel[sample];
-            }
+        const int16_t *planes[8];
+        for (int channel = 0; channel < _channelCount; ++channel) {
+            planes[channel] = (const int16_t *)_frame->data[channel];
         }
+        planarInt16ToInterleavedInt16(planes, _channelCount, _frame->nb_samples, _pcmBuffer.data());
     } break;
 
     case AV_SAMPLE_FMT_FLT: {
-        float *floatData = (float *)&_frame->data[0];
-#if LIBAVFORMAT_VERSION_MAJOR >= 59
-        for (int i = 0; i < _frame->nb_samples * _frame->ch_layout.nb_channels; i++) {
-            _pcmBuffer[i] = sampleFloatToInt16(floatData[i]);
-        }
-#else
-        for (int i = 0; i < _frame->nb_samples * _frame->channels; i++) {
-            _pcmBuffer[i] = sampleFloatToInt16(floatData[i]);
-        }
-#endif
+        floatToInt16((const float *)_frame->data[0], _frame->nb_samples * _channelCount, _pcmBuffer.data());
     } break;
 
     case AV_SAMPLE_FMT_FLTP: {
-        int16_t *to = _pcmBuffer.data();
-        for (int sample = 0; sample < _frame->nb_samples; ++sample) {
-#if LIBAVFORMAT_VERSION_MAJOR >= 59
-            for (int channel = 0; channel < _frame->ch_layout.nb_channels; ++channel) {
-#else
-            for (int channel = 0; channel < _frame->channels; ++channel) {
-#endif
-                float *floatChannel = (float*)_frame->data[channel];
-                *to++ = sampleFloatToInt16(floatChannel[sample]);
-            }
+        const float *planes[8];
+        for (int channel = 0; channel < _channelCount; ++channel) {
+            planes[channel] = (const float *)_frame->data[channel];
         }
+        planarFloatToInterleavedInt16(planes, _channelCount, _frame->nb_samples, _pcmBuffer.data());
     } break;
 
     default: {
@@ -401,4 +392,37 @@ void AudioStreamingPartInternal::fillPcmBuffer(AudioStreamingPartPersistentDecod
     _pcmBufferSampleOffset = 0;
 }
 
+void AudioStreamingPartInternal::fillPcmBufferFromOpus(AudioStreamingPartPersistentDecoder &persistentDecoder) {
+    if (_pcmBuffer.size() < kMaxOpusPacketSamples * _channelCount) {
+        _pcmBuffer.resize(kMaxOpusPacketSamples * _channelCount);
+    }
+
+    while (_opusRemainingSamples > 0) {
+        uint8_t const *packetData = nullptr;
+        size_t packetSize = 0;
+        if (!_oggOpusPart->readPacket(packetData, packetSize)) {
+            break;
+        }
+
+        const int numSamples = persistentDecoder.decodeOpus(_oggOpusPart->head(), packetData, packetSize, _pcmBuffer.data());
+        if (numSamples < 0) {
+            break;
+        }
+
+        const int skippedSamples = std::min(numSamples, _opusPreSkip);
+        _opusPreSkip -= skippedSamples;
+        const int outputSamples = (int)std::min((int64_t)(numSamples - skippedSamples), _opusRemainingSamples);
+        if (outputSamples <= 0) {
+            continue;
+        }
+        _opusRemainingSamples -= outputSamples;
+
+        _pcmBufferSampleOffset = skippedSamples;
+        _pcmBufferSampleSize = skippedSamples + outputSamples;
+        return;
+    }
+
+    _didReadToEnd = true;
+}
+
 }
@@ -8,6 +8,8 @@
 #include <stdint.h>
 
 #include "AVIOContextImpl.h"
+#include "StreamingPartDemuxer.h"
+#include "OggOpusStreamingPart.h"
 #include "AudioStreamingPartPersistentDecoder.h"
 
 namespace tgcalls {
@@ -26,7 +28,11 @@ public:
     };
 
 public:
-    AudioStreamingPartInternal(std::vector<uint8_t> &&fileData, std::string const &container);
+    // Reads the first audio stream of |demuxer|, which may be shared with other readers.
+    explicit AudioStreamingPartInternal(std::shared_ptr<StreamingPartDemuxer> demuxer);
+    // Reads "ogg" parts with OggOpusStreamingPart, other parts and those it
+    // doesn't handle through libavformat.
+    AudioStreamingPartInternal(StreamingPartData data, std::string const &container);
     ~AudioStreamingPartInternal();
 
     ReadPcmResult readPcm(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<int16_t> &outPcm);
@@ -35,11 +41,20 @@ public:
     std::map<std::string, int32_t> getEndpointMapping() const;
 
 private:
+    void openDemuxedStream();
+    void parseMetadata(std::map<std::string, std::string> const &metadata);
     void fillPcmBuffer(AudioStreamingPartPersistentDecoder &persistentDecoder);
+    void fillPcmBufferFromOpus(AudioStreamingPartPersistentDecoder &persistentDecoder);
 
 private:
-    AVIOContextImpl _avIoContext;
+    std::unique_ptr<OggOpusStreamingPart> _oggOpusPart;
+    // Samples per channel still to drop at the start and to output in total.
+    int _opusPreSkip = 0;
+    int64_t _opusRemainingSamples = 0;
 
+    std::shared_ptr<StreamingPartDemuxer> _demuxer;
+
+    // Owned by the demuxer.
     AVFormatContext *_inputFormatContext = nullptr;
     AVPacket _packet;
     AVFrame *_frame = nullptr;
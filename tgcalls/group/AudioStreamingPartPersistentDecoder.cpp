@@ -1,8 +1,11 @@
 #include "AudioStreamingPartPersistentDecoder.h"
 
+#include "modules/audio_coding/codecs/opus/opus_interface.h"
 #include "rtc_base/logging.h"
 #include "rtc_base/third_party/base64/base64.h"
 
+#include <algorithm>
+
 namespace tgcalls {
 
 WrappedCodecParameters::WrappedCodecParameters(AVCodecParameters const *codecParameters) {
@@ -93,6 +96,54 @@ public:
     int _channelCount = 0;
 };
 
+class AudioStreamingPartOpusDecoderState {
+public:
+    explicit AudioStreamingPartOpusDecoderState(OggOpusHead const &head) :
+    _head(head) {
+        int16_t ret = 0;
+        if (head.mappingFamily == 0) {
+            ret = WebRtcOpus_DecoderCreate(&_decoder, head.channelCount, 48000);
+        } else {
+            ret = WebRtcOpus_MultistreamDecoderCreate(&_decoder, head.channelCount, head.streamCount, head.coupledStreamCount, head.channelMapping.data());
+        }
+        if (ret != 0) {
+            _decoder = nullptr;
+        }
+
+        if (head.outputGain != 0) {
+            _gain = (float)pow(10.0, head.outputGain / (20.0 * 256.0));
+        }
+    }
+
+    ~AudioStreamingPartOpusDecoderState() {
+        if (_decoder) {
+            WebRtcOpus_DecoderFree(_decoder);
+        }
+    }
+
+    int decode(uint8_t const *data, size_t size, int16_t *pcm) {
+        if (!_decoder) {
+            return -1;
+        }
+
+        int16_t audioType = 0;
+        const int result = WebRtcOpus_Decode(_decoder, data, size, pcm, &audioType);
+        if (result > 0 && _gain != 1.0f) {
+            const int count = result * _head.channelCount;
+            for (int i = 0; i < count; i++) {
+                const float sample = pcm[i] * _gain;
+                pcm[i] = (int16_t)std::max(-32768.0f, std::min(32767.0f, sample));
+            }
+        }
+        return result;
+    }
+
+public:
+    OggOpusHead _head;
+    OpusDecInst *_decoder = nullptr;
+    float _gain = 1.0f;
+};
+
 AudioStreamingPartPersistentDecoder::AudioStreamingPartPersistentDecoder() {
 }
 
@@ -101,6 +152,10 @@ AudioStreamingPartPersistentDecoder::~AudioStreamingPartPersistentDecoder() {
         delete _state;
         _state = nullptr;
     }
+    if (_opusState) {
+        delete _opusState;
+        _opusState = nullptr;
+    }
 }
 
 void AudioStreamingPartPersistentDecoder::maybeReset(AVCodecParameters const *codecParameters, AVRational timeBase) {
@@ -115,16 +170,38 @@ void AudioStreamingPartPersistentDecoder::maybeReset(AVCodecParameters const *co
         if (!isUpdated) {
             return;
         }
+        RTC_LOG(LS_INFO) << "AudioStreamingPartPersistentDecoder: codec parameters changed, recreating the decoder";
     }
     
     if (_state) {
         delete _state;
         _state = nullptr;
     }
+    if (_opusState) {
+        delete _opusState;
+        _opusState = nullptr;
+    }
     
     _state = new AudioStreamingPartPersistentDecoderState(codecParameters, timeBase);
 }
 
+void AudioStreamingPartPersistentDecoder::maybeResetOpus(OggOpusHead const &head) {
+    if (_opusState) {
+        if (_opusState->_head == head) {
+            return;
+        }
+        RTC_LOG(LS_INFO) << "AudioStreamingPartPersistentDecoder: Opus header changed, recreating the decoder";
+        delete _opusState;
+        _opusState = nullptr;
+    }
+    if (_state) {
+        delete _state;
+        _state = nullptr;
+    }
+
+    _opusState = new AudioStreamingPartOpusDecoderState(head);
+}
+
 int AudioStreamingPartPersistentDecoder::decode(AVCodecParameters const *codecParameters, AVRational timeBase, AVPacket &packet, AVFrame *frame) {
     maybeReset(codecParameters, timeBase);
     
@@ -135,4 +212,10 @@ int AudioStreamingPartPersistentDecoder::decode(AVCodecParameters const *codecPa
     return _state->decode(packet, frame);
 }
 
+int AudioStreamingPartPersistentDecoder::decodeOpus(OggOpusHead const &head, uint8_t const *data, size_t size, int16_t *pcm) {
+    maybeResetOpus(head);
+
+    return _opusState->decode(data, size, pcm);
+}
+
 }
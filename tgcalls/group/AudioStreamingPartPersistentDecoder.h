@@ -17,9 +17,12 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+#include "OggOpusStreamingPart.h"
+
 namespace tgcalls {
 
 class AudioStreamingPartPersistentDecoderState;
+class AudioStreamingPartOpusDecoderState;
 
 class WrappedCodecParameters {
 public:
@@ -38,12 +41,19 @@ public:
     ~AudioStreamingPartPersistentDecoder();
 
     int decode(AVCodecParameters const *codecParameters, AVRational timeBase, AVPacket &packet, AVFrame *frame);
+    // Decodes a packet read by OggOpusStreamingPart with libopus into
+    // interleaved |pcm|, which has room for 120 ms. Returns the samples per
+    // channel, negative on error.
+    int decodeOpus(OggOpusHead const &head, uint8_t const *data, size_t size, int16_t *pcm);
 
 private:
     void maybeReset(AVCodecParameters const *codecParameters, AVRational timeBase);
+    void maybeResetOpus(OggOpusHead const &head);
 
 private:
+    // Only one of them is set, parts of either kind continue the same stream.
     AudioStreamingPartPersistentDecoderState *_state = nullptr;
+    AudioStreamingPartOpusDecoderState *_opusState = nullptr;
 };
 
 }
@@ -0,0 +1,41 @@
+#include "GroupE2EFrameTransform.h"
+
+#include "rtc_base/logging.h"
+
+#include <cstring>
+
+namespace tgcalls {
+
+namespace {
+
+// The callback doesn't declare its overhead; this comfortably covers a nonce,
+// an authentication tag and a signature.
+constexpr size_t kLegacyMaxOverhead = 1024;
+
+} // namespace
+
+LegacyE2EFrameTransform::LegacyE2EFrameTransform(Callback callback) :
+_callback(std::move(callback)) {
+}
+
+size_t LegacyE2EFrameTransform::maxOverhead() const {
+    return kLegacyMaxOverhead;
+}
+
+size_t LegacyE2EFrameTransform::transform(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId, bool isEncrypt, int32_t plaintextPrefix) {
+    thread_local std::vector<uint8_t> inputBuffer;
+    inputBuffer.assign(input.begin(), input.end());
+
+    const auto result = _callback(inputBuffer, userId, isEncrypt, plaintextPrefix);
+    if (result.empty()) {
+        return 0;
+    }
+    if (result.size() > output.size()) {
+        RTC_LOG(LS_ERROR) << "e2eEncryptDecrypt produced " << result.size() << " bytes, only " << output.size() << " fit";
+        return 0;
+    }
+    memcpy(output.data(), result.data(), result.size());
+    return result.size();
+}
+
+} // namespace tgcalls
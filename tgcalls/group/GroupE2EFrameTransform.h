@@ -0,0 +1,47 @@
+#ifndef TGCALLS_GROUP_E2E_FRAME_TRANSFORM_H
+#define TGCALLS_GROUP_E2E_FRAME_TRANSFORM_H
+
+#include "api/array_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace tgcalls {
+
+// End-to-end encryption of encoded media frames. The caller owns both
+// buffers: |output| always has room for input.size() + maxOverhead() bytes
+// and never aliases |input|. Implementations are called concurrently from
+// the encoder and decoder threads of different ssrcs.
+class GroupE2EFrameTransform {
+public:
+    virtual ~GroupE2EFrameTransform() = default;
+
+    // Upper bound on how many bytes encryption adds to a frame.
+    virtual size_t maxOverhead() const = 0;
+
+    // Returns the number of bytes written to |output|, 0 drops the frame.
+    // |plaintextPrefix| leading bytes must stay readable by the server.
+    virtual size_t transform(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId, bool isEncrypt, int32_t plaintextPrefix) = 0;
+};
+
+// Adapts the vector-returning GroupInstanceDescriptor::e2eEncryptDecrypt
+// callback. The callback still allocates its result, but the input is
+// passed in a per-thread buffer that is reused between frames.
+class LegacyE2EFrameTransform final : public GroupE2EFrameTransform {
+public:
+    using Callback = std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)>;
+
+    explicit LegacyE2EFrameTransform(Callback callback);
+
+    size_t maxOverhead() const override;
+    size_t transform(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId, bool isEncrypt, int32_t plaintextPrefix) override;
+
+private:
+    Callback _callback;
+};
+
+} // namespace tgcalls
+
+#endif
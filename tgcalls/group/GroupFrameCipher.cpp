@@ -0,0 +1,415 @@
+#include "GroupFrameCipher.h"
+
+extern "C" {
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#ifdef OPENSSL_IS_BORINGSSL
+#include <openssl/aead.h>
+#endif
+} // extern "C"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "rtc_base/time_utils.h"
+
+namespace tgcalls {
+
+namespace {
+
+constexpr size_t kSecretSize = 32;
+constexpr size_t kNonceSize = 12;
+constexpr size_t kTagSize = 16;
+// Nonce counter (8), prefix length (4) and key index (1).
+constexpr size_t kTrailerSize = 8 + 4 + 1;
+constexpr size_t kOverhead = kTagSize + kTrailerSize;
+
+static_assert(kTrailerSize <= kTagSize, "The trailer is masked with the tag");
+
+using Secret = std::array<uint8_t, kSecretSize>;
+
+Secret deriveSecret(const uint8_t *key, size_t keySize, const char *label) {
+    Secret result;
+    unsigned int resultSize = 0;
+    HMAC(EVP_sha256(), key, (int)keySize, reinterpret_cast<const uint8_t *>(label), strlen(label), result.data(), &resultSize);
+    return result;
+}
+
+size_t keySizeForAlgorithm(GroupFrameCipher::Algorithm algorithm) {
+    switch (algorithm) {
+        case GroupFrameCipher::Algorithm::AesGcm:
+            return 16;
+        case GroupFrameCipher::Algorithm::ChaCha20Poly1305:
+            return 32;
+    }
+    return 16;
+}
+
+void writeUint(uint8_t *data, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(value >> (8 * (size - 1 - i)));
+    }
+}
+
+uint64_t readUint(const uint8_t *data, size_t size) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < size; i++) {
+        result = (result << 8) | data[i];
+    }
+    return result;
+}
+
+} // namespace
+
+class GroupFrameCipher::Key {
+public:
+    Key(Algorithm algorithm, Secret const &secret) :
+    _algorithm(algorithm),
+    _secret(secret) {
+        auto encryptionKey = deriveSecret(_secret.data(), _secret.size(), "tgcalls frame key");
+        const auto salt = deriveSecret(_secret.data(), _secret.size(), "tgcalls frame salt");
+        std::copy(salt.begin(), salt.begin() + kNonceSize, _salt.begin());
+
+        const auto keySize = keySizeForAlgorithm(algorithm);
+#ifdef OPENSSL_IS_BORINGSSL
+        const EVP_AEAD *aead = algorithm == Algorithm::AesGcm ? EVP_aead_aes_128_gcm() : EVP_aead_chacha20_poly1305();
+        EVP_AEAD_CTX_zero(&_context);
+        _isValid = EVP_AEAD_CTX_init(&_context, aead, encryptionKey.data(), keySize, kTagSize, nullptr) == 1;
+#else
+        const EVP_CIPHER *cipher = algorithm == Algorithm::AesGcm ? EVP_aes_128_gcm() : EVP_chacha20_poly1305();
+        _sealContext = EVP_CIPHER_CTX_new();
+        _openContext = EVP_CIPHER_CTX_new();
+        _isValid = _sealContext && _openContext
+            && EVP_EncryptInit_ex(_sealContext, cipher, nullptr, nullptr, nullptr) == 1
+            && EVP_CIPHER_CTX_ctrl(_sealContext, EVP_CTRL_AEAD_SET_IVLEN, (int)kNonceSize, nullptr) == 1
+            && EVP_EncryptInit_ex(_sealContext, nullptr, nullptr, encryptionKey.data(), nullptr) == 1
+            && EVP_DecryptInit_ex(_openContext, cipher, nullptr, nullptr, nullptr) == 1
+            && EVP_CIPHER_CTX_ctrl(_openContext, EVP_CTRL_AEAD_SET_IVLEN, (int)kNonceSize, nullptr) == 1
+            && EVP_DecryptInit_ex(_openContext, nullptr, nullptr, encryptionKey.data(), nullptr) == 1;
+        (void)keySize;
+#endif
+        OPENSSL_cleanse(encryptionKey.data(), encryptionKey.size());
+    }
+
+    ~Key() {
+#ifdef OPENSSL_IS_BORINGSSL
+        EVP_AEAD_CTX_cleanup(&_context);
+#else
+        EVP_CIPHER_CTX_free(_sealContext);
+        EVP_CIPHER_CTX_free(_openContext);
+#endif
+        OPENSSL_cleanse(_secret.data(), _secret.size());
+    }
+
+    Key(const Key &) = delete;
+    Key &operator=(const Key &) = delete;
+
+    bool isValid() const {
+        return _isValid;
+    }
+
+    std::unique_ptr<Key> ratcheted() const {
+        return std::make_unique<Key>(_algorithm, deriveSecret(_secret.data(), _secret.size(), "tgcalls frame ratchet"));
+    }
+
+    void makeNonce(uint64_t counter, uint8_t *nonce) const {
+        std::copy(_salt.begin(), _salt.end(), nonce);
+        for (size_t i = 0; i < 8; i++) {
+            nonce[kNonceSize - 1 - i] ^= (uint8_t)(counter >> (8 * i));
+        }
+    }
+
+    // Writes the ciphertext followed by the tag to |out|.
+    bool seal(const uint8_t *nonce, rtc::ArrayView<const uint8_t> aad, rtc::ArrayView<const uint8_t> plaintext, uint8_t *out) {
+#ifdef OPENSSL_IS_BORINGSSL
+        size_t outSize = 0;
+        return EVP_AEAD_CTX_seal(&_context, out, &outSize, plaintext.size() + kTagSize, nonce, kNonceSize, plaintext.data(), plaintext.size(), aad.data(), aad.size()) == 1;
+#else
+        int length = 0;
+        if (EVP_EncryptInit_ex(_sealContext, nullptr, nullptr, nullptr, nonce) != 1) {
+            return false;
+        }
+        if (!aad.empty() && EVP_EncryptUpdate(_sealContext, nullptr, &length, aad.data(), (int)aad.size()) != 1) {
+            return false;
+        }
+        if (EVP_EncryptUpdate(_sealContext, out, &length, plaintext.data(), (int)plaintext.size()) != 1) {
+            return false;
+        }
+        if (EVP_EncryptFinal_ex(_sealContext, out + length, &length) != 1) {
+            return false;
+        }
+        return EVP_CIPHER_CTX_ctrl(_sealContext, EVP_CTRL_AEAD_GET_TAG, (int)kTagSize, out + plaintext.size()) == 1;
+#endif
+    }
+
+    // |sealed| is the ciphertext followed by the tag.
+    bool open(const uint8_t *nonce, rtc::ArrayView<const uint8_t> aad, rtc::ArrayView<const uint8_t> sealed, uint8_t *out) {
+#ifdef OPENSSL_IS_BORINGSSL
+        size_t outSize = 0;
+        return EVP_AEAD_CTX_open(&_context, out, &outSize, sealed.size(), nonce, kNonceSize, sealed.data(), sealed.size(), aad.data(), aad.size()) == 1;
+#else
+        const auto ciphertextSize = sealed.size() - kTagSize;
+        int length = 0;
+        if (EVP_DecryptInit_ex(_openContext, nullptr, nullptr, nullptr, nonce) != 1) {
+            return false;
+        }
+        if (!aad.empty() && EVP_DecryptUpdate(_openContext, nullptr, &length, aad.data(), (int)aad.size()) != 1) {
+            return false;
+        }
+        if (EVP_DecryptUpdate(_openContext, out, &length, sealed.data(), (int)ciphertextSize) != 1) {
+            return false;
+        }
+        uint8_t tag[kTagSize];
+        memcpy(tag, sealed.data() + ciphertextSize, kTagSize);
+        if (EVP_CIPHER_CTX_ctrl(_openContext, EVP_CTRL_AEAD_SET_TAG, (int)kTagSize, tag) != 1) {
+            return false;
+        }
+        return EVP_DecryptFinal_ex(_openContext, out + length, &length) == 1;
+#endif
+    }
+
+private:
+    Algorithm _algorithm = Algorithm::AesGcm;
+    Secret _secret;
+    std::array<uint8_t, kNonceSize> _salt;
+#ifdef OPENSSL_IS_BORINGSSL
+    EVP_AEAD_CTX _context;
+#else
+    EVP_CIPHER_CTX *_sealContext = nullptr;
+    EVP_CIPHER_CTX *_openContext = nullptr;
+#endif
+    bool _isValid = false;
+};
+
+struct GroupFrameCipher::KeySlot {
+    std::unique_ptr<Key> key;
+    // The next steps of the sender's ratchet, derived ahead so that frames
+    // never build keys.
+    std::vector<std::unique_ptr<Key>> ratchetedKeys;
+    // The key replaced by the last ratchet step, for frames still in flight.
+    std::unique_ptr<Key> previousKey;
+    int64_t previousKeyExpiresAtMs = 0;
+    int64_t nextRatchetSearchAtMs = 0;
+};
+
+struct GroupFrameCipher::Participant {
+    webrtc::Mutex mutex;
+    std::array<KeySlot, kKeyIndexCount> keys;
+};
+
+GroupFrameCipher::GroupFrameCipher(Configuration configuration) :
+_configuration(configuration) {
+}
+
+GroupFrameCipher::~GroupFrameCipher() = default;
+
+void GroupFrameCipher::setOwnKey(rtc::ArrayView<const uint8_t> key, uint8_t keyIndex) {
+    if (key.size() < kMinKeySize) {
+        return;
+    }
+    auto ownKey = std::make_unique<Key>(_configuration.algorithm, deriveSecret(key.data(), key.size(), "tgcalls frame secret"));
+    if (!ownKey->isValid()) {
+        return;
+    }
+
+    // The nonce salt only depends on the key, so another instance given the
+    // same key must not count from the same start.
+    uint64_t nonceCounter = 0;
+    if (RAND_bytes(reinterpret_cast<uint8_t *>(&nonceCounter), sizeof(nonceCounter)) != 1) {
+        return;
+    }
+
+    webrtc::MutexLock lock(&_ownKeyMutex);
+    _ownKey = std::move(ownKey);
+    _ownKeyIndex = keyIndex % kKeyIndexCount;
+    _nonceCounter = nonceCounter;
+}
+
+void GroupFrameCipher::ratchetOwnKey() {
+    webrtc::MutexLock lock(&_ownKeyMutex);
+    if (!_ownKey) {
+        return;
+    }
+    auto ownKey = _ownKey->ratcheted();
+    if (ownKey->isValid()) {
+        _ownKey = std::move(ownKey);
+    }
+}
+
+void GroupFrameCipher::setParticipantKey(int64_t userId, rtc::ArrayView<const uint8_t> key, uint8_t keyIndex) {
+    if (key.size() < kMinKeySize) {
+        return;
+    }
+    auto participantKey = std::make_unique<Key>(_configuration.algorithm, deriveSecret(key.data(), key.size(), "tgcalls frame secret"));
+    if (!participantKey->isValid()) {
+        return;
+    }
+
+    std::shared_ptr<Participant> participant;
+    {
+        webrtc::MutexLock lock(&_participantsMutex);
+        auto &found = _participants[userId];
+        if (!found) {
+            found = std::make_shared<Participant>();
+        }
+        participant = found;
+    }
+
+    KeySlot slot;
+    slot.key = std::move(participantKey);
+    fillRatchetedKeys(slot);
+
+    webrtc::MutexLock lock(&participant->mutex);
+    participant->keys[keyIndex % kKeyIndexCount] = std::move(slot);
+}
+
+void GroupFrameCipher::fillRatchetedKeys(KeySlot &slot) const {
+    while ((int)slot.ratchetedKeys.size() < _configuration.maxRatchetSteps) {
+        const auto &base = slot.ratchetedKeys.empty() ? slot.key : slot.ratchetedKeys.back();
+        auto key = base->ratcheted();
+        if (!key->isValid()) {
+            break;
+        }
+        slot.ratchetedKeys.push_back(std::move(key));
+    }
+}
+
+void GroupFrameCipher::removeParticipant(int64_t userId) {
+    webrtc::MutexLock lock(&_participantsMutex);
+    _participants.erase(userId);
+}
+
+size_t GroupFrameCipher::maxOverhead() const {
+    return kOverhead;
+}
+
+size_t GroupFrameCipher::transform(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId, bool isEncrypt, int32_t plaintextPrefix) {
+    if (isEncrypt) {
+        return encrypt(input, output, plaintextPrefix);
+    } else {
+        return decrypt(input, output, userId);
+    }
+}
+
+size_t GroupFrameCipher::encrypt(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int32_t plaintextPrefix) {
+    const auto resultSize = input.size() + kOverhead;
+    if (output.size() < resultSize) {
+        return 0;
+    }
+    const auto prefixSize = (size_t)std::clamp(plaintextPrefix, 0, (int32_t)input.size());
+
+    webrtc::MutexLock lock(&_ownKeyMutex);
+    if (!_ownKey) {
+        return 0;
+    }
+
+    // Retries of the same frame get a fresh nonce and therefore a different ciphertext.
+    const auto counter = ++_nonceCounter;
+    uint8_t nonce[kNonceSize];
+    _ownKey->makeNonce(counter, nonce);
+
+    std::copy(input.begin(), input.begin() + prefixSize, output.begin());
+    const auto aad = input.subview(0, prefixSize);
+    const auto plaintext = input.subview(prefixSize);
+    if (!_ownKey->seal(nonce, aad, plaintext, output.data() + prefixSize)) {
+        return 0;
+    }
+
+    const auto tag = output.data() + input.size();
+    const auto trailer = tag + kTagSize;
+    writeUint(trailer, counter, 8);
+    writeUint(trailer + 8, prefixSize, 4);
+    trailer[12] = _ownKeyIndex;
+    for (size_t i = 0; i < kTrailerSize; i++) {
+        trailer[i] ^= tag[i];
+    }
+
+    return resultSize;
+}
+
+size_t GroupFrameCipher::decrypt(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId) {
+    if (input.size() < kOverhead) {
+        return 0;
+    }
+    const auto resultSize = input.size() - kOverhead;
+    if (output.size() < resultSize) {
+        return 0;
+    }
+
+    const auto tag = input.data() + resultSize;
+    const auto maskedTrailer = tag + kTagSize;
+    uint8_t trailer[kTrailerSize];
+    for (size_t i = 0; i < kTrailerSize; i++) {
+        trailer[i] = maskedTrailer[i] ^ tag[i];
+    }
+    const auto counter = readUint(trailer, 8);
+    const auto prefixSize = (size_t)readUint(trailer + 8, 4);
+    const auto keyIndex = trailer[12];
+    if (prefixSize > resultSize || keyIndex >= kKeyIndexCount) {
+        return 0;
+    }
+
+    std::shared_ptr<Participant> participant;
+    {
+        webrtc::MutexLock lock(&_participantsMutex);
+        const auto found = _participants.find(userId);
+        if (found == _participants.end()) {
+            return 0;
+        }
+        participant = found->second;
+    }
+
+    webrtc::MutexLock lock(&participant->mutex);
+    auto &slot = participant->keys[keyIndex];
+    if (!slot.key) {
+        return 0;
+    }
+
+    std::copy(input.begin(), input.begin() + prefixSize, output.begin());
+    const auto aad = input.subview(0, prefixSize);
+    const auto sealed = input.subview(prefixSize, resultSize - prefixSize + kTagSize);
+    const auto tryOpen = [&](Key &key) {
+        uint8_t nonce[kNonceSize];
+        key.makeNonce(counter, nonce);
+        return key.open(nonce, aad, sealed, output.data() + prefixSize);
+    };
+
+    if (tryOpen(*slot.key)) {
+        return resultSize;
+    }
+
+    const auto timestamp = rtc::TimeMillis();
+    if (slot.previousKey) {
+        if (timestamp < slot.previousKeyExpiresAtMs) {
+            if (tryOpen(*slot.previousKey)) {
+                return resultSize;
+            }
+        } else {
+            slot.previousKey.reset();
+        }
+    }
+
+    // The sender may have ratcheted its key since the last frame we saw. Any
+    // frame that fails to authenticate gets here, so the search is limited.
+    if (timestamp < slot.nextRatchetSearchAtMs) {
+        return 0;
+    }
+    for (size_t i = 0; i < slot.ratchetedKeys.size(); i++) {
+        if (tryOpen(*slot.ratchetedKeys[i])) {
+            slot.previousKey = std::move(slot.key);
+            slot.previousKeyExpiresAtMs = timestamp + _configuration.previousKeyGraceMs;
+            slot.key = std::move(slot.ratchetedKeys[i]);
+            slot.ratchetedKeys.erase(slot.ratchetedKeys.begin(), slot.ratchetedKeys.begin() + i + 1);
+            fillRatchetedKeys(slot);
+            return resultSize;
+        }
+    }
+    slot.nextRatchetSearchAtMs = timestamp + _configuration.ratchetSearchIntervalMs;
+
+    return 0;
+}
+
+} // namespace tgcalls
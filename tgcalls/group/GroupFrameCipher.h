@@ -0,0 +1,85 @@
+#ifndef TGCALLS_GROUP_FRAME_CIPHER_H
+#define TGCALLS_GROUP_FRAME_CIPHER_H
+
+#include "GroupE2EFrameTransform.h"
+
+#include "rtc_base/synchronization/mutex.h"
+
+#include <array>
+#include <map>
+#include <memory>
+
+namespace tgcalls {
+
+// Built-in GroupE2EFrameTransform with an AEAD frame format:
+//
+//   plaintext prefix | ciphertext | tag (16) | masked trailer (13)
+//
+// The trailer carries the nonce counter, the prefix length and the key index,
+// masked with the tag so that it looks as random as the ciphertext; together
+// with the encryptor retries this keeps H264 output free of start codes.
+// Every sender has up to 16 keys selected by key index. A key can be
+// ratcheted forward by the sender, receivers follow by trying the next few
+// ratchet steps, derived when the key is set, when a frame fails to
+// authenticate. The replaced key keeps opening late frames for a short while.
+// Cipher contexts are created when keys are set or followed, never for a
+// frame that fails.
+class GroupFrameCipher final : public GroupE2EFrameTransform {
+public:
+    enum class Algorithm {
+        AesGcm,
+        ChaCha20Poly1305
+    };
+
+    struct Configuration {
+        Algorithm algorithm = Algorithm::AesGcm;
+        // Ratchet steps a receiver tries before dropping an undecryptable frame.
+        int maxRatchetSteps = 8;
+        // After a frame matched no ratchet step, the next frames of that key
+        // index are not tried against the ratchet for this long.
+        int ratchetSearchIntervalMs = 100;
+        // How long a key replaced by a ratchet step still opens frames.
+        int previousKeyGraceMs = 2000;
+    };
+
+    static constexpr size_t kMinKeySize = 32;
+    static constexpr uint8_t kKeyIndexCount = 16;
+
+    explicit GroupFrameCipher(Configuration configuration);
+    ~GroupFrameCipher() override;
+
+    // |key| must hold at least kMinKeySize bytes of uniformly random data.
+    void setOwnKey(rtc::ArrayView<const uint8_t> key, uint8_t keyIndex);
+    // Replaces the current own key with the next one derived from it.
+    void ratchetOwnKey();
+    void setParticipantKey(int64_t userId, rtc::ArrayView<const uint8_t> key, uint8_t keyIndex);
+    void removeParticipant(int64_t userId);
+
+    size_t maxOverhead() const override;
+    size_t transform(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId, bool isEncrypt, int32_t plaintextPrefix) override;
+
+private:
+    class Key;
+    struct KeySlot;
+    struct Participant;
+
+    size_t encrypt(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int32_t plaintextPrefix);
+    size_t decrypt(rtc::ArrayView<const uint8_t> input, rtc::ArrayView<uint8_t> output, int64_t userId);
+    void fillRatchetedKeys(KeySlot &slot) const;
+
+private:
+    Configuration _configuration;
+
+    webrtc::Mutex _ownKeyMutex;
+    std::unique_ptr<Key> _ownKey;
+    uint8_t _ownKeyIndex = 0;
+    // Starts at a random value for every own key.
+    uint64_t _nonceCounter = 0;
+
+    webrtc::Mutex _participantsMutex;
+    std::map<int64_t, std::shared_ptr<Participant>> _participants;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -56,11 +56,20 @@
 #include "AudioDeviceHelper.h"
 #include "FakeAudioDeviceModule.h"
 #include "StreamingMediaContext.h"
+#include "IncomingAudioChannelScheduler.h"
+#include "GroupLevelsAggregator.h"
+#include "GroupVideoConstraintsPlanner.h"
+#include "GroupE2EFrameTransform.h"
+#include "utils/AudioKernels.h"
+#include "utils/H26xStartCodes.h"
+#include "utils/VideoSinkFanout.h"
+#include "ExternalAudioBuffer.h"
 #ifdef WEBRTC_IOS
 #include "platform/darwin/iOS/tgcalls_audio_device_module_ios.h"
 #endif
 #include <mutex>
 #include <random>
+#include <set>
 #include <sstream>
 #include <iostream>
 
@@ -378,15 +387,6 @@ struct VideoSsrcs {
     }
 };
 
-struct InternalGroupLevelValue {
-    GroupLevelValue value;
-    int64_t timestamp = 0;
-};
-
-struct InternalGroupActivityValue {
-    int64_t timestamp = 0;
-};
-
 struct ChannelId {
   uint32_t networkSsrc = 0;
   uint32_t actualSsrc = 0;
@@ -451,6 +451,10 @@ struct RequestedMediaChannelDescriptions {
 
 static const int kVadResultHistoryLength = 8;
 
+// Speculative channels are anonymous until their description arrives, keep few of them.
+static const size_t kMaxSpeculativeAudioChannels = 4;
+static const int64_t kSpeculativeAudioChannelTimeoutMs = 5000;
+
 class VadHistory {
 private:
     float _vadResultHistory[kVadResultHistoryLength];
@@ -585,20 +589,11 @@ public:
             const int16_t *samples = (const int16_t *)audio.data;
             int numberOfSamplesInFrame = (int)audio.samples_per_channel;
 
-            int16_t currentPeak = 0;
-            for (int i = 0; i < numberOfSamplesInFrame; i++) {
-                int16_t sample = samples[i];
-                if (sample < 0) {
-                    sample = -sample;
-                }
-                if (_peak < sample) {
-                    _peak = sample;
-                }
-                if (currentPeak < sample) {
-                    currentPeak = sample;
-                }
-                _peakCount += 1;
+            int16_t currentPeak = peakAbsInt16(samples, numberOfSamplesInFrame);
+            if (_peak < currentPeak) {
+                _peak = currentPeak;
             }
+            _peakCount += numberOfSamplesInFrame;
 
             /*bool vadResult = false;
             if (currentPeak > 10) {
@@ -659,44 +654,26 @@ public:
             _lastFrameSizeChangeTimestamp = timestamp;
         }
         _lastFrame = frame;
-        for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
-            auto strong = _sinks[i].lock();
-            if (!strong) {
-                _sinks.erase(_sinks.begin() + i);
-            } else {
-                strong->OnFrame(frame);
-            }
-        }
+        _fanout.onFrame(frame);
     }
 
     virtual void OnDiscardedFrame() override {
         std::unique_lock<std::mutex> lock{ _mutex };
-        for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
-            auto strong = _sinks[i].lock();
-            if (!strong) {
-                _sinks.erase(_sinks.begin() + i);
-            } else {
-                strong->OnDiscardedFrame();
-            }
-        }
+        _fanout.onDiscardedFrame();
     }
 
-    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl) {
-        if (const auto strong = impl.lock()) {
-            std::unique_lock<std::mutex> lock{ _mutex };
-            _sinks.push_back(impl);
-            if (_lastFrame) {
-                strong->OnFrame(_lastFrame.value());
-            }
-        }
+    void addSink(VideoSinkRegistration const &registration) {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _fanout.addSink(registration, _lastFrame ? &_lastFrame.value() : nullptr);
     }
 
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> getSinks() {
-        return _sinks;
+    std::vector<VideoSinkRegistration> getSinks() {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        return _fanout.getSinks();
     }
 
 private:
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> _sinks;
+    VideoSinkFanout _fanout;
     absl::optional<webrtc::VideoFrame> _lastFrame;
     std::mutex _mutex;
     int64_t _lastFrameSizeChangeTimestamp = 0;
@@ -717,11 +694,10 @@ struct NoiseSuppressionConfiguration {
 #if USE_RNNOISE
 class AudioCapturePostProcessor : public webrtc::CustomProcessing {
 public:
-    AudioCapturePostProcessor(std::function<void(GroupLevelValue const &)> updated, std::shared_ptr<NoiseSuppressionConfiguration> noiseSuppressionConfiguration, std::vector<float> *externalAudioSamples, webrtc::Mutex *externalAudioSamplesMutex) :
+    AudioCapturePostProcessor(std::function<void(GroupLevelValue const &)> updated, std::shared_ptr<NoiseSuppressionConfiguration> noiseSuppressionConfiguration, ExternalAudioBuffer *externalAudioBuffer) :
     _updated(updated),
     _noiseSuppressionConfiguration(noiseSuppressionConfiguration),
-    _externalAudioSamples(externalAudioSamples),
-    _externalAudioSamplesMutex(externalAudioSamplesMutex) {
+    _externalAudioBuffer(externalAudioBuffer) {
         int frameSize = rnnoise_get_frame_size();
         _frameSamples.resize(frameSize);
 
@@ -763,11 +739,7 @@ private:
             buffer = newBuffer;
         }
 
-        float sourcePeak = 0.0f;
-        float *sourceSamples = buffer->channels()[0];
-        for (int i = 0; i < _frameSamples.size(); i++) {
-            sourcePeak = std::max(std::fabs(sourceSamples[i]), sourcePeak);
-        }
+        float sourcePeak = peakAbsFloat(buffer->channels()[0], _frameSamples.size());
 
         if (_noiseSuppressionConfiguration) {
             float vadProbability = 0.0f;
@@ -778,19 +750,8 @@ private:
                 }
             }
 
-            float peak = 0;
-            int peakCount = 0;
-            const float *samples = buffer->channels_const()[0];
-            for (int i = 0; i < buffer->num_frames(); i++) {
-                float sample = samples[i];
-                if (sample < 0) {
-                    sample = -sample;
-                }
-                if (peak < sample) {
-                    peak = sample;
-                }
-                peakCount += 1;
-            }
+            float peak = peakAbsFloat(buffer->channels_const()[0], buffer->num_frames());
+            int peakCount = (int)buffer->num_frames();
 
             bool vadStatus = _history.update(vadProbability);
 
@@ -809,19 +770,8 @@ private:
                 });
             }
         } else {
-            float peak = 0;
-            int peakCount = 0;
-            const float *samples = buffer->channels_const()[0];
-            for (int i = 0; i < buffer->num_frames(); i++) {
-                float sample = samples[i];
-                if (sample < 0) {
-                    sample = -sample;
-                }
-                if (peak < sample) {
-                    peak = sample;
-                }
-                peakCount += 1;
-            }
+            float peak = peakAbsFloat(buffer->channels_const()[0], buffer->num_frames());
+            int peakCount = (int)buffer->num_frames();
 
             _peakCount += peakCount;
             if (_peak < peak) {
@@ -839,24 +789,8 @@ private:
             }
         }
 
-        if (_externalAudioSamplesMutex && _externalAudioSamples) {
-            _externalAudioSamplesMutex->Lock();
-            if (!_externalAudioSamples->empty()) {
-                float *bufferData = buffer->channels()[0];
-                int takenSamples = 0;
-                for (int i = 0; i < _externalAudioSamples->size() && i < _frameSamples.size(); i++) {
-                    float sample = (*_externalAudioSamples)[i];
-                    sample += bufferData[i];
-                    sample = std::min(sample, 32768.f);
-                    sample = std::max(sample, -32768.f);
-                    bufferData[i] = sample;
-                    takenSamples++;
-                }
-                if (takenSamples != 0) {
-                    _externalAudioSamples->erase(_externalAudioSamples->begin(), _externalAudioSamples->begin() + takenSamples);
-                }
-            }
-            _externalAudioSamplesMutex->Unlock();
+        if (_externalAudioBuffer) {
+            _externalAudioBuffer->mixInto(buffer->channels()[0], _frameSamples.size());
         }
         
         if (freeBuffer) {
@@ -884,16 +818,14 @@ private:
     VadHistory _history;
     SparseVad _vad;
 
-    std::vector<float> *_externalAudioSamples = nullptr;
-    webrtc::Mutex *_externalAudioSamplesMutex = nullptr;
+    ExternalAudioBuffer *_externalAudioBuffer = nullptr;
 };
 #endif
 
 class AudioInjectionPostProcessor : public webrtc::CustomProcessing {
 public:
-    AudioInjectionPostProcessor(std::vector<float> *externalAudioSamples, webrtc::Mutex *externalAudioSamplesMutex) :
-    _externalAudioSamples(externalAudioSamples),
-    _externalAudioSamplesMutex(externalAudioSamplesMutex) {
+    AudioInjectionPostProcessor(ExternalAudioBuffer *externalAudioBuffer) :
+    _externalAudioBuffer(externalAudioBuffer) {
     }
 
     virtual ~AudioInjectionPostProcessor() {
@@ -911,24 +843,8 @@ private:
             return;
         }
 
-        if (_externalAudioSamplesMutex && _externalAudioSamples) {
-            _externalAudioSamplesMutex->Lock();
-            if (!_externalAudioSamples->empty()) {
-                float *bufferData = buffer->channels()[0];
-                int takenSamples = 0;
-                for (int i = 0; i < _externalAudioSamples->size() && i < buffer->num_frames(); i++) {
-                    float sample = (*_externalAudioSamples)[i];
-                    sample += bufferData[i];
-                    sample = std::min(sample, 32768.f);
-                    sample = std::max(sample, -32768.f);
-                    bufferData[i] = sample;
-                    takenSamples++;
-                }
-                if (takenSamples != 0) {
-                    _externalAudioSamples->erase(_externalAudioSamples->begin(), _externalAudioSamples->begin() + takenSamples);
-                }
-            }
-            _externalAudioSamplesMutex->Unlock();
+        if (_externalAudioBuffer) {
+            _externalAudioBuffer->mixInto(buffer->channels()[0], buffer->num_frames());
         }
     }
 
@@ -940,15 +856,13 @@ private:
     }
 
 private:
-    std::vector<float> *_externalAudioSamples = nullptr;
-    webrtc::Mutex *_externalAudioSamplesMutex = nullptr;
+    ExternalAudioBuffer *_externalAudioBuffer = nullptr;
 };
 
 class ExternalAudioRecorder : public FakeAudioDeviceModule::Recorder {
 public:
-    ExternalAudioRecorder(std::vector<float> *externalAudioSamples, webrtc::Mutex *externalAudioSamplesMutex) :
-    _externalAudioSamples(externalAudioSamples),
-    _externalAudioSamplesMutex(externalAudioSamplesMutex) {
+    ExternalAudioRecorder(ExternalAudioBuffer *externalAudioBuffer) :
+    _externalAudioBuffer(externalAudioBuffer) {
         _samples.resize(480);
     }
 
@@ -958,20 +872,11 @@ public:
     virtual AudioFrame Record() override {
         AudioFrame result;
 
-        _externalAudioSamplesMutex->Lock();
-        if (!_externalAudioSamples->empty() && _externalAudioSamples->size() >= 480) {
-            size_t takenSamples = std::min(_samples.size(), _externalAudioSamples->size());
-            webrtc::FloatS16ToS16(_externalAudioSamples->data(), takenSamples, _samples.data());
-
-            result.num_samples = takenSamples;
-
-            if (takenSamples != 0) {
-                _externalAudioSamples->erase(_externalAudioSamples->begin(), _externalAudioSamples->begin() + takenSamples);
-            }
+        if (_externalAudioBuffer->available() >= _samples.size()) {
+            result.num_samples = _externalAudioBuffer->read(_samples.data(), _samples.size());
         } else {
             result.num_samples = 0;
         }
-        _externalAudioSamplesMutex->Unlock();
 
         result.audio_samples = _samples.data();
         result.bytes_per_sample = 2;
@@ -984,15 +889,11 @@ public:
     }
 
     virtual int32_t WaitForUs() override {
-        _externalAudioSamplesMutex->Lock();
-        _externalAudioSamplesMutex->Unlock();
-
         return 1000;
     }
 
 private:
-    std::vector<float> *_externalAudioSamples = nullptr;
-    webrtc::Mutex *_externalAudioSamplesMutex = nullptr;
+    ExternalAudioBuffer *_externalAudioBuffer = nullptr;
     std::vector<int16_t> _samples;
 };
 
@@ -1051,20 +952,25 @@ static constexpr size_t kNalHeaderSize = 1;
 static constexpr size_t kFuAHeaderSize = 2;
 constexpr size_t kLengthFieldSize = 2;
 constexpr size_t kStapAHeaderSize = kNalHeaderSize + kLengthFieldSize;
+// first_mb_in_slice, slice_type and pic_parameter_set_id are at most 32 bits
+// of exp-Golomb each, so the PPS ID always ends well within this many bytes.
+constexpr size_t kSliceHeaderPpsIdMaxBytes = 64;
 
 // Calculate bytes needed to include PPS ID in a slice header
 size_t calculateSliceHeaderBytesForPpsId(const uint8_t* data, size_t size) {
     if (size < 2)
         return 0;
 
-    // Convert to RBSP format (remove emulation prevention bytes)
-    std::vector<uint8_t> rbsp = webrtc::H264::ParseRbsp(data, size);
-    if (rbsp.size() < 2)
+    // Convert to RBSP format (remove emulation prevention bytes), only the
+    // beginning of the slice is needed, so it fits on the stack
+    uint8_t rbsp[kSliceHeaderPpsIdMaxBytes];
+    const size_t rbspSize = unescapeH26xEmulation(data, std::min(size, kSliceHeaderPpsIdMaxBytes), 0, rbsp);
+    if (rbspSize < 2)
         return 0;
 
     // Create a bitstream reader for the RBSP data (skipping NAL header)
     // We need to skip the NAL header (1 byte) but still read from the start of the slice header
-    rtc::ArrayView<const uint8_t> rbspView(rbsp.data() + 1, rbsp.size() - 1);
+    rtc::ArrayView<const uint8_t> rbspView(rbsp + 1, rbspSize - 1);
     webrtc::BitstreamReader reader(rbspView);
 
     // first_mb_in_slice: ue(v)
@@ -1102,63 +1008,61 @@ size_t calculateSliceHeaderBytesForPpsId(const uint8_t* data, size_t size) {
  * the PPS ID is included in the unencrypted portion.
  * 
  * The method also ensures that all NAL units start codes are four bytes in length,
- * as WebRTC will always do this on the receiver side.
+ * as WebRTC will always do this on the receiver side. Only when some start codes
+ * are shorter the frame is copied, with the start codes expanded, to |rewrittenFrame|.
  *
  * @param frame The H264 RTP payload in Annex B format
- * @return The size of the header that must remain unencrypted
+ * @param rewrittenFrame Reusable buffer for the frame with expanded start codes
+ * @param headerSize The size of the header that must remain unencrypted
+ * @return Whether the frame to encrypt was written to |rewrittenFrame|
  */
-std::vector<uint8_t> calculateH264FramePlaintextHeaderSize(rtc::ArrayView<const uint8_t> frame, uint32_t& headerSize) {
+bool calculateH264FramePlaintextHeaderSize(rtc::ArrayView<const uint8_t> frame, std::vector<uint8_t> &rewrittenFrame, uint32_t& headerSize) {
     if (frame.empty()) {
         headerSize = 0;
-        return std::vector<uint8_t>();
+        return false;
     }
 
-    // Find all NAL units in the frame
-    std::vector<webrtc::H264::NaluIndex> naluIndices =
-        webrtc::H264::FindNaluIndices(frame.data(), frame.size());
-
-    if (naluIndices.empty()) {
+    // Walk NAL units up to the first slice, the rest of the frame is not scanned
+    H26xNaluReader naluReader(frame.data(), frame.size());
+    H26xNaluIndex naluIndex;
+    if (!naluReader.next(naluIndex)) {
         // No valid NAL units found
         headerSize = 0;
-
-        std::vector<uint8_t> frameData;
-        frameData.resize(frame.size());
-        std::copy(frame.begin(), frame.end(), frameData.begin());
-        return frameData;
+        return false;
     }
 
     // Track the maximum offset we need to keep unencrypted
     size_t maxOffset = 0;
-    std::vector<size_t> naluToUpdate; 
+    size_t shortStartCodeCount = 0;
 
-    for (const auto& naluIndex : naluIndices) {
-        size_t startCodeLength = naluIndex.payload_start_offset - naluIndex.start_offset;
+    do {
+        size_t startCodeLength = naluIndex.payloadStartOffset - naluIndex.startOffset;
 
         // If nalu start code is less than 4 bytes we need to rewrite it because
         // otherwise receiving WebRTC will do this and decryption won't work anymore
         if (startCodeLength == kNalShortStartCode) {
-            naluToUpdate.push_back(naluIndex.start_offset);
+            shortStartCodeCount++;
         }
 
         // Start by including the start code and NAL header
-        size_t headerEndOffset = naluIndex.payload_start_offset + kNalHeaderSize;
+        size_t headerEndOffset = naluIndex.payloadStartOffset + kNalHeaderSize;
 
         // Check if we have enough data to read the NAL unit type
-        if (naluIndex.payload_size >= kNalHeaderSize) {
+        if (naluIndex.payloadSize >= kNalHeaderSize) {
             // Get NAL unit type from the first byte after start code
-            uint8_t nalType = frame[naluIndex.payload_start_offset] & kTypeMask;
+            uint8_t nalType = frame[naluIndex.payloadStartOffset] & kTypeMask;
 
             // Extend header size based on NAL unit type
             if (nalType == kFuA) {
                 // For fragmented units, we need the FU header as well
-                if (naluIndex.payload_size >= kFuAHeaderSize) {
-                    headerEndOffset = naluIndex.payload_start_offset + kFuAHeaderSize;
+                if (naluIndex.payloadSize >= kFuAHeaderSize) {
+                    headerEndOffset = naluIndex.payloadStartOffset + kFuAHeaderSize;
 
                     // For the first fragment, we also need to include PPS ID
-                    bool isStartBit = (frame[naluIndex.payload_start_offset + 1] & 0x80) != 0;
+                    bool isStartBit = (frame[naluIndex.payloadStartOffset + 1] & 0x80) != 0;
                     if (isStartBit) {
                         // Get original NAL type from the FU header
-                        uint8_t originalNalType = frame[naluIndex.payload_start_offset + 1] & kTypeMask;
+                        uint8_t originalNalType = frame[naluIndex.payloadStartOffset + 1] & kTypeMask;
 
                         // If this is an IDR or non-IDR slice, include enough for PPS ID
                         if (originalNalType == kIdr || originalNalType == 1) {
@@ -1169,12 +1073,12 @@ std::vector<uint8_t> calculateH264FramePlaintextHeaderSize(rtc::ArrayView<const
                 }
             } else if (nalType == kStapA) {
                 // For aggregation packets, we need the STAP-A header and first NAL's length field
-                if (naluIndex.payload_size >= kStapAHeaderSize) {
-                    headerEndOffset = naluIndex.payload_start_offset + kStapAHeaderSize;
+                if (naluIndex.payloadSize >= kStapAHeaderSize) {
+                    headerEndOffset = naluIndex.payloadStartOffset + kStapAHeaderSize;
 
                     // Try to get the type of the first aggregated NAL
-                    if (naluIndex.payload_size > kStapAHeaderSize) {
-                        uint8_t firstNalType = frame[naluIndex.payload_start_offset + kStapAHeaderSize] & kTypeMask;
+                    if (naluIndex.payloadSize > kStapAHeaderSize) {
+                        uint8_t firstNalType = frame[naluIndex.payloadStartOffset + kStapAHeaderSize] & kTypeMask;
 
                         // If this is an IDR or non-IDR slice, include enough for PPS ID
                         if (firstNalType == kIdr || firstNalType == 1) {
@@ -1188,45 +1092,58 @@ std::vector<uint8_t> calculateH264FramePlaintextHeaderSize(rtc::ArrayView<const
             else if (nalType == kIdr || nalType == 1) {
                 // Calculate bytes needed to include PPS ID
                 size_t ppsIdBytes = calculateSliceHeaderBytesForPpsId(
-                    frame.data() + naluIndex.payload_start_offset,
-                    naluIndex.payload_size);
+                    frame.data() + naluIndex.payloadStartOffset,
+                    naluIndex.payloadSize);
 
-                headerEndOffset = naluIndex.payload_start_offset + ppsIdBytes;
+                headerEndOffset = naluIndex.payloadStartOffset + ppsIdBytes;
                 maxOffset = std::max(maxOffset, headerEndOffset);
                 break;
             }
             // For keyframe related NAL units, ensure we keep their header
             else if (nalType == kSps || nalType == kPps || nalType == kSei) {
                 // SPS and PPS need to be kept entirely in plaintext
-                headerEndOffset = naluIndex.payload_start_offset + naluIndex.payload_size;
+                headerEndOffset = naluIndex.payloadStartOffset + naluIndex.payloadSize;
             }
         }
 
         // Update the maximum offset
         maxOffset = std::max(maxOffset, headerEndOffset);
+    } while (naluReader.next(naluIndex));
+
+    headerSize = static_cast<uint32_t>(maxOffset + shortStartCodeCount);
+    if (shortStartCodeCount == 0) {
+        return false;
     }
 
-    std::vector<uint8_t> frameData;
-    frameData.resize(frame.size() + naluToUpdate.size());
+    rewrittenFrame.resize(frame.size() + shortStartCodeCount);
 
     size_t offset = 0;
+    size_t inserted = 0;
 
-    for (size_t i = 0; i < naluToUpdate.size(); ++i) {
-        const auto& naluIndex = naluToUpdate[i];
-        if (naluIndex - offset > 0) {
-            std::copy(frame.begin() + offset, frame.begin() + naluIndex, frameData.begin() + offset + i);
+    H26xNaluReader rewriteReader(frame.data(), frame.size());
+    while (rewriteReader.next(naluIndex)) {
+        // Only start codes up to the first slice were counted above
+        if (inserted == shortStartCodeCount) {
+            break;
+        }
+        if (naluIndex.payloadStartOffset - naluIndex.startOffset != kNalShortStartCode) {
+            continue;
+        }
+        const auto position = naluIndex.startOffset;
+        if (position - offset > 0) {
+            std::copy(frame.begin() + offset, frame.begin() + position, rewrittenFrame.begin() + offset + inserted);
         }
 
-        frameData[naluIndex + i] = 0;
-        offset = naluIndex;
+        rewrittenFrame[position + inserted] = 0;
+        inserted++;
+        offset = position;
     }
 
     if (offset < frame.size()) {
-        std::copy(frame.begin() + offset, frame.end(), frameData.begin() + offset + naluToUpdate.size());
+        std::copy(frame.begin() + offset, frame.end(), rewrittenFrame.begin() + offset + inserted);
     }
-        
-    headerSize = static_cast<uint32_t>(maxOffset + naluToUpdate.size());
-    return frameData;
+
+    return true;
 }
 
 // VP8 Payload Header constants
@@ -1251,11 +1168,10 @@ constexpr uint8_t P_BIT = 0x01;  // Inverse key frame flag (0=key frame, 1=delta
  * @param frame The VP8 payload data (after RTP header and VP8 payload descriptor)
  * @return The size of the header that must remain unencrypted
  */
-std::vector<uint8_t> calculateVp8FramePlaintextHeaderSize(rtc::ArrayView<const uint8_t> frame, uint32_t& headerSize) {
+uint32_t calculateVp8FramePlaintextHeaderSize(rtc::ArrayView<const uint8_t> frame) {
     // Ensure we have at least 1 byte
     if (frame.empty()) {
-        headerSize = 0;
-        return std::vector<uint8_t>();
+        return 0;
     }
     
     // First byte of VP8 payload header
@@ -1267,16 +1183,11 @@ std::vector<uint8_t> calculateVp8FramePlaintextHeaderSize(rtc::ArrayView<const u
     if (is_key_frame) {
         // For key frames, leave 10 bytes unencrypted to cover the full uncompressed VP8 header
         // This includes the frame dimensions
-        headerSize = frame.size() >= 10 ? 10 : ((uint32_t)frame.size());
+        return frame.size() >= 10 ? 10 : ((uint32_t)frame.size());
     } else {
         // For delta frames, just leave 1 byte unencrypted (payload header)
-        headerSize = 1;
+        return 1;
     }
-
-    std::vector<uint8_t> frameData;
-    frameData.resize(frame.size());
-    std::copy(frame.begin(), frame.end(), frameData.begin());
-    return frameData;
 }
 
 enum class FrameTransformerPayloadType {
@@ -1288,63 +1199,6 @@ enum class FrameTransformerPayloadType {
 
 constexpr uint8_t kH26XNaluShortStartSequenceSize = 3;
 
-using IndexStartCodeSizePair = std::pair<size_t, size_t>;
-
-std::optional<IndexStartCodeSizePair> FindNextH26XNaluIndex(const uint8_t* buffer,
-                                                            const size_t bufferSize,
-                                                            const size_t searchStartIndex = 0)
-{
-    constexpr uint8_t kH26XStartCodeHighestPossibleValue = 1;
-    constexpr uint8_t kH26XStartCodeEndByteValue = 1;
-    constexpr uint8_t kH26XStartCodeLeadingBytesValue = 0;
-
-    if (bufferSize < kH26XNaluShortStartSequenceSize) {
-        return std::nullopt;
-    }
-
-    // look for NAL unit 3 or 4 byte start code
-    for (size_t i = searchStartIndex; i < bufferSize - kH26XNaluShortStartSequenceSize;) {
-        if (buffer[i + 2] > kH26XStartCodeHighestPossibleValue) {
-            // third byte is not 0 or 1, can't be a start code
-            i += kH26XNaluShortStartSequenceSize;
-        }
-        else if (buffer[i + 2] == kH26XStartCodeEndByteValue) {
-            // third byte matches the start code end byte, might be a start code sequence
-            if (buffer[i + 1] == kH26XStartCodeLeadingBytesValue &&
-                buffer[i] == kH26XStartCodeLeadingBytesValue) {
-                // confirmed start sequence {0, 0, 1}
-                auto nalUnitStartIndex = i + kH26XNaluShortStartSequenceSize;
-
-                if (i >= 1 && buffer[i - 1] == kH26XStartCodeLeadingBytesValue) {
-                    // 4 byte start code
-                    return std::optional<IndexStartCodeSizePair>({nalUnitStartIndex, 4});
-                }
-                else {
-                    // 3 byte start code
-                    return std::optional<IndexStartCodeSizePair>({nalUnitStartIndex, 3});
-                }
-            }
-
-            i += kH26XNaluShortStartSequenceSize;
-        }
-        else {
-            // third byte is 0, might be a four byte start code
-            ++i;
-        }
-    }
-
-    return std::nullopt;
-}
-
-struct UnencryptedRange {
-    size_t offset = 0;
-    size_t size = 0;
-    
-    UnencryptedRange(size_t offset_, size_t size_) :
-    offset(offset_), size(size_) {
-    }
-};
-
 bool ValidateEncryptedFrame(FrameTransformerPayloadType payloadType, rtc::ArrayView<uint8_t> frame, int plaintextPrefix) {
     if (payloadType != FrameTransformerPayloadType::H264) {
         return true;
@@ -1353,48 +1207,85 @@ bool ValidateEncryptedFrame(FrameTransformerPayloadType payloadType, rtc::ArrayV
     static_assert(kH26XNaluShortStartSequenceSize - 1 >= 0, "Padding will overflow!");
     constexpr size_t Padding = kH26XNaluShortStartSequenceSize - 1;
 
-    std::vector<UnencryptedRange> unencryptedRanges;
-    if (plaintextPrefix != 0) {
-        unencryptedRanges.emplace_back(0, plaintextPrefix);
-    }
-
     // H264 and H265 ciphertexts cannot contain a 3 or 4 byte start code {0, 0, 1}
     // otherwise the packetizer gets confused
-    // and the frame we get on the decryption side will be shifted and fail to decrypt
-    size_t encryptedSectionStart = 0;
-    for (auto& range : unencryptedRanges) {
-        if (encryptedSectionStart == range.offset) {
-            encryptedSectionStart += range.size;
-            continue;
-        }
+    // and the frame we get on the decryption side will be shifted and fail to decrypt.
+    // A start code may begin in the last bytes of the plaintext prefix.
+    const auto encryptedSectionStart = std::min((size_t)std::max(plaintextPrefix, 0), frame.size());
+    if (encryptedSectionStart == frame.size()) {
+        return true;
+    }
 
-        auto start = encryptedSectionStart - std::min(encryptedSectionStart, size_t{Padding});
-        auto end = std::min(range.offset + Padding, frame.size());
-        if (FindNextH26XNaluIndex(frame.data() + start, end - start)) {
-            return false;
-        }
+    const auto start = encryptedSectionStart - std::min(encryptedSectionStart, Padding);
+    return findH26xStartCode(frame.data(), frame.size(), start) == frame.size();
+}
 
-        encryptedSectionStart = range.offset + range.size;
-    }
+// Trailer of an escaped frame: the plaintext prefix length in 7-bit groups, each
+// with the high bit set so that it can't take part in a start code.
+constexpr size_t kEscapedFramePrefixSizeBytes = 3;
+constexpr size_t kEscapedFrameMaxPrefixSize = (size_t(1) << (7 * kEscapedFramePrefixSizeBytes)) - 1;
 
-    if (encryptedSectionStart == frame.size()) {
-        return true;
+size_t countTrailingZeroBytes(const uint8_t *data, size_t size) {
+    size_t result = 0;
+    while (result < 2 && result < size && data[size - 1 - result] == 0) {
+        result++;
     }
+    return result;
+}
 
-    auto start = encryptedSectionStart - std::min(encryptedSectionStart, size_t{Padding});
-    auto end = frame.size();
-    if (FindNextH26XNaluIndex(frame.data() + start, end - start)) {
+// Writes prefix | escaped(rest) | prefix size to |out|, which is resized to fit.
+bool EscapeEncryptedFrame(rtc::ArrayView<const uint8_t> frame, size_t plaintextPrefix, std::vector<uint8_t> &out) {
+    if (plaintextPrefix > frame.size() || plaintextPrefix > kEscapedFrameMaxPrefixSize) {
         return false;
     }
 
+    out.resize(plaintextPrefix + maxEscapedH26xSize(frame.size() - plaintextPrefix) + kEscapedFramePrefixSizeBytes);
+    std::copy(frame.begin(), frame.begin() + plaintextPrefix, out.begin());
+    size_t size = plaintextPrefix + escapeH26xEmulation(
+        frame.data() + plaintextPrefix,
+        frame.size() - plaintextPrefix,
+        countTrailingZeroBytes(frame.data(), plaintextPrefix),
+        out.data() + plaintextPrefix);
+    for (size_t i = 0; i < kEscapedFramePrefixSizeBytes; i++) {
+        out[size++] = 0x80 | ((plaintextPrefix >> (7 * i)) & 0x7f);
+    }
+    out.resize(size);
     return true;
 }
 
+// Reverses EscapeEncryptedFrame, returns the size of the frame written to |out|.
+size_t UnescapeEncryptedFrame(rtc::ArrayView<const uint8_t> frame, std::vector<uint8_t> &out) {
+    if (frame.size() < kEscapedFramePrefixSizeBytes) {
+        return 0;
+    }
+    const auto escapedSize = frame.size() - kEscapedFramePrefixSizeBytes;
+    size_t plaintextPrefix = 0;
+    for (size_t i = 0; i < kEscapedFramePrefixSizeBytes; i++) {
+        const auto value = frame[escapedSize + i];
+        if ((value & 0x80) == 0) {
+            return 0;
+        }
+        plaintextPrefix |= size_t(value & 0x7f) << (7 * i);
+    }
+    if (plaintextPrefix > escapedSize) {
+        return 0;
+    }
+
+    out.resize(escapedSize);
+    std::copy(frame.begin(), frame.begin() + plaintextPrefix, out.begin());
+    return plaintextPrefix + unescapeH26xEmulation(
+        frame.data() + plaintextPrefix,
+        escapedSize - plaintextPrefix,
+        countTrailingZeroBytes(frame.data(), plaintextPrefix),
+        out.data() + plaintextPrefix);
+}
+
 class FrameTransformer : public webrtc::FrameTransformerInterface {
 public:
-    FrameTransformer(bool isEncryptor, std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)> transform, int64_t userId, std::map<int32_t, FrameTransformerPayloadType> const &payloadTypeMapping, std::function<std::pair<uint8_t, bool>()> getAudioLevelAndSpeech, std::function<void(uint8_t, bool)> setAudioLevelAndSpeech) :
+    FrameTransformer(bool isEncryptor, std::shared_ptr<GroupE2EFrameTransform> transform, bool escapeEncryptedFrames, int64_t userId, std::map<int32_t, FrameTransformerPayloadType> const &payloadTypeMapping, std::function<std::pair<uint8_t, bool>()> getAudioLevelAndSpeech, std::function<void(uint8_t, bool)> setAudioLevelAndSpeech) :
     _isEncryptor(isEncryptor),
-    _transform(transform),
+    _transform(std::move(transform)),
+    _escapeEncryptedFrames(escapeEncryptedFrames),
     _userId(userId),
     _payloadTypeMapping(payloadTypeMapping),
     _getAudioLevelAndSpeech(getAudioLevelAndSpeech),
@@ -1415,6 +1306,7 @@ public:
     virtual void UnregisterTransformedFrameSinkCallback(uint32_t ssrc) override {
         webrtc::MutexLock lock(&_mutex);
         _sinkCallbackBySsrc.erase(ssrc);
+        _scratchBySsrc.erase(ssrc);
     }
 
     virtual void Transform(std::unique_ptr<webrtc::TransformableFrameInterface> frame) override {
@@ -1435,37 +1327,58 @@ public:
             payloadType = foundPayloadType->second;
         }
 
+        // Buffers are kept per ssrc so that their capacity settles on the usual
+        // frame size of the stream and no further allocations happen.
+        auto &scratch = _scratchBySsrc[ssrc];
+        const auto data = frame->GetData();
+        const auto overhead = _transform->maxOverhead();
+
         if (_isEncryptor) {
             if (payloadType == FrameTransformerPayloadType::H264 || payloadType == FrameTransformerPayloadType::VP8) {
                 uint32_t plaintextHeaderSize = 0;
-                std::vector<uint8_t> frameData;
+                rtc::ArrayView<const uint8_t> input = data;
                 if (payloadType == FrameTransformerPayloadType::H264) {
-                    frameData = calculateH264FramePlaintextHeaderSize(frame->GetData(), plaintextHeaderSize);
+                    if (calculateH264FramePlaintextHeaderSize(data, scratch.input, plaintextHeaderSize)) {
+                        input = scratch.input;
+                    }
                 } else if (payloadType == FrameTransformerPayloadType::VP8) {
-                    frameData = calculateVp8FramePlaintextHeaderSize(frame->GetData(), plaintextHeaderSize);
+                    plaintextHeaderSize = calculateVp8FramePlaintextHeaderSize(data);
                 }
 
-                if (plaintextHeaderSize > (uint32_t)frameData.size()) {
-                    plaintextHeaderSize = (uint32_t)frameData.size();
+                if (plaintextHeaderSize > (uint32_t)input.size()) {
+                    plaintextHeaderSize = (uint32_t)input.size();
                 }
 
+                scratch.output.resize(input.size() + overhead);
+                if (_escapeEncryptedFrames && payloadType == FrameTransformerPayloadType::H264) {
+                    // A single pass, escaping makes the ciphertext start code free
+                    const auto resultSize = _transform->transform(input, scratch.output, _userId, _isEncryptor, plaintextHeaderSize);
+                    if (resultSize == 0) {
+                        return;
+                    }
+                    const auto result = rtc::ArrayView<const uint8_t>(scratch.output.data(), resultSize);
+                    if (EscapeEncryptedFrame(result, std::min((size_t)plaintextHeaderSize, resultSize), scratch.escaped)) {
+                        frame->SetData(scratch.escaped);
+                        sink->OnTransformedFrame(std::move(frame));
+                    }
+                    return;
+                }
                 for (int attempt = 0; attempt < 4; attempt++) {
-                    auto result = _transform(frameData, _userId, _isEncryptor, plaintextHeaderSize);
-                    
-                    if (!result.empty()) {
-                        if (ValidateEncryptedFrame(payloadType, result, plaintextHeaderSize)) {
-                            frame->SetData(result);
-                            sink->OnTransformedFrame(std::move(frame));
-                            break;
-                        }
-                    } else {
+                    const auto resultSize = _transform->transform(input, scratch.output, _userId, _isEncryptor, plaintextHeaderSize);
+                    if (resultSize == 0) {
+                        break;
+                    }
+                    const auto result = rtc::ArrayView<uint8_t>(scratch.output.data(), resultSize);
+                    if (ValidateEncryptedFrame(payloadType, result, plaintextHeaderSize)) {
+                        frame->SetData(result);
+                        sink->OnTransformedFrame(std::move(frame));
                         break;
                     }
                 }
             } else {
-                std::vector<uint8_t> buffer;
-                buffer.resize(frame->GetData().size() + 1 + 1);
-                std::copy(frame->GetData().begin(), frame->GetData().end(), buffer.begin());
+                auto &buffer = scratch.input;
+                buffer.resize(data.size() + 1 + 1);
+                std::copy(data.begin(), data.end(), buffer.begin());
                 
                 buffer[buffer.size() - 1 - 1] = 0x01;
                 std::pair<uint8_t, bool> audioLevelAndSpeech = std::make_pair(0, false);
@@ -1479,56 +1392,61 @@ public:
                 encodedAudioLevelAndSpeech |= audioLevelAndSpeech.first & 0x7f;
                 buffer[buffer.size() - 1] = encodedAudioLevelAndSpeech;
                 
-                auto result = _transform(buffer, _userId, _isEncryptor, 0);
-                if (!result.empty()) {
-                    frame->SetData(result);
+                scratch.output.resize(buffer.size() + overhead);
+                const auto resultSize = _transform->transform(buffer, scratch.output, _userId, _isEncryptor, 0);
+                if (resultSize != 0) {
+                    frame->SetData(rtc::ArrayView<const uint8_t>(scratch.output.data(), resultSize));
                     sink->OnTransformedFrame(std::move(frame));
                 }
             }
         } else {
-            if (payloadType != FrameTransformerPayloadType::Opus) {
-                std::vector<uint8_t> encryptedFrame;
-                encryptedFrame.resize(frame->GetData().size());
-                std::copy(frame->GetData().begin(), frame->GetData().end(), encryptedFrame.begin());
-                
-                auto decryptedFrame = _transform(encryptedFrame, _userId, false, 0);
-                if (!decryptedFrame.empty()) {
-                    frame->SetData(decryptedFrame);
-                    sink->OnTransformedFrame(std::move(frame));
+            rtc::ArrayView<const uint8_t> input = data;
+            if (_escapeEncryptedFrames && payloadType == FrameTransformerPayloadType::H264) {
+                const auto unescapedSize = UnescapeEncryptedFrame(data, scratch.escaped);
+                if (unescapedSize == 0) {
+                    return;
                 }
-            } else {
-                std::vector<uint8_t> buffer;
-                buffer.resize(frame->GetData().size());
-                std::copy(frame->GetData().begin(), frame->GetData().end(), buffer.begin());
-                
-                auto result = _transform(buffer, _userId, false, 0);
-                if (!result.empty()) {
-                    if (result.size() >= 2) {
-                        uint8_t extensionFlags = result[result.size() - 2];
-                        if (extensionFlags & 0x01) {
-                            uint8_t audioLevelAndSpeech = result[result.size() - 1];
-                            if (_setAudioLevelAndSpeech) {
-                                bool hasSpeech = (audioLevelAndSpeech & 0x80) != 0;
-                                uint8_t audioLevel = audioLevelAndSpeech & 0x7f;
-                                _setAudioLevelAndSpeech(audioLevel, hasSpeech);
-                            }
+                input = rtc::ArrayView<const uint8_t>(scratch.escaped.data(), unescapedSize);
+            }
 
-                            result.resize(result.size() - 2);
-                        } else {
-                            result.resize(result.size() - 1);
-                        }
+            scratch.output.resize(input.size() + overhead);
+            auto resultSize = _transform->transform(input, scratch.output, _userId, false, 0);
+            if (resultSize == 0) {
+                return;
+            }
+
+            if (payloadType == FrameTransformerPayloadType::Opus && resultSize >= 2) {
+                const auto result = scratch.output.data();
+                uint8_t extensionFlags = result[resultSize - 2];
+                if (extensionFlags & 0x01) {
+                    uint8_t audioLevelAndSpeech = result[resultSize - 1];
+                    if (_setAudioLevelAndSpeech) {
+                        bool hasSpeech = (audioLevelAndSpeech & 0x80) != 0;
+                        uint8_t audioLevel = audioLevelAndSpeech & 0x7f;
+                        _setAudioLevelAndSpeech(audioLevel, hasSpeech);
                     }
-                    
-                    frame->SetData(result);
-                    sink->OnTransformedFrame(std::move(frame));
+
+                    resultSize -= 2;
+                } else {
+                    resultSize -= 1;
                 }
             }
+
+            frame->SetData(rtc::ArrayView<const uint8_t>(scratch.output.data(), resultSize));
+            sink->OnTransformedFrame(std::move(frame));
         }
     }
 
 private:
+    struct FrameScratch {
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        std::vector<uint8_t> escaped;
+    };
+
     bool _isEncryptor = false;
-    std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)> _transform;
+    std::shared_ptr<GroupE2EFrameTransform> _transform;
+    bool _escapeEncryptedFrames = false;
     int64_t _userId = 0;
     std::map<int32_t, FrameTransformerPayloadType> _payloadTypeMapping;
     std::function<std::pair<uint8_t, bool>()> _getAudioLevelAndSpeech;
@@ -1536,6 +1454,7 @@ private:
     webrtc::Mutex _mutex;
     rtc::scoped_refptr<webrtc::TransformedFrameCallback> _sinkCallback;
     std::map<uint32_t, rtc::scoped_refptr<webrtc::TransformedFrameCallback>> _sinkCallbackBySsrc;
+    std::map<uint32_t, FrameScratch> _scratchBySsrc;
 };
 
 class IncomingAudioChannel : public sigslot::has_slots<> {
@@ -1551,16 +1470,17 @@ public:
         std::function<void(AudioSinkImpl::Update)> &&onAudioLevelUpdated,
         std::function<void(uint32_t, const AudioFrame &)> onAudioFrame,
         std::shared_ptr<Threads> threads,
-        std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)> e2eEncryptDecrypt,
+        std::shared_ptr<GroupE2EFrameTransform> e2eFrameTransform,
         std::map<int32_t, FrameTransformerPayloadType> const &payloadTypeMapping,
         std::function<void(uint32_t, uint8_t, bool)> setAudioLevelAndSpeech) :
     _threads(threads),
     _ssrc(ssrc),
+    _userId(userId),
     _channelManager(channelManager),
     _call(call) {
         _creationTimestamp = rtc::TimeMillis();
 
-        threads->getWorkerThread()->BlockingCall([this, rtpTransport, ssrc, onAudioFrame = std::move(onAudioFrame), onAudioLevelUpdated = std::move(onAudioLevelUpdated), isRawPcm, userId, e2eEncryptDecrypt, payloadTypeMapping, setAudioLevelAndSpeech]() mutable {
+        threads->getWorkerThread()->BlockingCall([this, rtpTransport, ssrc, onAudioFrame = std::move(onAudioFrame), onAudioLevelUpdated = std::move(onAudioLevelUpdated), isRawPcm, userId, e2eFrameTransform, payloadTypeMapping, setAudioLevelAndSpeech]() mutable {
             cricket::AudioOptions audioOptions;
             audioOptions.audio_jitter_buffer_fast_accelerate = true;
             audioOptions.audio_jitter_buffer_min_delay_ms = 50;
@@ -1622,8 +1542,8 @@ public:
             outgoingAudioDescription.reset();
             incomingAudioDescription.reset();
 
-            if (e2eEncryptDecrypt) {
-                _audioChannel->receive_channel()->SetDepacketizerToDecoderFrameTransformer(_ssrc.networkSsrc, rtc::make_ref_counted<FrameTransformer>(false, e2eEncryptDecrypt, userId, payloadTypeMapping, nullptr, [ssrc, setAudioLevelAndSpeech](uint8_t audioLevel, bool hasSpeech) {
+            if (e2eFrameTransform) {
+                _audioChannel->receive_channel()->SetDepacketizerToDecoderFrameTransformer(_ssrc.networkSsrc, rtc::make_ref_counted<FrameTransformer>(false, e2eFrameTransform, false, userId, payloadTypeMapping, nullptr, [ssrc, setAudioLevelAndSpeech](uint8_t audioLevel, bool hasSpeech) {
                     setAudioLevelAndSpeech(ssrc.networkSsrc, audioLevel, hasSpeech);
                 }));
             }
@@ -1661,6 +1581,37 @@ public:
         return _activityTimestamp;
     }
 
+    void updateSpeechActivity() {
+        _speechTimestamp = rtc::TimeMillis();
+    }
+
+    int64_t getSpeechActivity() {
+        return std::max(_speechTimestamp, _creationTimestamp);
+    }
+
+    // A suspended channel drops incoming packets instead of feeding the jitter buffer,
+    // so neither decoding nor mixing happens until it is resumed.
+    void setIsDecodingSuspended(bool isDecodingSuspended) {
+        if (_isDecodingSuspended == isDecodingSuspended) {
+            return;
+        }
+        _isDecodingSuspended = isDecodingSuspended;
+        _audioChannel->Enable(!isDecodingSuspended);
+    }
+
+    bool isDecodingSuspended() const {
+        return _isDecodingSuspended;
+    }
+
+    int64_t userId() const {
+        return _userId;
+    }
+
+    // Speculative channels are created before their description is known.
+    void setUserId(int64_t userId) {
+        _userId = userId;
+    }
+
 private:
     void OnSentPacket_w(const rtc::SentPacket& sent_packet) {
         _call->OnSentPacket(sent_packet);
@@ -1669,6 +1620,7 @@ private:
 private:
     std::shared_ptr<Threads> _threads;
     ChannelId _ssrc;
+    int64_t _userId = 0;
     // Memory is managed by _channelManager
     cricket::VoiceChannel *_audioChannel = nullptr;
     // Memory is managed externally
@@ -1676,6 +1628,8 @@ private:
     webrtc::Call *_call = nullptr;
     int64_t _creationTimestamp = 0;
     int64_t _activityTimestamp = 0;
+    int64_t _speechTimestamp = 0;
+    bool _isDecodingSuspended = false;
 };
 
 class IncomingVideoChannel : public sigslot::has_slots<> {
@@ -1693,9 +1647,11 @@ public:
         VideoChannelDescription::Quality maxQuality,
         GroupParticipantVideoInformation const &description,
         std::shared_ptr<Threads> threads,
-        std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)> e2eEncryptDecrypt,
+        std::shared_ptr<GroupE2EFrameTransform> e2eFrameTransform,
+        bool escapeEncryptedFrames,
         std::map<int32_t, FrameTransformerPayloadType> const &payloadTypeMapping) :
     _threads(threads),
+    _audioSsrc(audioSsrc),
     _endpointId(description.endpointId),
     _channelManager(channelManager),
     _call(call),
@@ -1703,7 +1659,7 @@ public:
     _requestedMaxQuality(maxQuality) {
         _videoSink.reset(new VideoSinkImpl(_endpointId));
 
-        _threads->getWorkerThread()->BlockingCall([this, rtpTransport, &availableVideoFormats, &description, randomIdGenerator, e2eEncryptDecrypt, userId, payloadTypeMapping]() mutable {
+        _threads->getWorkerThread()->BlockingCall([this, rtpTransport, &availableVideoFormats, &description, randomIdGenerator, e2eFrameTransform, escapeEncryptedFrames, userId, payloadTypeMapping]() mutable {
             uint32_t mid = randomIdGenerator->GenerateId();
             std::string streamId = std::string("video") + uint32ToString(mid);
 
@@ -1784,8 +1740,8 @@ public:
             _videoChannel->SetPayloadTypeDemuxingEnabled(false);
             _videoChannel->receive_channel()->SetSink(_mainVideoSsrc, _videoSink.get());
 
-            if (e2eEncryptDecrypt) {
-                _videoChannel->receive_channel()->SetDepacketizerToDecoderFrameTransformer(_mainVideoSsrc, rtc::make_ref_counted<FrameTransformer>(false, e2eEncryptDecrypt, userId, payloadTypeMapping, nullptr, nullptr));
+            if (e2eFrameTransform) {
+                _videoChannel->receive_channel()->SetDepacketizerToDecoderFrameTransformer(_mainVideoSsrc, rtc::make_ref_counted<FrameTransformer>(false, e2eFrameTransform, escapeEncryptedFrames, userId, payloadTypeMapping, nullptr, nullptr));
             }
         });
 
@@ -1803,14 +1759,18 @@ public:
         });
     }
 
-    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl) {
-        _videoSink->addSink(impl);
+    void addSink(VideoSinkRegistration const &registration) {
+        _videoSink->addSink(registration);
     }
 
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> getSinks() {
+    std::vector<VideoSinkRegistration> getSinks() {
         return _videoSink->getSinks();
     }
 
+    uint32_t audioSsrc() const {
+        return _audioSsrc;
+    }
+
     std::string const &endpointId() {
         return _endpointId;
     }
@@ -1831,6 +1791,14 @@ public:
         _requestedMaxQuality = quality;
     }
 
+    bool isPinned() {
+        return _isPinned;
+    }
+
+    void setIsPinned(bool isPinned) {
+        _isPinned = isPinned;
+    }
+
     void setStats(absl::optional<GroupInstanceStats::IncomingVideoStats> stats) {
         _stats = stats;
     }
@@ -1847,6 +1815,7 @@ private:
 private:
     std::shared_ptr<Threads> _threads;
     uint32_t _mainVideoSsrc = 0;
+    uint32_t _audioSsrc = 0;
     std::string _endpointId;
     std::unique_ptr<VideoSinkImpl> _videoSink;
     std::vector<GroupJoinPayloadVideoSourceGroup> _ssrcGroups;
@@ -1859,6 +1828,7 @@ private:
 
     VideoChannelDescription::Quality _requestedMinQuality = VideoChannelDescription::Quality::Thumbnail;
     VideoChannelDescription::Quality _requestedMaxQuality = VideoChannelDescription::Quality::Thumbnail;
+    bool _isPinned = false;
 
     absl::optional<GroupInstanceStats::IncomingVideoStats> _stats;
 };
@@ -2094,6 +2064,43 @@ struct NetworkBitrateLogRecord {
     int32_t bitrate = 0;
 };
 
+// Header audio levels are -dBov; anything louder than this counts as activity
+// even when the sender's VAD flag is not set.
+constexpr uint8_t kAudibleHeaderAudioLevel = 50;
+constexpr int64_t kSilentAudioSuspendTimeoutMs = 3000;
+// A video endpoint counts as speaking for this long after its last voiced audio.
+constexpr int64_t kVideoSpeakerHoldMs = 2000;
+// Minimum interval between two ReceiverVideoConstraints messages.
+constexpr int64_t kRemoteVideoConstraintsMinIntervalMs = 500;
+
+std::shared_ptr<GroupE2EFrameTransform> e2eFrameTransformFromDescriptor(GroupInstanceDescriptor const &descriptor) {
+    if (descriptor.e2eFrameTransform) {
+        return descriptor.e2eFrameTransform;
+    } else if (descriptor.e2eEncryptDecrypt) {
+        return std::make_shared<LegacyE2EFrameTransform>(descriptor.e2eEncryptDecrypt);
+    }
+    return nullptr;
+}
+
+IncomingAudioChannelScheduler::Configuration audioChannelSchedulerConfiguration(GroupInstanceDescriptor const &descriptor) {
+    IncomingAudioChannelScheduler::Configuration configuration;
+    configuration.maxActiveChannels = descriptor.maxIncomingAudioChannels;
+    return configuration;
+}
+
+GroupVideoConstraintsPlanner::Configuration videoConstraintsPlannerConfiguration(GroupInstanceDescriptor const &descriptor) {
+    GroupVideoConstraintsPlanner::Configuration configuration;
+    configuration.maxDecodePixelsPerSecond = descriptor.maxIncomingVideoDecodePixelsPerSecond;
+    return configuration;
+}
+
+GroupLevelsAggregator::Configuration levelsAggregatorConfiguration(GroupInstanceDescriptor const &descriptor) {
+    GroupLevelsAggregator::Configuration configuration;
+    configuration.onlyChanged = descriptor.audioLevelsDeltaOnly;
+    configuration.refreshIntervalMs = std::max(500, descriptor.audioLevelsUpdatePeriodMs * 5);
+    return configuration;
+}
+
 GroupLevelValue mappedAudioLevel(GroupLevelValue const &value) {
     GroupLevelValue result = value;
     result.level = result.level * 2.0f;
@@ -2127,10 +2134,13 @@ public:
     _enableSystemMute(descriptor.ios_enableSystemMute),
 #endif
     _isConference(descriptor.isConference),
+    _suspendSilentIncomingAudio(descriptor.suspendSilentIncomingAudio && !descriptor.e2eEncryptDecrypt && !descriptor.e2eFrameTransform),
+    _speculativeIncomingAudioChannels(descriptor.speculativeIncomingAudioChannels && descriptor.requestMediaChannelDescriptions && !descriptor.e2eEncryptDecrypt && !descriptor.e2eFrameTransform),
     _minOutgoingVideoBitrateKbit(descriptor.minOutgoingVideoBitrateKbit),
     _videoContentType(descriptor.videoContentType),
     _videoCodecPreferences(std::move(descriptor.videoCodecPreferences)),
-    _e2eEncryptDecrypt(descriptor.e2eEncryptDecrypt),
+    _e2eFrameTransform(e2eFrameTransformFromDescriptor(descriptor)),
+    _e2eEscapeEncryptedFrames(descriptor.e2eEscapeEncryptedFrames),
     _eventLog(std::make_unique<webrtc::RtcEventLogNull>()),
     _webrtcEnvironment(webrtc::EnvironmentFactory().Create()),
     _netEqFactory(createNetEqFactory()),
@@ -2138,11 +2148,16 @@ public:
     _createWrappedAudioDeviceModule(descriptor.createWrappedAudioDeviceModule),
     _initialInputDeviceId(std::move(descriptor.initialInputDeviceId)),
     _initialOutputDeviceId(std::move(descriptor.initialOutputDeviceId)),
+    _audioLevelsUpdatePeriodMs(std::max(20, descriptor.audioLevelsUpdatePeriodMs)),
+    _audioLevelsDeltaOnly(descriptor.audioLevelsDeltaOnly),
+    _levelsAggregator(levelsAggregatorConfiguration(descriptor)),
     _missingPacketBuffer(50),
     _onMutedSpeechActivityDetected(std::move(descriptor.onMutedSpeechActivityDetected)),
     _stereoMode(descriptor.enableStereoMode),
     _customBitrate(descriptor.customBitrate),
-    _HDVideo(descriptor.enableHDVideo) {
+    _HDVideo(descriptor.enableHDVideo),
+    _audioChannelScheduler(audioChannelSchedulerConfiguration(descriptor)),
+    _videoConstraintsPlanner(videoConstraintsPlannerConfiguration(descriptor)) {
         assert(_threads->getMediaThread()->IsCurrent());
 
         _threads->getWorkerThread()->BlockingCall([this] {
@@ -2160,11 +2175,11 @@ public:
 
         _noiseSuppressionConfiguration = std::make_shared<NoiseSuppressionConfiguration>(descriptor.initialEnableNoiseSuppression);
 
-        _externalAudioRecorder.reset(new ExternalAudioRecorder(&_externalAudioSamples, &_externalAudioSamplesMutex));
+        _externalAudioRecorder.reset(new ExternalAudioRecorder(&_externalAudioBuffer));
 
         _myAudioLevel = std::make_shared<MyAudioLevelHolder>();
 
-        if (_e2eEncryptDecrypt) {
+        if (_e2eFrameTransform) {
             _myAudioLevelAndSpeech = std::make_shared<AudioLevelAndSpeechHolder>();
         }
     }
@@ -2218,7 +2233,7 @@ public:
             );
         }
 
-        bool takeAudioLevelFromNetwork = _e2eEncryptDecrypt == nullptr;
+        bool takeAudioLevelFromNetwork = _e2eFrameTransform == nullptr;
 
         _networkManager.reset(new ThreadLocalObject<GroupNetworkManager>(_threads->getNetworkThread(), [weak, threads = _threads, takeAudioLevelFromNetwork] () mutable {
             return std::make_shared<GroupNetworkManager>(
@@ -2290,11 +2305,11 @@ public:
                 if (myAudioLevel) {
                     myAudioLevel->set(level);
                 }
-            }, _noiseSuppressionConfiguration, nullptr, nullptr);
+            }, _noiseSuppressionConfiguration, nullptr);
     #endif
         } else {
             #ifdef WEBRTC_IOS
-            audioProcessor = std::make_unique<AudioInjectionPostProcessor>(&_externalAudioSamples, &_externalAudioSamplesMutex);
+            audioProcessor = std::make_unique<AudioInjectionPostProcessor>(&_externalAudioBuffer);
             #endif
         }
 
@@ -2387,7 +2402,7 @@ public:
         _videoBitrateAllocatorFactory = webrtc::CreateBuiltinVideoBitrateAllocatorFactory();
 
         if (_audioLevelsUpdated) {
-            beginLevelsTimer(100);
+            beginLevelsTimer(_audioLevelsUpdatePeriodMs);
         }
 
         if (_getVideoSource) {
@@ -2408,7 +2423,7 @@ public:
 
         beginNetworkStatusTimer(0);
         beginLogTimer(0);
-        //beginAudioChannelCleanupTimer(0);
+        beginAudioChannelSchedulingTimer(200);
 
         adjustBitratePreferences(true);
 
@@ -2482,6 +2497,8 @@ public:
             _channelManager->DestroyChannel(_outgoingVideoChannel);
         });
         _outgoingVideoChannel = nullptr;
+        _outgoingVideoActiveLayers = 0;
+        _outgoingVideoLayers = 0;
     }
 
     void createOutgoingVideoChannel() {
@@ -2576,9 +2593,9 @@ public:
             _outgoingVideoChannel->SetLocalContent(outgoingVideoDescription.get(), webrtc::SdpType::kOffer, errorDesc);
             _outgoingVideoChannel->SetPayloadTypeDemuxingEnabled(false);
 
-            if (_e2eEncryptDecrypt) {
+            if (_e2eFrameTransform) {
                 for (auto ssrc : simulcastGroupSsrcs) {
-                    _outgoingVideoChannel->send_channel()->SetEncoderToPacketizerFrameTransformer(ssrc, rtc::make_ref_counted<FrameTransformer>(true, _e2eEncryptDecrypt, int64_t(), _payloadTypeMapping, nullptr, nullptr));
+                    _outgoingVideoChannel->send_channel()->SetEncoderToPacketizerFrameTransformer(ssrc, rtc::make_ref_counted<FrameTransformer>(true, _e2eFrameTransform, _e2eEscapeEncryptedFrames, int64_t(), _payloadTypeMapping, nullptr, nullptr));
                 }
             }
         });
@@ -2602,18 +2619,15 @@ public:
                             rtpParameters.encodings[i].max_bitrate_bps = _HDVideo ? 20000000 : 100000;
                             rtpParameters.encodings[i].max_framerate = _HDVideo ? 60 : 30;
                             rtpParameters.encodings[i].scale_resolution_down_by = 4.0;
-                            rtpParameters.encodings[i].active = _outgoingVideoConstraint >= 180;
                         } else if (i == 1) {
                             rtpParameters.encodings[i].min_bitrate_bps = 150000;
                             rtpParameters.encodings[i].max_bitrate_bps = _HDVideo ? 20000000 : 200000;
                             rtpParameters.encodings[i].max_framerate = _HDVideo ? 60 : 30;
                             rtpParameters.encodings[i].scale_resolution_down_by = 2.0;
-                            rtpParameters.encodings[i].active = _outgoingVideoConstraint >= 360;
                         } else if (i == 2) {
                             rtpParameters.encodings[i].min_bitrate_bps = 300000;
                             rtpParameters.encodings[i].max_bitrate_bps = _HDVideo ? 20000000 : (800000 + 100000);
                             rtpParameters.encodings[i].max_framerate = _HDVideo ? 60 : 30;
-                            rtpParameters.encodings[i].active = _outgoingVideoConstraint >= 720;
                         }
                     }
                 } else if (rtpParameters.encodings.size() == 2) {
@@ -2634,7 +2648,7 @@ public:
                     rtpParameters.encodings[0].max_framerate = _HDVideo ? 60 : 30;
                 }
 
-                _outgoingVideoChannel->send_channel()->SetRtpSendParameters(_outgoingVideoSsrcs.simulcastLayers[0].ssrc, rtpParameters);
+                setOutgoingVideoSendParameters(rtpParameters);
             });
         } else {
             _threads->getWorkerThread()->BlockingCall([this]() {
@@ -2646,18 +2660,15 @@ public:
                             rtpParameters.encodings[i].max_bitrate_bps = _HDVideo ? 20000000 : 60000;;
                             rtpParameters.encodings[i].max_framerate = _HDVideo ? 60 : 30;
                             rtpParameters.encodings[i].scale_resolution_down_by = 4.0;
-                            rtpParameters.encodings[i].active = _outgoingVideoConstraint >= 180;
                         } else if (i == 1) {
                             rtpParameters.encodings[i].min_bitrate_bps = 100000;
                             rtpParameters.encodings[i].max_bitrate_bps = _HDVideo ? 20000000 : 110000;
                             rtpParameters.encodings[i].max_framerate = _HDVideo ? 60 : 30;
                             rtpParameters.encodings[i].scale_resolution_down_by = 2.0;
-                            rtpParameters.encodings[i].active = _outgoingVideoConstraint >= 360;
                         } else if (i == 2) {
                             rtpParameters.encodings[i].min_bitrate_bps = 300000;
                             rtpParameters.encodings[i].max_bitrate_bps = _HDVideo ? 20000000 : (800000 + 100000) * 2;
                             rtpParameters.encodings[i].max_framerate = _HDVideo ? 60 : 30;
-                            rtpParameters.encodings[i].active = _outgoingVideoConstraint >= 720;
                         }
                     }
                 } else if (rtpParameters.encodings.size() == 2) {
@@ -2678,11 +2689,95 @@ public:
                     rtpParameters.encodings[0].max_framerate = _HDVideo ? 60 : 30;
                 }
 
-                _outgoingVideoChannel->send_channel()->SetRtpSendParameters(_outgoingVideoSsrcs.simulcastLayers[0].ssrc, rtpParameters);
+                setOutgoingVideoSendParameters(rtpParameters);
             });
         }
     }
 
+    // Runs on the worker thread. Layers nobody receives are not encoded: a layer
+    // is active when the receivers' constraint reaches its nominal height, the
+    // lowest one whenever anybody watches. Resumed layers start with a keyframe.
+    void setOutgoingVideoSendParameters(webrtc::RtpParameters &rtpParameters) {
+        if (rtpParameters.encodings.empty()) {
+            return;
+        }
+
+        size_t lowestLayer = 0;
+        for (size_t i = 0; i < rtpParameters.encodings.size(); i++) {
+            if (rtpParameters.encodings[i].scale_resolution_down_by.value_or(1.0) > rtpParameters.encodings[lowestLayer].scale_resolution_down_by.value_or(1.0)) {
+                lowestLayer = i;
+            }
+        }
+
+        std::vector<std::string> resumedRids;
+        bool hasResumedLayers = false;
+        int activeLayers = 0;
+        for (size_t i = 0; i < rtpParameters.encodings.size(); i++) {
+            auto &encoding = rtpParameters.encodings[i];
+            const int nominalHeight = (int)(720.0 / std::max(1.0, encoding.scale_resolution_down_by.value_or(1.0)));
+            const bool isActive = i == lowestLayer ? _outgoingVideoConstraint > 0 : _outgoingVideoConstraint >= nominalHeight;
+            if (isActive && !encoding.active) {
+                hasResumedLayers = true;
+                if (!encoding.rid.empty()) {
+                    resumedRids.push_back(encoding.rid);
+                }
+            }
+            encoding.active = isActive;
+            if (isActive) {
+                activeLayers++;
+            }
+        }
+
+        _outgoingVideoChannel->send_channel()->SetRtpSendParameters(_outgoingVideoSsrcs.simulcastLayers[0].ssrc, rtpParameters);
+
+        if (hasResumedLayers && activeLayers != 0) {
+            // Without rids the keyframe goes to every layer, which is what ssrc-based simulcast needs anyway
+            _outgoingVideoChannel->send_channel()->GenerateSendKeyFrame(_outgoingVideoSsrcs.simulcastLayers[0].ssrc, resumedRids);
+        }
+
+        if (_outgoingVideoActiveLayers != activeLayers || _outgoingVideoLayers != (int)rtpParameters.encodings.size()) {
+            RTC_LOG(LS_INFO) << "Outgoing video: encoding " << activeLayers << " of " << rtpParameters.encodings.size() << " layers for receiver constraint " << _outgoingVideoConstraint;
+        }
+        _outgoingVideoActiveLayers = activeLayers;
+        _outgoingVideoLayers = (int)rtpParameters.encodings.size();
+    }
+
+    // Decreases wait a little in case the constraint comes back, increases apply at once.
+    void setOutgoingVideoConstraint(int outgoingVideoConstraint) {
+        if (_outgoingVideoConstraint == outgoingVideoConstraint) {
+            _pendingOutgoingVideoConstraint = -1;
+            _pendingOutgoingVideoConstraintRequestId += 1;
+            return;
+        }
+
+        if (_outgoingVideoConstraint > outgoingVideoConstraint) {
+            _pendingOutgoingVideoConstraint = outgoingVideoConstraint;
+
+            _pendingOutgoingVideoConstraintRequestId += 1;
+            int requestId = _pendingOutgoingVideoConstraintRequestId;
+
+            const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
+            _threads->getMediaThread()->PostDelayedTask([weak, requestId]() {
+                auto strong = weak.lock();
+                if (!strong) {
+                    return;
+                }
+                if (strong->_pendingOutgoingVideoConstraint != -1 && strong->_pendingOutgoingVideoConstraintRequestId == requestId) {
+                    if (strong->_outgoingVideoConstraint != strong->_pendingOutgoingVideoConstraint) {
+                        strong->_outgoingVideoConstraint = strong->_pendingOutgoingVideoConstraint;
+                        strong->adjustVideoSendParams();
+                    }
+                    strong->_pendingOutgoingVideoConstraint = -1;
+                }
+            }, webrtc::TimeDelta::Millis(2000));
+        } else {
+            _pendingOutgoingVideoConstraint = -1;
+            _pendingOutgoingVideoConstraintRequestId += 1;
+            _outgoingVideoConstraint = outgoingVideoConstraint;
+            adjustVideoSendParams();
+        }
+    }
+
     void updateVideoSend() {
         if (!_outgoingVideoChannel) {
             return;
@@ -2820,9 +2915,9 @@ public:
             _outgoingAudioChannel->SetRemoteContent(incomingAudioDescription.get(), webrtc::SdpType::kAnswer, errorDesc);
             _outgoingAudioChannel->SetPayloadTypeDemuxingEnabled(false);
 
-            if (_e2eEncryptDecrypt) {
+            if (_e2eFrameTransform) {
                 auto myAudioLevelAndSpeech = _myAudioLevelAndSpeech;
-                _outgoingAudioChannel->send_channel()->SetEncoderToPacketizerFrameTransformer(_outgoingAudioSsrc, rtc::make_ref_counted<FrameTransformer>(true, _e2eEncryptDecrypt, int64_t(), _payloadTypeMapping, [myAudioLevelAndSpeech]() -> std::pair<uint8_t, bool> {
+                _outgoingAudioChannel->send_channel()->SetEncoderToPacketizerFrameTransformer(_outgoingAudioSsrc, rtc::make_ref_counted<FrameTransformer>(true, _e2eFrameTransform, false, int64_t(), _payloadTypeMapping, [myAudioLevelAndSpeech]() -> std::pair<uint8_t, bool> {
                     if (myAudioLevelAndSpeech) {
                         return myAudioLevelAndSpeech->get();
                     } else {
@@ -2920,36 +3015,25 @@ public:
         // audioLevel of 127 means -127 dBov (minimum level)
         float mappedLevel = pow(10.0f, -audioLevel / 20.0f);
 
-        auto it = _audioLevels.find(ChannelId(ssrc));
-        if (it != _audioLevels.end()) {
-            it->second.value.level = fmax(it->second.value.level, mappedLevel);
-            if (isSpeech) {
-                it->second.value.voice = true;
-            }
-            it->second.timestamp = rtc::TimeMillis();
-        } else {
-            InternalGroupLevelValue updated;
-            updated.value.level = mappedLevel;
-            updated.value.voice = isSpeech;
-            updated.timestamp = rtc::TimeMillis();
-            _audioLevels.insert(std::make_pair(ChannelId(ssrc), std::move(updated)));
-        }
+        GroupLevelValue value;
+        value.level = mappedLevel;
+        value.voice = isSpeech;
+        _levelsAggregator.updateLevel(ssrc, value, rtc::TimeMillis());
+
+        _audioChannelScheduler.reportLevel(ssrc, mappedLevel, isSpeech, rtc::TimeMillis());
 
         auto audioChannel = _incomingAudioChannels.find(ChannelId(ssrc));
         if (audioChannel != _incomingAudioChannels.end()) {
             audioChannel->second->updateActivity();
+            if (isSpeech || audioLevel < kAudibleHeaderAudioLevel) {
+                audioChannel->second->updateSpeechActivity();
+                audioChannel->second->setIsDecodingSuspended(false);
+            }
         }
     }
 
     void updateSsrcActivity(uint32_t ssrc) {
-        auto it = _ssrcActivities.find(ChannelId(ssrc));
-        if (it != _ssrcActivities.end()) {
-            it->second.timestamp = rtc::TimeMillis();
-        } else {
-            InternalGroupActivityValue updated;
-            updated.timestamp = rtc::TimeMillis();
-            _ssrcActivities.insert(std::make_pair(ChannelId(ssrc), std::move(updated)));
-        }
+        _levelsAggregator.updateActivity(ssrc, rtc::TimeMillis());
     }
 
     void beginLevelsTimer(int timeoutMs) {
@@ -2960,54 +3044,31 @@ public:
                 return;
             }
 
-            //int64_t timestamp = rtc::TimeMillis();
-            //int64_t maxSampleTimeout = 400;
-
-            GroupLevelsUpdate levelsUpdate;
-            levelsUpdate.updates.reserve(strong->_audioLevels.size() + 1);
-            for (auto &it : strong->_audioLevels) {
-                uint32_t effectiveSsrc = it.first.actualSsrc;
-                if (std::find_if(levelsUpdate.updates.begin(), levelsUpdate.updates.end(), [&](GroupLevelUpdate const &item) {
-                    return item.ssrc == effectiveSsrc;
-                }) != levelsUpdate.updates.end()) {
-                    continue;
-                }
-                levelsUpdate.updates.push_back(GroupLevelUpdate{
-                    effectiveSsrc,
-                    mappedAudioLevel(it.second.value),
-                    });
-                if (it.second.value.level > 0.001f) {
-                    auto audioChannel = strong->_incomingAudioChannels.find(it.first);
-                    if (audioChannel != strong->_incomingAudioChannels.end()) {
-                        audioChannel->second->updateActivity();
-                    }
-                }
-            }
-            strong->_audioLevels.clear();
+            int64_t timestamp = rtc::TimeMillis();
 
             auto myAudioLevel = strong->_myAudioLevel->get();
             myAudioLevel.isMuted = strong->_isMuted;
-            levelsUpdate.updates.push_back(GroupLevelUpdate{ 0, mappedAudioLevel(myAudioLevel) });
-
-            GroupActivitiesUpdate activitiesUpdate;
-            activitiesUpdate.updates.reserve(strong->_ssrcActivities.size());
-            for (auto &it : strong->_ssrcActivities) {
-                uint32_t effectiveSsrc = it.first.actualSsrc;
-                if (std::find_if(activitiesUpdate.updates.begin(), activitiesUpdate.updates.end(), [&](GroupActivityUpdate const &item) {
-                    return item.ssrc == effectiveSsrc;
-                }) != activitiesUpdate.updates.end()) {
-                    continue;
-                }
-                activitiesUpdate.updates.push_back(GroupActivityUpdate{
-                    effectiveSsrc
-                });
+            strong->_levelsAggregator.updateLevel(0, myAudioLevel, timestamp);
+
+            // The update vectors are members so their capacity is reused between ticks.
+            auto &levelsUpdate = strong->_levelsUpdate;
+            levelsUpdate.updates.clear();
+            strong->_levelsAggregator.collectLevels(timestamp, levelsUpdate.updates);
+            for (auto &update : levelsUpdate.updates) {
+                update.value = mappedAudioLevel(update.value);
             }
-            strong->_ssrcActivities.clear();
 
-            if (strong->_audioLevelsUpdated) {
+            auto &activitiesUpdate = strong->_activitiesUpdate;
+            activitiesUpdate.updates.clear();
+            strong->_levelsAggregator.collectActivities(activitiesUpdate.updates);
+
+            strong->_levelsAggregator.prune(timestamp);
+
+            // Full updates are reported every period even if nothing changed.
+            if (strong->_audioLevelsUpdated && (!strong->_audioLevelsDeltaOnly || !levelsUpdate.updates.empty())) {
                 strong->_audioLevelsUpdated(levelsUpdate);
             }
-            if (strong->_activitiesUpdated) {
+            if (strong->_activitiesUpdated && !activitiesUpdate.updates.empty()) {
                 strong->_activitiesUpdated(activitiesUpdate);
             }
 
@@ -3027,15 +3088,15 @@ public:
                 strong->_myAudioLevelAndSpeech->set(compressedAudioLevel, myAudioLevel.voice && !myAudioLevel.isMuted);
             }
             bool isSpeech = myAudioLevel.voice && !myAudioLevel.isMuted;
-            strong->_networkManager->perform([isSpeech = isSpeech](GroupNetworkManager *networkManager) {
+            strong->_networkManager->performBatched([isSpeech = isSpeech](GroupNetworkManager *networkManager) {
                 networkManager->setOutgoingVoiceActivity(isSpeech);
             });
 
-            strong->beginLevelsTimer(100);
+            strong->beginLevelsTimer(strong->_audioLevelsUpdatePeriodMs);
         }, webrtc::TimeDelta::Millis(timeoutMs));
     }
 
-    void beginAudioChannelCleanupTimer(int delayMs) {
+    void beginAudioChannelSchedulingTimer(int delayMs) {
         const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
         _threads->getMediaThread()->PostDelayedTask([weak]() {
             auto strong = weak.lock();
@@ -3043,27 +3104,42 @@ public:
                 return;
             }
 
-            auto timestamp = rtc::TimeMillis();
-
-            std::vector<ChannelId> removeChannels;
-            for (const auto &it : strong->_incomingAudioChannels) {
-                if (it.first.networkSsrc == 1) {
-                    continue;
-                }
-                auto activity = it.second->getActivity();
-                if (activity < timestamp - 1000) {
-                    removeChannels.push_back(it.first);
+            const auto swaps = strong->_audioChannelScheduler.update(rtc::TimeMillis());
+            for (const auto &swap : swaps) {
+                if (swap.evicted.networkSsrc != 0) {
+                    strong->removeIncomingAudioChannel(ChannelId(swap.evicted.networkSsrc, swap.evicted.actualSsrc));
                 }
+                strong->addIncomingAudioChannel(ChannelId(swap.admitted.networkSsrc, swap.admitted.actualSsrc), swap.admitted.userId);
             }
+            if (!swaps.empty()) {
+                const auto stats = strong->_audioChannelScheduler.getStats();
+                RTC_LOG(LS_INFO) << "Incoming audio channels: " << stats.activeChannels << "/" << stats.maxActiveChannels << ", pending: " << stats.pendingCandidates << ", swaps: " << stats.totalSwaps << ", last speaker wait: " << stats.lastSpeakerWaitMs << " ms";
+            }
+
+            strong->expireSpeculativeAudioChannels(rtc::TimeMillis());
 
-            for (const auto &channelId : removeChannels) {
-                strong->removeIncomingAudioChannel(channelId);
+            if (strong->_suspendSilentIncomingAudio) {
+                strong->updateIncomingAudioDecodeSuspension();
             }
 
-            strong->beginAudioChannelCleanupTimer(500);
+            strong->beginAudioChannelSchedulingTimer(200);
         }, webrtc::TimeDelta::Millis(delayMs));
     }
 
+    void updateIncomingAudioDecodeSuspension() {
+        // Levels come from the RTP header extension, which keeps flowing for suspended
+        // channels, so updateSsrcAudioLevel() resumes them on the first audible packet.
+        auto timestamp = rtc::TimeMillis();
+        for (const auto &it : _incomingAudioChannels) {
+            if (it.first.networkSsrc == 1) {
+                continue;
+            }
+            if (it.second->getSpeechActivity() < timestamp - kSilentAudioSuspendTimeoutMs) {
+                it.second->setIsDecodingSuspended(true);
+            }
+        }
+    }
+
     void beginRemoteConstraintsUpdateTimer(int delayMs) {
         const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
         _threads->getMediaThread()->PostDelayedTask([weak]() {
@@ -3072,9 +3148,26 @@ public:
                 return;
             }
 
-            strong->maybeUpdateRemoteVideoConstraints();
+            strong->_threads->getWorkerThread()->PostTask([weak]() {
+                auto strong = weak.lock();
+                if (!strong) {
+                    return;
+                }
+
+                const auto downlinkBitrateBps = (int64_t)strong->_call->GetStats().recv_bandwidth_bps;
 
-            strong->beginRemoteConstraintsUpdateTimer(5000);
+                strong->_threads->getMediaThread()->PostTask([weak, downlinkBitrateBps]() {
+                    auto strong = weak.lock();
+                    if (!strong) {
+                        return;
+                    }
+
+                    strong->_downlinkBitrateBps = downlinkBitrateBps;
+                    strong->maybeUpdateRemoteVideoConstraints();
+                });
+            });
+
+            strong->beginRemoteConstraintsUpdateTimer(2000);
         }, webrtc::TimeDelta::Millis(delayMs));
     }
 
@@ -3364,6 +3457,9 @@ public:
         _isDataChannelOpen = isDataChannelOpen;
 
         if (_isDataChannelOpen) {
+            // The bridge doesn't keep constraints across data channel connections
+            _sentRemoteVideoConstraints.clear();
+            _nextRemoteVideoConstraintsTimestamp = 0;
             maybeUpdateRemoteVideoConstraints();
         }
     }
@@ -3375,8 +3471,19 @@ public:
 
         auto ssrcInfo = _channelBySsrc.find(ssrc);
         if (ssrcInfo == _channelBySsrc.end()) {
+            if (_audioChannelScheduler.isPendingCandidate(ssrc)) {
+                // Waiting for a free decoding slot, the description is already known.
+                if (_e2eFrameTransform) {
+                    // Levels are only available after decryption, so treat packets as speech.
+                    _audioChannelScheduler.reportLevel(ssrc, 0.0f, true, rtc::TimeMillis());
+                } else {
+                    _audioChannelScheduler.reportActivity(ssrc, rtc::TimeMillis());
+                }
+                return;
+            }
             // opus
             if (payloadType == 111) {
+                maybeAddSpeculativeAudioChannel(ssrc);
                 maybeRequestUnknownSsrc(ssrc);
             }
         } else {
@@ -3422,37 +3529,15 @@ public:
                     if (videoConstraints != json.object_items().end() && videoConstraints->second.is_object()) {
                         const auto idealHeight = videoConstraints->second.object_items().find("idealHeight");
                         if (idealHeight != videoConstraints->second.object_items().end() && idealHeight->second.is_number()) {
-                            int outgoingVideoConstraint = idealHeight->second.int_value();
-                            if (_outgoingVideoConstraint != outgoingVideoConstraint) {
-                                if (_outgoingVideoConstraint > outgoingVideoConstraint) {
-                                    _pendingOutgoingVideoConstraint = outgoingVideoConstraint;
-
-                                    int requestId = _pendingOutgoingVideoConstraintRequestId;
-                                    _pendingOutgoingVideoConstraintRequestId += 1;
-
-                                    const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
-                                    _threads->getMediaThread()->PostDelayedTask([weak, requestId]() {
-                                        auto strong = weak.lock();
-                                        if (!strong) {
-                                            return;
-                                        }
-                                        if (strong->_pendingOutgoingVideoConstraint != -1 && strong->_pendingOutgoingVideoConstraintRequestId == requestId) {
-                                            if (strong->_outgoingVideoConstraint != strong->_pendingOutgoingVideoConstraint) {
-                                                strong->_outgoingVideoConstraint = strong->_pendingOutgoingVideoConstraint;
-                                                strong->adjustVideoSendParams();
-                                            }
-                                            strong->_pendingOutgoingVideoConstraint = -1;
-                                        }
-                                    }, webrtc::TimeDelta::Millis(2000));
-                                } else {
-                                    _pendingOutgoingVideoConstraint = -1;
-                                    _pendingOutgoingVideoConstraintRequestId += 1;
-                                    _outgoingVideoConstraint = outgoingVideoConstraint;
-                                    adjustVideoSendParams();
-                                }
-                            }
+                            setOutgoingVideoConstraint(idealHeight->second.int_value());
                         }
                     }
+                } else if (messageType == "SenderSourceConstraints") {
+                    // Per-source form of the above, there is a single outgoing video source
+                    const auto maxHeight = json.object_items().find("maxHeight");
+                    if (maxHeight != json.object_items().end() && maxHeight->second.is_number()) {
+                        setOutgoingVideoConstraint(maxHeight->second.int_value());
+                    }
                 } else if (messageType == "DebugMessage") {
                     const auto message = json.object_items().find("message");
                     if (message != json.object_items().end() && message->second.is_string()) {
@@ -3543,8 +3628,79 @@ public:
         _requestedMediaChannelDescriptions.insert(std::make_pair(requestId, RequestedMediaChannelDescriptions(task, std::move(requestSsrcs))));
     }
 
+    void maybeAddSpeculativeAudioChannel(uint32_t ssrc) {
+        if (!_speculativeIncomingAudioChannels || _disableIncomingChannels) {
+            return;
+        }
+        if (_speculativeAudioChannels.size() >= kMaxSpeculativeAudioChannels) {
+            return;
+        }
+        if (_rejectedSpeculativeAudioSsrcs.find(ssrc) != _rejectedSpeculativeAudioSsrcs.end()) {
+            return;
+        }
+        // Never displace a described channel for one that may not be a participant
+        if (!_audioChannelScheduler.hasFreeChannel()) {
+            return;
+        }
+
+        addIncomingAudioChannel(ChannelId(ssrc), 0);
+        if (_incomingAudioChannels.find(ChannelId(ssrc)) != _incomingAudioChannels.end()) {
+            _speculativeAudioChannels.insert(std::make_pair(ssrc, rtc::TimeMillis()));
+        }
+    }
+
+    void bindSpeculativeAudioChannel(uint32_t ssrc, int64_t userId) {
+        const auto it = _speculativeAudioChannels.find(ssrc);
+        if (it == _speculativeAudioChannels.end()) {
+            return;
+        }
+        RTC_LOG(LS_INFO) << "Speculative audio channel " << ssrc << " bound to its description after " << (rtc::TimeMillis() - it->second) << " ms";
+        _speculativeAudioChannels.erase(it);
+
+        const auto incomingAudioChannel = _incomingAudioChannels.find(ChannelId(ssrc));
+        if (incomingAudioChannel != _incomingAudioChannels.end()) {
+            incomingAudioChannel->second->setUserId(userId);
+        }
+
+        // Only updates the user id, the channel is already active
+        IncomingAudioChannelScheduler::Channel channel;
+        channel.networkSsrc = ssrc;
+        channel.actualSsrc = ssrc;
+        channel.userId = userId;
+        _audioChannelScheduler.requestChannel(channel, rtc::TimeMillis());
+    }
+
+    void removeSpeculativeAudioChannel(uint32_t ssrc) {
+        if (_speculativeAudioChannels.find(ssrc) == _speculativeAudioChannels.end()) {
+            return;
+        }
+        removeIncomingAudioChannel(ChannelId(ssrc));
+        if (_rejectedSpeculativeAudioSsrcs.size() >= 256) {
+            _rejectedSpeculativeAudioSsrcs.clear();
+        }
+        _rejectedSpeculativeAudioSsrcs.insert(ssrc);
+    }
+
+    void expireSpeculativeAudioChannels(int64_t timestamp) {
+        std::vector<uint32_t> expired;
+        for (const auto &it : _speculativeAudioChannels) {
+            if (it.second < timestamp - kSpeculativeAudioChannelTimeoutMs) {
+                expired.push_back(it.first);
+            }
+        }
+        for (const auto ssrc : expired) {
+            RTC_LOG(LS_WARNING) << "Speculative audio channel " << ssrc << " got no description, removing";
+            removeSpeculativeAudioChannel(ssrc);
+        }
+    }
+
     void processMediaChannelDescriptionsResponse(int requestId, std::vector<MediaChannelDescription> const &descriptions) {
-        _requestedMediaChannelDescriptions.erase(requestId);
+        std::vector<uint32_t> requestedSsrcs;
+        const auto request = _requestedMediaChannelDescriptions.find(requestId);
+        if (request != _requestedMediaChannelDescriptions.end()) {
+            requestedSsrcs = std::move(request->second.ssrcs);
+            _requestedMediaChannelDescriptions.erase(request);
+        }
 
         if (_disableIncomingChannels) {
             return;
@@ -3554,7 +3710,9 @@ public:
             switch (description.type) {
                 case MediaChannelDescription::Type::Audio: {
                     if (description.audioSsrc != 0) {
+                        bindSpeculativeAudioChannel(description.audioSsrc, description.userId);
                         addIncomingAudioChannel(ChannelId(description.audioSsrc), description.userId);
+                        requestedSsrcs.erase(std::remove(requestedSsrcs.begin(), requestedSsrcs.end(), description.audioSsrc), requestedSsrcs.end());
                     }
                     break;
                 }
@@ -3566,6 +3724,10 @@ public:
                 }
             }
         }
+
+        for (const auto ssrc : requestedSsrcs) {
+            removeSpeculativeAudioChannel(ssrc);
+        }
     }
 
     void maybeDeliverBufferedPackets(uint32_t ssrc) {
@@ -3583,13 +3745,35 @@ public:
         }*/
     }
 
+    void updateVideoConstraintsPlan() {
+        const auto timestamp = rtc::TimeMillis();
+
+        std::vector<GroupVideoConstraintsPlanner::Endpoint> endpoints;
+        endpoints.reserve(_incomingVideoChannels.size());
+        for (const auto &incomingVideoChannel : _incomingVideoChannels) {
+            GroupVideoConstraintsPlanner::Endpoint endpoint;
+            endpoint.endpointId = incomingVideoChannel.first.endpointId;
+            endpoint.minQuality = incomingVideoChannel.second->requestedMinQuality();
+            endpoint.maxQuality = incomingVideoChannel.second->requestedMaxQuality();
+            endpoint.isPinned = incomingVideoChannel.second->isPinned();
+            const auto lastVoiceTimestamp = _levelsAggregator.lastVoiceTimestamp(incomingVideoChannel.second->audioSsrc());
+            endpoint.isSpeaking = lastVoiceTimestamp != 0 && lastVoiceTimestamp >= timestamp - kVideoSpeakerHoldMs;
+            endpoints.push_back(std::move(endpoint));
+        }
+
+        if (_videoConstraintsPlanner.plan(endpoints, _downlinkBitrateBps, timestamp)) {
+            const auto stats = _videoConstraintsPlanner.getStats();
+            RTC_LOG(LS_INFO) << "Incoming video allocation: " << stats.allocatedBitrateBps / 1000 << "/" << stats.availableBitrateBps / 1000 << " kbit/s, " << stats.allocatedPixelsPerSecond << "/" << stats.maxDecodePixelsPerSecond << " px/s, " << stats.limitedEndpoints << " of " << endpoints.size() << " endpoints limited";
+        }
+    }
+
     void maybeUpdateRemoteVideoConstraints() {
+        updateVideoConstraintsPlan();
+
         if (!_isDataChannelOpen) {
             return;
         }
 
-        std::string pinnedEndpoint;
-
         json11::Json::object json;
         json.insert(std::make_pair("colibriClass", json11::Json("ReceiverVideoConstraints")));
 
@@ -3600,53 +3784,52 @@ public:
         json11::Json::array onStageEndpoints;
         json11::Json::object constraints;
 
-        for (const auto &incomingVideoChannel : _incomingVideoChannels) {
+        for (const auto &allocation : _videoConstraintsPlanner.allocation()) {
             json11::Json::object selectedConstraint;
 
-            switch (incomingVideoChannel.second->requestedMinQuality()) {
-                case VideoChannelDescription::Quality::Full: {
-                    selectedConstraint.insert(std::make_pair("minHeight", json11::Json(720)));
-                    break;
-                }
-                case VideoChannelDescription::Quality::Medium: {
-                    selectedConstraint.insert(std::make_pair("minHeight", json11::Json(360)));
-                    break;
-                }
-                case VideoChannelDescription::Quality::Thumbnail: {
-                    selectedConstraint.insert(std::make_pair("minHeight", json11::Json(180)));
-                    break;
-                }
-                default: {
-                    break;
-                }
+            if (allocation.isOnStage) {
+                onStageEndpoints.push_back(json11::Json(allocation.endpointId));
             }
-            switch (incomingVideoChannel.second->requestedMaxQuality()) {
-                case VideoChannelDescription::Quality::Full: {
-                    onStageEndpoints.push_back(json11::Json(incomingVideoChannel.first.endpointId));
-                    selectedConstraint.insert(std::make_pair("maxHeight", json11::Json(720)));
-                    break;
-                }
-                case VideoChannelDescription::Quality::Medium: {
-                    selectedConstraint.insert(std::make_pair("maxHeight", json11::Json(360)));
-                    break;
-                }
-                case VideoChannelDescription::Quality::Thumbnail: {
-                    selectedConstraint.insert(std::make_pair("maxHeight", json11::Json(180)));
-                    break;
-                }
-                default: {
-                    break;
-                }
+            if (allocation.minHeight != 0) {
+                selectedConstraint.insert(std::make_pair("minHeight", json11::Json(allocation.minHeight)));
+            }
+            selectedConstraint.insert(std::make_pair("maxHeight", json11::Json(allocation.maxHeight)));
+            if (allocation.maxHeight != 0 && allocation.maxFrameRate < 30) {
+                selectedConstraint.insert(std::make_pair("maxFrameRate", json11::Json(allocation.maxFrameRate)));
             }
 
-            constraints.insert(std::make_pair(incomingVideoChannel.first.endpointId, json11::Json(std::move(selectedConstraint))));
+            constraints.insert(std::make_pair(allocation.endpointId, json11::Json(std::move(selectedConstraint))));
         }
 
         json.insert(std::make_pair("onStageEndpoints", json11::Json(std::move(onStageEndpoints))));
         json.insert(std::make_pair("constraints", json11::Json(std::move(constraints))));
 
         std::string result = json11::Json(std::move(json)).dump();
-        _networkManager->perform([result = std::move(result)](GroupNetworkManager *networkManager) {
+        if (result == _sentRemoteVideoConstraints) {
+            return;
+        }
+
+        const auto timestamp = rtc::TimeMillis();
+        if (timestamp < _nextRemoteVideoConstraintsTimestamp) {
+            if (!_isRemoteVideoConstraintsUpdateScheduled) {
+                _isRemoteVideoConstraintsUpdateScheduled = true;
+
+                const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
+                _threads->getMediaThread()->PostDelayedTask([weak]() {
+                    auto strong = weak.lock();
+                    if (!strong) {
+                        return;
+                    }
+                    strong->_isRemoteVideoConstraintsUpdateScheduled = false;
+                    strong->maybeUpdateRemoteVideoConstraints();
+                }, webrtc::TimeDelta::Millis(_nextRemoteVideoConstraintsTimestamp - timestamp));
+            }
+            return;
+        }
+        _nextRemoteVideoConstraintsTimestamp = timestamp + kRemoteVideoConstraintsMinIntervalMs;
+        _sentRemoteVideoConstraints = result;
+
+        _networkManager->performBatched([result = std::move(result)](GroupNetworkManager *networkManager) {
             networkManager->sendDataChannelMessage(result);
         });
     }
@@ -3731,17 +3914,16 @@ public:
                             return;
                         }
 
-                        InternalGroupLevelValue updated;
-                        updated.value.level = level;
-                        updated.value.voice = isSpeech;
-                        updated.timestamp = rtc::TimeMillis();
-                        strong->_audioLevels.insert(std::make_pair(ChannelId(ssrc), std::move(updated)));
+                        GroupLevelValue value;
+                        value.level = level;
+                        value.voice = isSpeech;
+                        strong->_levelsAggregator.updateLevel(ssrc, value, rtc::TimeMillis());
                     };
                     _streamingContext = std::make_shared<StreamingMediaContext>(std::move(arguments));
 
                     for (const auto &it : _pendingVideoSinks) {
-                        for (const auto &sink : it.second) {
-                            _streamingContext->addVideoSink(it.first.endpointId, sink);
+                        for (const auto &registration : it.second) {
+                            _streamingContext->addVideoSink(it.first.endpointId, registration.sink);
                         }
                     }
 
@@ -3889,17 +4071,7 @@ public:
         if (samples.size() % 2 != 0) {
             return;
         }
-        _externalAudioSamplesMutex.Lock();
-
-        size_t previousSize = _externalAudioSamples.size();
-        _externalAudioSamples.resize(_externalAudioSamples.size() + samples.size() / 2);
-        webrtc::S16ToFloatS16((const int16_t *)samples.data(), samples.size() / 2, _externalAudioSamples.data() + previousSize);
-
-        if (_externalAudioSamples.size() > 2 * 48000) {
-            _externalAudioSamples.erase(_externalAudioSamples.begin(), _externalAudioSamples.begin() + (_externalAudioSamples.size() - 2 * 48000));
-        }
-
-        _externalAudioSamplesMutex.Unlock();
+        _externalAudioBuffer.write(rtc::ArrayView<const int16_t>((const int16_t *)samples.data(), samples.size() / 2));
     }
 
     void setJoinResponsePayload(std::string const &payload) {
@@ -3996,7 +4168,8 @@ public:
             VideoChannelDescription::Quality::Thumbnail,
             videoInformation,
             _threads,
-            _e2eEncryptDecrypt,
+            _e2eFrameTransform,
+            _e2eEscapeEncryptedFrames,
             _payloadTypeMapping
         ));
 
@@ -4060,8 +4233,8 @@ public:
         _noiseSuppressionConfiguration->isEnabled = isNoiseSuppressionEnabled;
     }
 
-    void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
-        _videoCaptureSink->addSink(sink);
+    void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+        _videoCaptureSink->addSink(VideoSinkRegistration{ sink, options });
 
         if (_videoCapture) {
             _videoCapture->setOutput(_videoCaptureSink);
@@ -4075,18 +4248,19 @@ public:
         createOutgoingAudioChannel();
     }
 
-    void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
+    void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+        VideoSinkRegistration registration{ sink, options };
         if (_sharedVideoInformation && endpointId == _sharedVideoInformation->endpointId) {
             if (_videoCapture) {
-                _videoCaptureSink->addSink(sink);
+                _videoCaptureSink->addSink(registration);
                 _videoCapture->setOutput(_videoCaptureSink);
             }
         } else {
             auto it = _incomingVideoChannels.find(VideoChannelId(endpointId));
             if (it != _incomingVideoChannels.end()) {
-                it->second->addSink(sink);
+                it->second->addSink(registration);
             } else {
-                _pendingVideoSinks[VideoChannelId(endpointId)].push_back(sink);
+                _pendingVideoSinks[VideoChannelId(endpointId)].push_back(registration);
             }
 
             if (_streamingContext) {
@@ -4100,29 +4274,18 @@ public:
             return;
         }
 
-        if (_incomingAudioChannels.size() > 10) {
-            auto timestamp = rtc::TimeMillis();
-
-            int64_t minActivity = INT64_MAX;
-            ChannelId minActivityChannelId(0, 0);
-
-            for (const auto &it : _incomingAudioChannels) {
-                if (it.first.networkSsrc == 1) {
-                    continue;
-                }
-                auto activity = it.second->getActivity();
-                if (activity < minActivity && activity < timestamp - 1000) {
-                    minActivity = activity;
-                    minActivityChannelId = it.first;
-                }
-            }
+        if (ssrc.networkSsrc != 1) {
+            IncomingAudioChannelScheduler::Channel channel;
+            channel.networkSsrc = ssrc.networkSsrc;
+            channel.actualSsrc = ssrc.actualSsrc;
+            channel.userId = userId;
 
-            if (minActivityChannelId.networkSsrc != 0) {
-                removeIncomingAudioChannel(minActivityChannelId);
+            const auto admission = _audioChannelScheduler.requestChannel(channel, rtc::TimeMillis());
+            if (admission.hasEvicted) {
+                removeIncomingAudioChannel(ChannelId(admission.evicted.networkSsrc, admission.evicted.actualSsrc));
             }
-
-            if (_incomingAudioChannels.size() > 10) {
-                // Wait until there is a channel that hasn't been active in 1 second
+            if (!admission.isAdmitted) {
+                // Kept as a candidate, the scheduling timer swaps it in once it speaks
                 return;
             }
         }
@@ -4130,7 +4293,7 @@ public:
         const auto weak = std::weak_ptr<GroupInstanceCustomInternal>(shared_from_this());
 
         std::function<void(AudioSinkImpl::Update)> onAudioSinkUpdate;
-        if (ssrc.actualSsrc != ssrc.networkSsrc) {
+        if (ssrc.actualSsrc != ssrc.networkSsrc && !_suspendSilentIncomingAudio) {
             if (_audioLevelsUpdated) {
                 onAudioSinkUpdate = [weak, ssrc = ssrc, threads = _threads](AudioSinkImpl::Update update) {
                     threads->getMediaThread()->PostTask([weak, ssrc, update]() {
@@ -4139,20 +4302,10 @@ public:
                             return;
                         }
 
-                        auto it = strong->_audioLevels.find(ChannelId(ssrc));
-                        if (it != strong->_audioLevels.end()) {
-                            it->second.value.level = fmax(it->second.value.level, update.level);
-                            if (update.hasSpeech) {
-                                it->second.value.voice = true;
-                            }
-                            it->second.timestamp = rtc::TimeMillis();
-                        } else {
-                            InternalGroupLevelValue updated;
-                            updated.value.level = update.level;
-                            updated.value.voice = update.hasSpeech;
-                            updated.timestamp = rtc::TimeMillis();
-                            strong->_audioLevels.insert(std::make_pair(ChannelId(ssrc), std::move(updated)));
-                        }
+                        GroupLevelValue value;
+                        value.level = update.level;
+                        value.voice = update.hasSpeech;
+                        strong->_levelsAggregator.updateLevel(ssrc.actualSsrc, value, rtc::TimeMillis());
                     });
                 };
             }
@@ -4169,7 +4322,7 @@ public:
             std::move(onAudioSinkUpdate),
             _onAudioFrame,
             _threads,
-            _e2eEncryptDecrypt,
+            _e2eFrameTransform,
             _payloadTypeMapping,
             [weak, threads = _threads](uint32_t ssrc, uint8_t audioLevel, bool hasSpeech) {
                 threads->getMediaThread()->PostTask([weak, ssrc, audioLevel, hasSpeech]() {
@@ -4211,6 +4364,12 @@ public:
         if (it != _incomingAudioChannels.end()) {
             _incomingAudioChannels.erase(it);
         }
+        if (_speculativeAudioChannels.erase(channelId.networkSsrc) != 0) {
+            // An anonymous channel must not be swapped back in without a description
+            _audioChannelScheduler.removeChannel(channelId.networkSsrc);
+        } else {
+            _audioChannelScheduler.releaseChannel(channelId.networkSsrc);
+        }
 
         auto currentMapping = _channelBySsrc.find(channelId.networkSsrc);
         if (currentMapping != _channelBySsrc.end()) {
@@ -4226,7 +4385,7 @@ public:
         }
     }
 
-    void addIncomingVideoChannel(uint32_t audioSsrc, int64_t userId, GroupParticipantVideoInformation const &videoInformation, VideoChannelDescription::Quality minQuality, VideoChannelDescription::Quality maxQuality) {
+    void addIncomingVideoChannel(uint32_t audioSsrc, int64_t userId, GroupParticipantVideoInformation const &videoInformation, VideoChannelDescription::Quality minQuality, VideoChannelDescription::Quality maxQuality, bool isPinned) {
         if (!_sharedVideoInformation) {
             return;
         }
@@ -4249,14 +4408,16 @@ public:
             maxQuality,
             videoInformation,
             _threads,
-            _e2eEncryptDecrypt,
+            _e2eFrameTransform,
+            _e2eEscapeEncryptedFrames,
             _payloadTypeMapping
         ));
+        channel->setIsPinned(isPinned);
 
         const auto pendingSinks = _pendingVideoSinks.find(VideoChannelId(videoInformation.endpointId));
         if (pendingSinks != _pendingVideoSinks.end()) {
-            for (const auto &sink : pendingSinks->second) {
-                channel->addSink(sink);
+            for (const auto &registration : pendingSinks->second) {
+                channel->addSink(registration);
             }
 
             _pendingVideoSinks.erase(pendingSinks);
@@ -4345,15 +4506,16 @@ public:
 
             auto current = _incomingVideoChannels.find(VideoChannelId(videoInformation.endpointId));
             if (current != _incomingVideoChannels.end()) {
-                if (current->second->requestedMinQuality() != description.minQuality || current->second->requestedMaxQuality() != description.maxQuality) {
+                if (current->second->requestedMinQuality() != description.minQuality || current->second->requestedMaxQuality() != description.maxQuality || current->second->isPinned() != description.isPinned) {
                     current->second->setRequstedMinQuality(description.minQuality);
                     current->second->setRequstedMaxQuality(description.maxQuality);
+                    current->second->setIsPinned(description.isPinned);
                     updated = true;
                 }
                 continue;
             }
 
-            addIncomingVideoChannel(description.audioSsrc, description.userId, videoInformation, description.minQuality, description.maxQuality);
+            addIncomingVideoChannel(description.audioSsrc, description.userId, videoInformation, description.minQuality, description.maxQuality, description.isPinned);
             updated = true;
         }
 
@@ -4369,8 +4531,8 @@ public:
             const auto it = _incomingVideoChannels.find(VideoChannelId(endpointId));
             if (it != _incomingVideoChannels.end()) {
                 auto sinks = it->second->getSinks();
-                for (const auto &sink : sinks) {
-                    _pendingVideoSinks[VideoChannelId(endpointId)].push_back(sink);
+                for (const auto &registration : sinks) {
+                    _pendingVideoSinks[VideoChannelId(endpointId)].push_back(registration);
                 }
                 _incomingVideoChannels.erase(it);
             }
@@ -4391,6 +4553,28 @@ public:
             }
         }
 
+        for (const auto &allocation : _videoConstraintsPlanner.allocation()) {
+            GroupInstanceStats::IncomingVideoAllocation incomingVideoAllocation;
+            incomingVideoAllocation.maxHeight = allocation.maxHeight;
+            incomingVideoAllocation.maxFrameRate = allocation.maxFrameRate;
+            result.incomingVideoAllocations.push_back(std::make_pair(allocation.endpointId, incomingVideoAllocation));
+        }
+        result.incomingVideoBitrateEstimateBps = _videoConstraintsPlanner.getStats().availableBitrateBps;
+
+        result.outgoingVideoConstraint = _outgoingVideoConstraint;
+        result.outgoingVideoActiveLayers = _outgoingVideoActiveLayers;
+        result.outgoingVideoLayers = _outgoingVideoLayers;
+
+        completion(result);
+    }
+
+    void getAudioLevelsSnapshot(std::function<void(GroupLevelsUpdate const &)> completion) {
+        GroupLevelsUpdate result;
+        _levelsAggregator.snapshot(result.updates);
+        for (auto &update : result.updates) {
+            update.value = mappedAudioLevel(update.value);
+        }
+
         completion(result);
     }
 
@@ -4491,13 +4675,20 @@ private:
     bool _enableSystemMute{false};
 #endif
     bool _isConference{false};
+    bool _suspendSilentIncomingAudio{false};
+    bool _speculativeIncomingAudioChannels{false};
     int _minOutgoingVideoBitrateKbit{100};
     VideoContentType _videoContentType{VideoContentType::None};
     std::vector<VideoCodecName> _videoCodecPreferences;
-    std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)> _e2eEncryptDecrypt;
+    std::shared_ptr<GroupE2EFrameTransform> _e2eFrameTransform;
+    bool _e2eEscapeEncryptedFrames = false;
 
     int _nextMediaChannelDescriptionsRequestId = 0;
     std::map<int, RequestedMediaChannelDescriptions> _requestedMediaChannelDescriptions;
+    // Anonymous incoming audio channels by ssrc, with their creation time.
+    std::map<uint32_t, int64_t> _speculativeAudioChannels;
+    // Ssrcs whose description didn't turn out to be audio, never speculated on again.
+    std::set<uint32_t> _rejectedSpeculativeAudioSsrcs;
 
     std::unique_ptr<ThreadLocalObject<GroupNetworkManager>> _networkManager;
 
@@ -4535,12 +4726,17 @@ private:
     VideoSsrcs _outgoingVideoSsrcs;
     int _outgoingVideoConstraint = 720;
     int _pendingOutgoingVideoConstraint = -1;
+    int _outgoingVideoActiveLayers = 0;
+    int _outgoingVideoLayers = 0;
     int _pendingOutgoingVideoConstraintRequestId = 0;
 
-    std::map<ChannelId, InternalGroupLevelValue> _audioLevels;
+    int _audioLevelsUpdatePeriodMs = 100;
+    bool _audioLevelsDeltaOnly = false;
+    GroupLevelsAggregator _levelsAggregator;
+    GroupLevelsUpdate _levelsUpdate;
+    GroupActivitiesUpdate _activitiesUpdate;
     std::shared_ptr<MyAudioLevelHolder> _myAudioLevel;
     std::shared_ptr<AudioLevelAndSpeechHolder> _myAudioLevelAndSpeech;
-    std::map<ChannelId, InternalGroupActivityValue> _ssrcActivities;
 
     bool _isMuted = true;
     std::shared_ptr<NoiseSuppressionConfiguration> _noiseSuppressionConfiguration;
@@ -4551,15 +4747,14 @@ private:
     std::map<ChannelId, std::unique_ptr<IncomingAudioChannel>> _incomingAudioChannels;
     std::map<VideoChannelId, std::unique_ptr<IncomingVideoChannel>> _incomingVideoChannels;
 
-    std::map<VideoChannelId, std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>>> _pendingVideoSinks;
+    std::map<VideoChannelId, std::vector<VideoSinkRegistration>> _pendingVideoSinks;
     std::vector<VideoChannelDescription> _pendingRequestedVideo;
 
     std::unique_ptr<IncomingVideoChannel> _serverBandwidthProbingVideoSsrc;
 
     absl::optional<GroupJoinVideoInformation> _sharedVideoInformation;
 
-    std::vector<float> _externalAudioSamples;
-    webrtc::Mutex _externalAudioSamplesMutex;
+    ExternalAudioBuffer _externalAudioBuffer;
     std::shared_ptr<ExternalAudioRecorder> _externalAudioRecorder;
 
     bool _isRtcConnected = false;
@@ -4588,6 +4783,13 @@ private:
     bool _stereoMode = false;
     uint16_t _customBitrate = 32;
     bool _HDVideo = false;
+    IncomingAudioChannelScheduler _audioChannelScheduler;
+
+    GroupVideoConstraintsPlanner _videoConstraintsPlanner;
+    int64_t _downlinkBitrateBps = 0;
+    std::string _sentRemoteVideoConstraints;
+    int64_t _nextRemoteVideoConstraintsTimestamp = 0;
+    bool _isRemoteVideoConstraintsUpdateScheduled = false;
 };
 
 GroupInstanceCustomImpl::GroupInstanceCustomImpl(GroupInstanceDescriptor &&descriptor) {
@@ -4710,13 +4912,25 @@ void GroupInstanceCustomImpl::addExternalAudioSamples(std::vector<uint8_t> &&sam
 
 void GroupInstanceCustomImpl::addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
     _internal->perform([sink](GroupInstanceCustomInternal *internal) mutable {
-        internal->addOutgoingVideoOutput(sink);
+        internal->addOutgoingVideoOutput(sink, VideoSinkOptions());
+    });
+}
+
+void GroupInstanceCustomImpl::addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+    _internal->perform([sink, options](GroupInstanceCustomInternal *internal) mutable {
+        internal->addOutgoingVideoOutput(sink, options);
     });
 }
 
 void GroupInstanceCustomImpl::addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
     _internal->perform([endpointId, sink](GroupInstanceCustomInternal *internal) mutable {
-        internal->addIncomingVideoOutput(endpointId, sink);
+        internal->addIncomingVideoOutput(endpointId, sink, VideoSinkOptions());
+    });
+}
+
+void GroupInstanceCustomImpl::addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+    _internal->perform([endpointId, sink, options](GroupInstanceCustomInternal *internal) mutable {
+        internal->addIncomingVideoOutput(endpointId, sink, options);
     });
 }
 
@@ -4738,6 +4952,12 @@ void GroupInstanceCustomImpl::getStats(std::function<void(GroupInstanceStats)> c
     });
 }
 
+void GroupInstanceCustomImpl::getAudioLevelsSnapshot(std::function<void(GroupLevelsUpdate const &)> completion) {
+    _internal->perform([completion = std::move(completion)](GroupInstanceCustomInternal *internal) mutable {
+        internal->getAudioLevelsSnapshot(completion);
+    });
+}
+
 void GroupInstanceCustomImpl::internal_addCustomNetworkEvent(bool isRemoteConnected) {
     _internal->perform([isRemoteConnected](GroupInstanceCustomInternal *internal) {
         internal->internal_addCustomNetworkEvent(isRemoteConnected);
@@ -40,12 +40,15 @@ public:
     void addExternalAudioSamples(std::vector<uint8_t> &&samples);
     
     void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
+    void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options);
     void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink);
+    void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options);
     
     void setVolume(uint32_t ssrc, double volume);
     void setRequestedVideoChannels(std::vector<VideoChannelDescription> &&requestedVideoChannels);
 
     void getStats(std::function<void(GroupInstanceStats)> completion);
+    void getAudioLevelsSnapshot(std::function<void(GroupLevelsUpdate const &)> completion);
     void internal_addCustomNetworkEvent(bool isRemoteConnected);
 
 private:
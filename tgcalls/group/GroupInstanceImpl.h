@@ -27,6 +27,7 @@ class scoped_refptr;
 namespace tgcalls {
 
 class LogSinkImpl;
+class GroupE2EFrameTransform;
 class GroupInstanceManager;
 class WrappedAudioDeviceModule;
 struct AudioFrame;
@@ -143,6 +144,8 @@ struct VideoChannelDescription {
     std::vector<MediaSsrcGroup> ssrcGroups;
     Quality minQuality = Quality::Thumbnail;
     Quality maxQuality = Quality::Thumbnail;
+    // Shown pinned or enlarged by the app, gets bandwidth before everything else.
+    bool isPinned = false;
 };
 
 struct GroupInstanceStats {
@@ -151,7 +154,21 @@ struct GroupInstanceStats {
         int availableQuality = 0;
     };
 
+    // What the receiver asked the SFU for, maxHeight 0 means the endpoint is off.
+    struct IncomingVideoAllocation {
+        int maxHeight = 0;
+        int maxFrameRate = 0;
+    };
+
     std::vector<std::pair<std::string, IncomingVideoStats>> incomingVideoStats;
+    std::vector<std::pair<std::string, IncomingVideoAllocation>> incomingVideoAllocations;
+    // Downlink estimate used for the allocation, 0 if none was available.
+    int64_t incomingVideoBitrateEstimateBps = 0;
+
+    // Highest resolution receivers currently ask for and the simulcast layers encoded for it.
+    int outgoingVideoConstraint = 0;
+    int outgoingVideoActiveLayers = 0;
+    int outgoingVideoLayers = 0;
 };
 
 struct GroupInstanceDescriptor {
@@ -183,8 +200,28 @@ struct GroupInstanceDescriptor {
     std::vector<VideoCodecName> videoCodecPreferences;
     std::function<std::shared_ptr<RequestMediaChannelDescriptionTask>(std::vector<uint32_t> const &, std::function<void(std::vector<MediaChannelDescription> &&)>)> requestMediaChannelDescriptions;
     int minOutgoingVideoBitrateKbit{100};
+    // Upper bound on simultaneously decoded incoming audio channels, 0 picks it from the CPU budget.
+    int maxIncomingAudioChannels{0};
+    // Take incoming levels only from the RTP audio-level extension and stop decoding
+    // channels that stay silent; ignored when e2eEncryptDecrypt is set.
+    bool suspendSilentIncomingAudio{false};
+    int audioLevelsUpdatePeriodMs{100};
+    // Report only levels that changed since the previous update and skip empty
+    // updates; an ssrc that goes quiet is reported once with a zero level.
+    bool audioLevelsDeltaOnly{false};
+    // Start decoding an unknown opus ssrc as an anonymous channel while its description
+    // is requested, instead of waiting for requestMediaChannelDescriptions to answer.
+    // Never used with e2e encryption, which needs the sender's user id to decrypt.
+    bool speculativeIncomingAudioChannels{false};
+    // Decoded pixels per second requested from the SFU across all incoming video, 0 means no limit.
+    int64_t maxIncomingVideoDecodePixelsPerSecond{0};
     std::function<void(bool)> onMutedSpeechActivityDetected;
     std::function<std::vector<uint8_t>(std::vector<uint8_t> const &, int64_t, bool, int32_t)> e2eEncryptDecrypt;
+    // Allocation-free replacement for e2eEncryptDecrypt, takes precedence when set.
+    std::shared_ptr<GroupE2EFrameTransform> e2eFrameTransform;
+    // Escape H264 ciphertext instead of re-encrypting frames that contain a start code.
+    // Changes the frame format, so every participant must use the same setting.
+    bool e2eEscapeEncryptedFrames{false};
     bool isConference{false};
     bool enableStereoMode = false;
     uint16_t customBitrate = 32;
@@ -220,11 +257,22 @@ public:
 
     virtual void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) = 0;
     virtual void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) = 0;
+    // Same as above, frames are downscaled and dropped per sink to fit |options|.
+    virtual void addOutgoingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+        addOutgoingVideoOutput(sink);
+    }
+    virtual void addIncomingVideoOutput(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+        addIncomingVideoOutput(endpointId, sink);
+    }
 
     virtual void setVolume(uint32_t ssrc, double volume) = 0;
     virtual void setRequestedVideoChannels(std::vector<VideoChannelDescription> &&requestedVideoChannels) = 0;
 
     virtual void getStats(std::function<void(GroupInstanceStats)> completion) = 0;
+    // Most recent level of every known ssrc, regardless of audioLevelsDeltaOnly.
+    virtual void getAudioLevelsSnapshot(std::function<void(GroupLevelsUpdate const &)> completion) {
+        completion(GroupLevelsUpdate());
+    }
     virtual void internal_addCustomNetworkEvent(bool isRemoteConnected) = 0;
 
     struct AudioDevice {
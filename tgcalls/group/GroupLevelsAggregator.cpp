@@ -0,0 +1,177 @@
+#include "GroupLevelsAggregator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tgcalls {
+
+namespace {
+
+bool isSilentLevel(GroupLevelValue const &value) {
+    return value.level <= 0.0f && !value.voice;
+}
+
+} // namespace
+
+GroupLevelsAggregator::GroupLevelsAggregator(Configuration configuration) :
+_configuration(configuration) {
+}
+
+uint32_t GroupLevelsAggregator::slotForSsrc(uint32_t ssrc) {
+    const auto it = _slotBySsrc.find(ssrc);
+    if (it != _slotBySsrc.end()) {
+        return it->second;
+    }
+
+    uint32_t index = 0;
+    if (!_freeSlots.empty()) {
+        index = _freeSlots.back();
+        _freeSlots.pop_back();
+    } else {
+        index = (uint32_t)_slots.size();
+        _slots.emplace_back();
+    }
+    _slots[index].ssrc = ssrc;
+    _slots[index].isUsed = true;
+    _slotBySsrc.emplace(ssrc, index);
+    return index;
+}
+
+void GroupLevelsAggregator::releaseSlot(uint32_t index) {
+    _slotBySsrc.erase(_slots[index].ssrc);
+    _slots[index] = Slot();
+    _freeSlots.push_back(index);
+}
+
+void GroupLevelsAggregator::updateLevel(uint32_t ssrc, GroupLevelValue const &value, int64_t timestamp) {
+    const auto index = slotForSsrc(ssrc);
+    auto &slot = _slots[index];
+    if (!slot.isLevelDirty) {
+        slot.isLevelDirty = true;
+        slot.pending = value;
+        slot.updatePeriod = _period;
+        _dirtyLevelSlots.push_back(index);
+    } else {
+        slot.pending.level = std::max(slot.pending.level, value.level);
+        slot.pending.voice = slot.pending.voice || value.voice;
+        slot.pending.isMuted = value.isMuted;
+    }
+    slot.updateTimestamp = timestamp;
+    if (value.voice) {
+        slot.voiceTimestamp = timestamp;
+    }
+}
+
+void GroupLevelsAggregator::updateActivity(uint32_t ssrc, int64_t timestamp) {
+    const auto index = slotForSsrc(ssrc);
+    auto &slot = _slots[index];
+    if (!slot.isActivityDirty) {
+        slot.isActivityDirty = true;
+        _dirtyActivitySlots.push_back(index);
+    }
+    slot.updateTimestamp = std::max(slot.updateTimestamp, timestamp);
+}
+
+bool GroupLevelsAggregator::isReportable(Slot const &slot, int64_t timestamp) const {
+    if (slot.current.voice != slot.reported.voice || slot.current.isMuted != slot.reported.isMuted) {
+        return true;
+    }
+    if (std::fabs(slot.current.level - slot.reported.level) >= _configuration.levelChangeThreshold) {
+        return true;
+    }
+    if (!isSilentLevel(slot.current) && timestamp - slot.reportedTimestamp >= _configuration.refreshIntervalMs) {
+        return true;
+    }
+    return false;
+}
+
+void GroupLevelsAggregator::collectLevels(int64_t timestamp, std::vector<GroupLevelUpdate> &updates) {
+    for (const auto index : _dirtyLevelSlots) {
+        auto &slot = _slots[index];
+        slot.isLevelDirty = false;
+        slot.current = slot.pending;
+        slot.pending = GroupLevelValue();
+
+        if (_configuration.onlyChanged && !isReportable(slot, timestamp)) {
+            continue;
+        }
+        updates.push_back(GroupLevelUpdate{ slot.ssrc, slot.current });
+        slot.reported = slot.current;
+        slot.reportedTimestamp = timestamp;
+
+        if (_configuration.onlyChanged && !slot.isAudible && !isSilentLevel(slot.reported)) {
+            slot.isAudible = true;
+            _audibleSlots.push_back(index);
+        }
+    }
+    _dirtyLevelSlots.clear();
+
+    // Consumers only see changes, so an ssrc that went quiet gets one final zero level.
+    for (size_t i = 0; i < _audibleSlots.size();) {
+        auto &slot = _slots[_audibleSlots[i]];
+        if (!isSilentLevel(slot.reported) && slot.updatePeriod != _period) {
+            slot.current = GroupLevelValue();
+            slot.reported = GroupLevelValue();
+            slot.reportedTimestamp = timestamp;
+            updates.push_back(GroupLevelUpdate{ slot.ssrc, GroupLevelValue() });
+        }
+        if (isSilentLevel(slot.reported)) {
+            slot.isAudible = false;
+            _audibleSlots[i] = _audibleSlots.back();
+            _audibleSlots.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    _period++;
+}
+
+void GroupLevelsAggregator::collectActivities(std::vector<GroupActivityUpdate> &updates) {
+    for (const auto index : _dirtyActivitySlots) {
+        auto &slot = _slots[index];
+        slot.isActivityDirty = false;
+        updates.push_back(GroupActivityUpdate{ slot.ssrc });
+    }
+    _dirtyActivitySlots.clear();
+}
+
+void GroupLevelsAggregator::snapshot(std::vector<GroupLevelUpdate> &updates) const {
+    for (const auto &slot : _slots) {
+        if (!slot.isUsed) {
+            continue;
+        }
+        if (slot.updatePeriod + 1 == _period) {
+            updates.push_back(GroupLevelUpdate{ slot.ssrc, slot.current });
+        } else {
+            updates.push_back(GroupLevelUpdate{ slot.ssrc, GroupLevelValue() });
+        }
+    }
+}
+
+int64_t GroupLevelsAggregator::lastVoiceTimestamp(uint32_t ssrc) const {
+    const auto it = _slotBySsrc.find(ssrc);
+    if (it == _slotBySsrc.end()) {
+        return 0;
+    }
+    return _slots[it->second].voiceTimestamp;
+}
+
+void GroupLevelsAggregator::prune(int64_t timestamp) {
+    if (timestamp < _nextPruneTimestamp) {
+        return;
+    }
+    _nextPruneTimestamp = timestamp + std::max((int64_t)1000, _configuration.slotTimeoutMs / 4);
+
+    for (uint32_t index = 0; index < (uint32_t)_slots.size(); index++) {
+        const auto &slot = _slots[index];
+        if (!slot.isUsed || slot.isLevelDirty || slot.isActivityDirty || slot.isAudible) {
+            continue;
+        }
+        if (timestamp - slot.updateTimestamp >= _configuration.slotTimeoutMs) {
+            releaseSlot(index);
+        }
+    }
+}
+
+} // namespace tgcalls
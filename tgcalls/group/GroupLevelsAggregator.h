@@ -0,0 +1,85 @@
+#ifndef TGCALLS_GROUP_LEVELS_AGGREGATOR_H
+#define TGCALLS_GROUP_LEVELS_AGGREGATOR_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "GroupInstanceImpl.h"
+
+namespace tgcalls {
+
+// Accumulates audio levels and activity marks per ssrc between two reports.
+// Every ssrc owns a dense slot that is reused for the lifetime of the call, so
+// steady-state updates and collection don't allocate. Only slots touched since
+// the previous collection are visited; in delta mode a slot is reported only
+// when its value changed noticeably, and once more with a zero level after it
+// stops being updated.
+class GroupLevelsAggregator {
+public:
+    struct Configuration {
+        // Report only levels that differ from the previously reported ones.
+        bool onlyChanged = false;
+        // Minimum difference in linear level that counts as a change.
+        float levelChangeThreshold = 0.01f;
+        // A non-zero level that didn't change is still repeated this often,
+        // so consumers that expire speakers by time keep seeing them.
+        int64_t refreshIntervalMs = 1000;
+        // Slots that haven't been updated for this long are released.
+        int64_t slotTimeoutMs = 30000;
+    };
+
+    explicit GroupLevelsAggregator(Configuration configuration);
+
+    // Merges a level sample into the current period, keeping the maximum level.
+    void updateLevel(uint32_t ssrc, GroupLevelValue const &value, int64_t timestamp);
+    void updateActivity(uint32_t ssrc, int64_t timestamp);
+
+    // Closes the current period and appends the levels to report to |updates|.
+    void collectLevels(int64_t timestamp, std::vector<GroupLevelUpdate> &updates);
+    // Appends every ssrc with activity since the previous call to |updates|.
+    void collectActivities(std::vector<GroupActivityUpdate> &updates);
+    // Appends the most recent level of every known ssrc to |updates|.
+    void snapshot(std::vector<GroupLevelUpdate> &updates) const;
+    // Time of the last level sample with voice for |ssrc|, 0 if there was none.
+    int64_t lastVoiceTimestamp(uint32_t ssrc) const;
+
+    // Releases slots that haven't been updated for slotTimeoutMs.
+    void prune(int64_t timestamp);
+
+private:
+    struct Slot {
+        uint32_t ssrc = 0;
+        bool isUsed = false;
+        bool isLevelDirty = false;
+        bool isActivityDirty = false;
+        bool isAudible = false;
+        GroupLevelValue pending;
+        GroupLevelValue current;
+        GroupLevelValue reported;
+        int64_t reportedTimestamp = 0;
+        int64_t updateTimestamp = 0;
+        int64_t voiceTimestamp = 0;
+        uint64_t updatePeriod = 0;
+    };
+
+    uint32_t slotForSsrc(uint32_t ssrc);
+    void releaseSlot(uint32_t index);
+    bool isReportable(Slot const &slot, int64_t timestamp) const;
+
+private:
+    Configuration _configuration;
+    std::unordered_map<uint32_t, uint32_t> _slotBySsrc;
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _freeSlots;
+    std::vector<uint32_t> _dirtyLevelSlots;
+    std::vector<uint32_t> _dirtyActivitySlots;
+    // Slots whose last reported level was non-zero, delta mode only.
+    std::vector<uint32_t> _audibleSlots;
+    uint64_t _period = 1;
+    int64_t _nextPruneTimestamp = 0;
+};
+
+} // namespace tgcalls
+
+#endif
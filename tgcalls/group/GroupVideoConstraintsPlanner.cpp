@@ -0,0 +1,215 @@
+#include "GroupVideoConstraintsPlanner.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace tgcalls {
+
+namespace {
+
+struct Step {
+    int height = 0;
+    int frameRate = 0;
+    int bitrateKbps = 0;
+};
+
+// Approximate SFU layer bitrates for the simulcast layers senders produce.
+constexpr Step kSteps[] = {
+    { 180, 15, 100 },
+    { 180, 30, 150 },
+    { 360, 15, 300 },
+    { 360, 30, 500 },
+    { 720, 15, 900 },
+    { 720, 30, 1500 }
+};
+constexpr int kStepCount = (int)(sizeof(kSteps) / sizeof(kSteps[0]));
+
+int maxStepForQuality(VideoChannelDescription::Quality quality) {
+    switch (quality) {
+        case VideoChannelDescription::Quality::Thumbnail:
+            return 1;
+        case VideoChannelDescription::Quality::Medium:
+            return 3;
+        case VideoChannelDescription::Quality::Full:
+            return 5;
+        default:
+            return 1;
+    }
+}
+
+// The lowest step with the height the quality asks for.
+int minStepForQuality(VideoChannelDescription::Quality quality) {
+    switch (quality) {
+        case VideoChannelDescription::Quality::Thumbnail:
+            return 0;
+        case VideoChannelDescription::Quality::Medium:
+            return 2;
+        case VideoChannelDescription::Quality::Full:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+int heightForQuality(VideoChannelDescription::Quality quality) {
+    return kSteps[minStepForQuality(quality)].height;
+}
+
+int64_t stepBitrateBps(int step) {
+    return step < 0 ? 0 : (int64_t)kSteps[step].bitrateKbps * 1000;
+}
+
+int64_t stepPixelsPerSecond(int step) {
+    if (step < 0) {
+        return 0;
+    }
+    const int64_t height = kSteps[step].height;
+    return height * height * 16 / 9 * kSteps[step].frameRate;
+}
+
+} // namespace
+
+GroupVideoConstraintsPlanner::GroupVideoConstraintsPlanner(Configuration configuration) :
+_configuration(configuration),
+_maxDecodePixelsPerSecond(std::max((int64_t)0, configuration.maxDecodePixelsPerSecond)) {
+}
+
+GroupVideoConstraintsPlanner::State const *GroupVideoConstraintsPlanner::findState(std::string const &endpointId) const {
+    for (const auto &state : _states) {
+        if (state.endpointId == endpointId) {
+            return &state;
+        }
+    }
+    return nullptr;
+}
+
+bool GroupVideoConstraintsPlanner::plan(std::vector<Endpoint> const &endpoints, int64_t downlinkBitrateBps, int64_t timestamp) {
+    // Higher priority first, the input order is kept within a class
+    std::vector<size_t> order(endpoints.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    const auto priorityClass = [&](size_t index) {
+        if (endpoints[index].isPinned) {
+            return 0;
+        }
+        return endpoints[index].isSpeaking ? 1 : 2;
+    };
+    std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return priorityClass(lhs) < priorityClass(rhs);
+    });
+
+    int64_t bitrateBudget = std::numeric_limits<int64_t>::max();
+    if (downlinkBitrateBps > 0) {
+        bitrateBudget = (int64_t)((double)downlinkBitrateBps * _configuration.bandwidthUtilization);
+    }
+    int64_t pixelBudget = std::numeric_limits<int64_t>::max();
+    if (_maxDecodePixelsPerSecond > 0) {
+        pixelBudget = _maxDecodePixelsPerSecond;
+    }
+
+    std::vector<int> steps(endpoints.size(), -1);
+    const auto tryRaise = [&](size_t index) {
+        const int current = steps[index];
+        const int next = current + 1;
+        if (next > maxStepForQuality(endpoints[index].maxQuality) || next >= kStepCount) {
+            return false;
+        }
+        const auto bitrateDelta = stepBitrateBps(next) - stepBitrateBps(current);
+        const auto pixelDelta = stepPixelsPerSecond(next) - stepPixelsPerSecond(current);
+        if (bitrateDelta > bitrateBudget || pixelDelta > pixelBudget) {
+            return false;
+        }
+        bitrateBudget -= bitrateDelta;
+        pixelBudget -= pixelDelta;
+        steps[index] = next;
+        return true;
+    };
+
+    for (const auto index : order) {
+        tryRaise(index);
+    }
+    for (const auto index : order) {
+        const int minStep = std::min(minStepForQuality(endpoints[index].minQuality), maxStepForQuality(endpoints[index].maxQuality));
+        while (steps[index] >= 0 && steps[index] < minStep && tryRaise(index)) {
+        }
+    }
+    for (int currentClass = 0; currentClass <= 2; currentClass++) {
+        bool raised = true;
+        while (raised) {
+            raised = false;
+            for (const auto index : order) {
+                if (priorityClass(index) == currentClass && steps[index] >= 0) {
+                    raised = tryRaise(index) || raised;
+                }
+            }
+        }
+    }
+
+    std::vector<State> states;
+    states.reserve(endpoints.size());
+    std::vector<Allocation> allocation;
+    allocation.reserve(endpoints.size());
+    Stats stats;
+    stats.availableBitrateBps = downlinkBitrateBps > 0 ? downlinkBitrateBps : 0;
+    stats.maxDecodePixelsPerSecond = _maxDecodePixelsPerSecond;
+
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        const auto &endpoint = endpoints[i];
+
+        State state;
+        state.endpointId = endpoint.endpointId;
+        state.minQuality = endpoint.minQuality;
+        state.maxQuality = endpoint.maxQuality;
+        state.isPinned = endpoint.isPinned;
+        state.step = steps[i];
+
+        const auto previous = findState(endpoint.endpointId);
+        const bool isRequestUnchanged = previous && previous->minQuality == endpoint.minQuality && previous->maxQuality == endpoint.maxQuality && previous->isPinned == endpoint.isPinned;
+        if (isRequestUnchanged && state.step > previous->step) {
+            // Lowering the step only frees budget, so the rest of the plan still fits
+            state.upgradeSince = previous->upgradeSince != 0 ? previous->upgradeSince : timestamp;
+            if (timestamp - state.upgradeSince < _configuration.upgradeHoldMs) {
+                state.step = previous->step;
+            } else {
+                state.upgradeSince = 0;
+            }
+        }
+
+        Allocation entry;
+        entry.endpointId = endpoint.endpointId;
+        // Full quality requests stay on stage as they always were, pinning only adds to them
+        entry.isOnStage = endpoint.isPinned || endpoint.maxQuality == VideoChannelDescription::Quality::Full;
+        if (state.step >= 0) {
+            const auto &step = kSteps[state.step];
+            entry.maxHeight = step.height;
+            entry.maxFrameRate = step.frameRate;
+            entry.bitrateKbps = step.bitrateKbps;
+            entry.minHeight = std::min(heightForQuality(endpoint.minQuality), step.height);
+        }
+        if (state.step < maxStepForQuality(endpoint.maxQuality)) {
+            stats.limitedEndpoints++;
+        }
+        stats.allocatedBitrateBps += stepBitrateBps(state.step);
+        stats.allocatedPixelsPerSecond += stepPixelsPerSecond(state.step);
+
+        states.push_back(std::move(state));
+        allocation.push_back(std::move(entry));
+    }
+
+    const bool isChanged = allocation != _allocation;
+    _states = std::move(states);
+    _allocation = std::move(allocation);
+    _stats = stats;
+    return isChanged;
+}
+
+std::vector<GroupVideoConstraintsPlanner::Allocation> const &GroupVideoConstraintsPlanner::allocation() const {
+    return _allocation;
+}
+
+GroupVideoConstraintsPlanner::Stats GroupVideoConstraintsPlanner::getStats() const {
+    return _stats;
+}
+
+} // namespace tgcalls
@@ -0,0 +1,97 @@
+#ifndef TGCALLS_GROUP_VIDEO_CONSTRAINTS_PLANNER_H
+#define TGCALLS_GROUP_VIDEO_CONSTRAINTS_PLANNER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "GroupInstanceImpl.h"
+
+namespace tgcalls {
+
+// Chooses the height and frame rate requested from the SFU for every incoming
+// video endpoint. Each endpoint climbs a fixed ladder of (height, frame rate)
+// steps bounded by its requested quality. Every endpoint first gets the
+// lowest step, then its requested minimum, then the remaining downlink
+// bandwidth and decode budget go to pinned endpoints first, speaking ones
+// next and the rest last. Lower steps apply at once. A higher step has to
+// stay affordable for upgradeHoldMs before it's taken, unless the request
+// for the endpoint changed.
+class GroupVideoConstraintsPlanner {
+public:
+    struct Configuration {
+        // Share of the downlink estimate that incoming video may use.
+        float bandwidthUtilization = 0.85f;
+        // Decoded pixels per second that incoming video may use, 0 or less means no limit.
+        int64_t maxDecodePixelsPerSecond = 0;
+        int64_t upgradeHoldMs = 3000;
+    };
+
+    struct Endpoint {
+        std::string endpointId;
+        VideoChannelDescription::Quality minQuality = VideoChannelDescription::Quality::Thumbnail;
+        VideoChannelDescription::Quality maxQuality = VideoChannelDescription::Quality::Thumbnail;
+        bool isPinned = false;
+        bool isSpeaking = false;
+    };
+
+    struct Allocation {
+        std::string endpointId;
+        bool isOnStage = false;
+        // 0 means no constraint for minHeight and no video for maxHeight.
+        int minHeight = 0;
+        int maxHeight = 0;
+        int maxFrameRate = 0;
+        int bitrateKbps = 0;
+
+        bool operator==(Allocation const &rhs) const {
+            return endpointId == rhs.endpointId && isOnStage == rhs.isOnStage && minHeight == rhs.minHeight && maxHeight == rhs.maxHeight && maxFrameRate == rhs.maxFrameRate;
+        }
+        bool operator!=(Allocation const &rhs) const {
+            return !(*this == rhs);
+        }
+    };
+
+    struct Stats {
+        // 0 when there is no downlink estimate and bandwidth is not limited.
+        int64_t availableBitrateBps = 0;
+        int64_t allocatedBitrateBps = 0;
+        // 0 when decoding is not limited.
+        int64_t maxDecodePixelsPerSecond = 0;
+        int64_t allocatedPixelsPerSecond = 0;
+        // Endpoints that got less than their requested maximum.
+        int limitedEndpoints = 0;
+    };
+
+    explicit GroupVideoConstraintsPlanner(Configuration configuration);
+
+    // Recomputes the allocation, |downlinkBitrateBps| of 0 means unknown.
+    // Returns whether the allocation differs from the previous one.
+    bool plan(std::vector<Endpoint> const &endpoints, int64_t downlinkBitrateBps, int64_t timestamp);
+
+    std::vector<Allocation> const &allocation() const;
+    Stats getStats() const;
+
+private:
+    struct State {
+        std::string endpointId;
+        VideoChannelDescription::Quality minQuality = VideoChannelDescription::Quality::Thumbnail;
+        VideoChannelDescription::Quality maxQuality = VideoChannelDescription::Quality::Thumbnail;
+        bool isPinned = false;
+        int step = -1;
+        int64_t upgradeSince = 0;
+    };
+
+    State const *findState(std::string const &endpointId) const;
+
+private:
+    Configuration _configuration;
+    int64_t _maxDecodePixelsPerSecond = 0;
+    std::vector<State> _states;
+    std::vector<Allocation> _allocation;
+    Stats _stats;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -0,0 +1,254 @@
+#include "IncomingAudioChannelScheduler.h"
+
+#include <algorithm>
+
+namespace tgcalls {
+
+namespace {
+
+int computeMaxActiveChannels(IncomingAudioChannelScheduler::Configuration const &configuration) {
+    if (configuration.maxActiveChannels > 0) {
+        return configuration.maxActiveChannels;
+    }
+    // All channels are decoded by the mixer on the audio playout thread, so the
+    // budget is a share of one core however many the machine has.
+    float decodeCost = std::max(0.01f, configuration.decodeCostPercent);
+    int channels = (int)((float)configuration.cpuBudgetPercent / decodeCost);
+    return std::clamp(channels, configuration.minActiveChannels, std::max(configuration.minActiveChannels, configuration.maxAutomaticActiveChannels));
+}
+
+} // namespace
+
+IncomingAudioChannelScheduler::IncomingAudioChannelScheduler(Configuration configuration) :
+_configuration(configuration),
+_maxActiveChannels(computeMaxActiveChannels(configuration)) {
+    _entries.reserve(_maxActiveChannels * 2);
+    _activeSsrcs.reserve(_maxActiveChannels);
+}
+
+IncomingAudioChannelScheduler::Admission IncomingAudioChannelScheduler::requestChannel(Channel const &channel, int64_t timestamp) {
+    Admission result;
+
+    const auto inserted = _entries.emplace(channel.networkSsrc, Entry());
+    auto &entry = inserted.first->second;
+    entry.channel = channel;
+    if (entry.isActive) {
+        result.isAdmitted = true;
+        return result;
+    }
+    if (!inserted.second) {
+        removeCandidate(entry);
+    }
+    if (entry.lastActivity == 0) {
+        entry.lastActivity = timestamp;
+    }
+
+    if ((int)_activeSsrcs.size() >= _maxActiveChannels) {
+        Entry *victim = findEvictionVictim(timestamp, channel.networkSsrc);
+        if (!victim) {
+            addCandidate(entry);
+            _stats.rejectedAdmissions++;
+            return result;
+        }
+        result.hasEvicted = true;
+        result.evicted = victim->channel;
+        releaseChannel(victim->channel.networkSsrc);
+    }
+
+    activate(entry, timestamp);
+    result.isAdmitted = true;
+    return result;
+}
+
+void IncomingAudioChannelScheduler::releaseChannel(uint32_t networkSsrc) {
+    const auto it = _entries.find(networkSsrc);
+    if (it == _entries.end() || !it->second.isActive) {
+        return;
+    }
+    it->second.isActive = false;
+    it->second.waitingSince = 0;
+    const auto active = std::find(_activeSsrcs.begin(), _activeSsrcs.end(), networkSsrc);
+    *active = _activeSsrcs.back();
+    _activeSsrcs.pop_back();
+    addCandidate(it->second);
+}
+
+void IncomingAudioChannelScheduler::removeChannel(uint32_t networkSsrc) {
+    releaseChannel(networkSsrc);
+    const auto it = _entries.find(networkSsrc);
+    if (it == _entries.end()) {
+        return;
+    }
+    removeCandidate(it->second);
+    _entries.erase(it);
+}
+
+void IncomingAudioChannelScheduler::clear() {
+    _entries.clear();
+    _activeSsrcs.clear();
+    _candidatesBySpeech.clear();
+    _candidatesByActivity.clear();
+}
+
+void IncomingAudioChannelScheduler::reportLevel(uint32_t networkSsrc, float level, bool isSpeech, int64_t timestamp) {
+    const auto it = _entries.find(networkSsrc);
+    if (it == _entries.end()) {
+        return;
+    }
+    auto &entry = it->second;
+    if (!entry.isActive) {
+        removeCandidate(entry);
+    }
+    entry.lastActivity = timestamp;
+    entry.smoothedLevel = entry.smoothedLevel * 0.8f + level * 0.2f;
+    if (isSpeech) {
+        entry.lastSpeech = timestamp;
+        if (!entry.isActive && entry.waitingSince == 0) {
+            entry.waitingSince = timestamp;
+        }
+    }
+    if (!entry.isActive) {
+        addCandidate(entry);
+    }
+}
+
+void IncomingAudioChannelScheduler::reportActivity(uint32_t networkSsrc, int64_t timestamp) {
+    const auto it = _entries.find(networkSsrc);
+    if (it == _entries.end() || it->second.lastActivity == timestamp) {
+        return;
+    }
+    auto &entry = it->second;
+    if (entry.isActive) {
+        entry.lastActivity = timestamp;
+        return;
+    }
+    _candidatesByActivity.erase(std::make_pair(entry.lastActivity, networkSsrc));
+    entry.lastActivity = timestamp;
+    _candidatesByActivity.emplace(entry.lastActivity, networkSsrc);
+}
+
+bool IncomingAudioChannelScheduler::isPendingCandidate(uint32_t networkSsrc) const {
+    const auto it = _entries.find(networkSsrc);
+    return it != _entries.end() && !it->second.isActive;
+}
+
+bool IncomingAudioChannelScheduler::hasFreeChannel() const {
+    return (int)_activeSsrcs.size() < _maxActiveChannels;
+}
+
+int IncomingAudioChannelScheduler::maxActiveChannels() const {
+    return _maxActiveChannels;
+}
+
+std::vector<IncomingAudioChannelScheduler::Swap> IncomingAudioChannelScheduler::update(int64_t timestamp) {
+    std::vector<Swap> swaps;
+
+    while (!_candidatesByActivity.empty() && _candidatesByActivity.begin()->first < timestamp - _configuration.candidateTimeoutMs) {
+        const auto it = _entries.find(_candidatesByActivity.begin()->second);
+        removeCandidate(it->second);
+        _entries.erase(it);
+    }
+
+    // Loudest speaking candidates are admitted first.
+    std::vector<Entry *> candidates;
+    for (auto it = _candidatesBySpeech.rbegin(); it != _candidatesBySpeech.rend(); ++it) {
+        auto &entry = _entries.find(it->second)->second;
+        if (!isSpeaking(entry, timestamp)) {
+            break;
+        }
+        candidates.push_back(&entry);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](Entry const *lhs, Entry const *rhs) {
+        return lhs->smoothedLevel > rhs->smoothedLevel;
+    });
+
+    for (auto candidate : candidates) {
+        if ((int)_activeSsrcs.size() < _maxActiveChannels) {
+            activate(*candidate, timestamp);
+            Swap swap;
+            swap.admitted = candidate->channel;
+            swaps.push_back(swap);
+            continue;
+        }
+        Entry *victim = findEvictionVictim(timestamp, candidate->channel.networkSsrc);
+        if (!victim) {
+            break;
+        }
+        Swap swap;
+        swap.evicted = victim->channel;
+        swap.admitted = candidate->channel;
+        releaseChannel(victim->channel.networkSsrc);
+        activate(*candidate, timestamp);
+        swaps.push_back(swap);
+        _stats.totalSwaps++;
+    }
+
+    return swaps;
+}
+
+IncomingAudioChannelScheduler::Stats IncomingAudioChannelScheduler::getStats() const {
+    Stats stats = _stats;
+    stats.activeChannels = (int)_activeSsrcs.size();
+    stats.pendingCandidates = (int)(_entries.size() - _activeSsrcs.size());
+    stats.maxActiveChannels = _maxActiveChannels;
+    return stats;
+}
+
+IncomingAudioChannelScheduler::Entry *IncomingAudioChannelScheduler::findEvictionVictim(int64_t timestamp, uint32_t excludeSsrc) {
+    Entry *victim = nullptr;
+    for (const auto ssrc : _activeSsrcs) {
+        if (ssrc == excludeSsrc) {
+            continue;
+        }
+        auto &entry = _entries.find(ssrc)->second;
+        if (entry.activeSince > timestamp - _configuration.minResidencyMs) {
+            continue;
+        }
+        int64_t lastHeard = std::max(entry.lastSpeech, entry.activeSince);
+        if (lastHeard > timestamp - _configuration.evictionSilenceMs) {
+            continue;
+        }
+        if (!victim || lastHeard < std::max(victim->lastSpeech, victim->activeSince)) {
+            victim = &entry;
+        }
+    }
+    return victim;
+}
+
+void IncomingAudioChannelScheduler::activate(Entry &entry, int64_t timestamp) {
+    if (entry.isActive) {
+        return;
+    }
+    removeCandidate(entry);
+    entry.isActive = true;
+    entry.activeSince = timestamp;
+    if (entry.waitingSince != 0) {
+        _stats.lastSpeakerWaitMs = timestamp - entry.waitingSince;
+        _stats.maxSpeakerWaitMs = std::max(_stats.maxSpeakerWaitMs, _stats.lastSpeakerWaitMs);
+        entry.waitingSince = 0;
+    }
+    _activeSsrcs.push_back(entry.channel.networkSsrc);
+    _stats.totalAdmissions++;
+}
+
+bool IncomingAudioChannelScheduler::isSpeaking(Entry const &entry, int64_t timestamp) const {
+    return entry.lastSpeech != 0 && entry.lastSpeech > timestamp - _configuration.speechHoldMs;
+}
+
+void IncomingAudioChannelScheduler::addCandidate(Entry const &entry) {
+    const auto ssrc = entry.channel.networkSsrc;
+    _candidatesByActivity.emplace(entry.lastActivity, ssrc);
+    if (entry.lastSpeech != 0) {
+        _candidatesBySpeech.emplace(entry.lastSpeech, ssrc);
+    }
+}
+
+void IncomingAudioChannelScheduler::removeCandidate(Entry const &entry) {
+    const auto ssrc = entry.channel.networkSsrc;
+    _candidatesByActivity.erase(std::make_pair(entry.lastActivity, ssrc));
+    if (entry.lastSpeech != 0) {
+        _candidatesBySpeech.erase(std::make_pair(entry.lastSpeech, ssrc));
+    }
+}
+
+} // namespace tgcalls
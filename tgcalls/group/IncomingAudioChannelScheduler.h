@@ -0,0 +1,127 @@
+#ifndef TGCALLS_INCOMING_AUDIO_CHANNEL_SCHEDULER_H
+#define TGCALLS_INCOMING_AUDIO_CHANNEL_SCHEDULER_H
+
+#include <stdint.h>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tgcalls {
+
+// Decides which remote audio ssrcs get a decoding IncomingAudioChannel.
+// The number of decoded channels is bounded by a CPU budget; candidates that
+// don't fit are remembered and swapped in once they speak while a decoded
+// channel has been quiet for long enough (hysteresis prevents flapping).
+// Entries are keyed by network ssrc in a hash map. Eviction only looks at the
+// active channels, and pending candidates are ranked by last speech and last
+// activity, so neither promotion nor expiry visits every stale candidate.
+class IncomingAudioChannelScheduler {
+public:
+    struct Configuration {
+        // Explicit limit on decoded channels; 0 derives it from the CPU budget.
+        int maxActiveChannels = 0;
+        // Share of a single core, in percent, that incoming decoding may use.
+        int cpuBudgetPercent = 30;
+        // Approximate cost of one Opus decoder with NetEq, in percent of a core.
+        float decodeCostPercent = 1.0f;
+        int minActiveChannels = 10;
+        int maxAutomaticActiveChannels = 40;
+        // A decoded channel must be silent this long before it can be replaced.
+        int64_t evictionSilenceMs = 1000;
+        // Minimum time a channel stays decoded after being admitted.
+        int64_t minResidencyMs = 2000;
+        // A candidate is considered speaking for this long after its last speech.
+        int64_t speechHoldMs = 500;
+        // Candidates that haven't produced any packets for this long are forgotten.
+        int64_t candidateTimeoutMs = 30000;
+    };
+
+    struct Channel {
+        uint32_t networkSsrc = 0;
+        uint32_t actualSsrc = 0;
+        int64_t userId = 0;
+    };
+
+    struct Admission {
+        bool isAdmitted = false;
+        // Set when an active channel has to be removed to make room.
+        bool hasEvicted = false;
+        Channel evicted;
+    };
+
+    struct Swap {
+        Channel evicted;
+        Channel admitted;
+    };
+
+    struct Stats {
+        int activeChannels = 0;
+        int pendingCandidates = 0;
+        int maxActiveChannels = 0;
+        int64_t totalAdmissions = 0;
+        int64_t totalSwaps = 0;
+        int64_t rejectedAdmissions = 0;
+        // Time from the first speech of a pending candidate until it got a channel.
+        int64_t lastSpeakerWaitMs = 0;
+        int64_t maxSpeakerWaitMs = 0;
+    };
+
+    explicit IncomingAudioChannelScheduler(Configuration configuration);
+
+    // Asks for a decoding slot; a rejected channel stays a pending candidate.
+    Admission requestChannel(Channel const &channel, int64_t timestamp);
+    // Marks an active channel as no longer decoded, keeping it as a candidate.
+    void releaseChannel(uint32_t networkSsrc);
+    // Forgets the channel entirely, it won't be swapped back in.
+    void removeChannel(uint32_t networkSsrc);
+    void clear();
+
+    void reportLevel(uint32_t networkSsrc, float level, bool isSpeech, int64_t timestamp);
+    void reportActivity(uint32_t networkSsrc, int64_t timestamp);
+
+    bool isPendingCandidate(uint32_t networkSsrc) const;
+    // Whether requestChannel would admit a channel without evicting another one.
+    bool hasFreeChannel() const;
+    int maxActiveChannels() const;
+
+    // Returns swaps that should be applied now and drops stale candidates.
+    std::vector<Swap> update(int64_t timestamp);
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        Channel channel;
+        bool isActive = false;
+        int64_t activeSince = 0;
+        int64_t lastActivity = 0;
+        int64_t lastSpeech = 0;
+        // First speech observed while waiting for a channel, 0 if none.
+        int64_t waitingSince = 0;
+        float smoothedLevel = 0.0f;
+    };
+
+    Entry *findEvictionVictim(int64_t timestamp, uint32_t excludeSsrc);
+    void activate(Entry &entry, int64_t timestamp);
+    bool isSpeaking(Entry const &entry, int64_t timestamp) const;
+    // Pending entries are ranked by the fields below, so they have to be taken
+    // out of the ranking before lastActivity or lastSpeech change.
+    void addCandidate(Entry const &entry);
+    void removeCandidate(Entry const &entry);
+
+private:
+    Configuration _configuration;
+    int _maxActiveChannels = 0;
+    std::unordered_map<uint32_t, Entry> _entries;
+    std::vector<uint32_t> _activeSsrcs;
+    // Pending candidates by (lastSpeech, ssrc), only those that ever spoke.
+    std::set<std::pair<int64_t, uint32_t>> _candidatesBySpeech;
+    // Pending candidates by (lastActivity, ssrc).
+    std::set<std::pair<int64_t, uint32_t>> _candidatesByActivity;
+    Stats _stats;
+};
+
+} // namespace tgcalls
+
+#endif
@@ -0,0 +1,349 @@
+#include "OggOpusStreamingPart.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "rtc_base/logging.h"
+
+namespace tgcalls {
+
+namespace {
+
+constexpr size_t kPageHeaderSize = 27;
+constexpr uint8_t kPageContinued = 0x01;
+constexpr uint8_t kPageBeginsStream = 0x02;
+// Largest Opus packet, 120 ms at 48 kHz.
+constexpr int kMaxPacketSamples = 5760;
+
+uint16_t readUInt16(uint8_t const *data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+uint32_t readUInt32(uint8_t const *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+int64_t readInt64(uint8_t const *data) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | data[i];
+    }
+    return (int64_t)value;
+}
+
+// Samples per channel at 48 kHz, from the TOC byte and frame count (RFC 6716, 3.1).
+int opusPacketSampleCount(uint8_t const *data, size_t size) {
+    if (size < 1) {
+        return -1;
+    }
+
+    const int config = data[0] >> 3;
+    int frameSamples = 0;
+    if (config < 12) {
+        static const int silkFrameSamples[] = { 480, 960, 1920, 2880 };
+        frameSamples = silkFrameSamples[config & 3];
+    } else if (config < 16) {
+        frameSamples = (config & 1) ? 960 : 480;
+    } else {
+        frameSamples = 120 << (config & 3);
+    }
+
+    int frameCount = 0;
+    switch (data[0] & 3) {
+    case 0:
+        frameCount = 1;
+        break;
+    case 1:
+    case 2:
+        frameCount = 2;
+        break;
+    default:
+        if (size < 2) {
+            return -1;
+        }
+        frameCount = data[1] & 0x3f;
+        break;
+    }
+
+    const int result = frameCount * frameSamples;
+    if (result <= 0 || result > kMaxPacketSamples) {
+        return -1;
+    }
+    return result;
+}
+
+}
+
+OggOpusStreamingPart::OggOpusStreamingPart(StreamingPartData data) :
+_data(std::move(data)) {
+}
+
+std::unique_ptr<OggOpusStreamingPart> OggOpusStreamingPart::parse(StreamingPartData data) {
+    auto result = std::unique_ptr<OggOpusStreamingPart>(new OggOpusStreamingPart(std::move(data)));
+    if (!result->parsePages()) {
+        return nullptr;
+    }
+    return result;
+}
+
+OggOpusHead const &OggOpusStreamingPart::head() const {
+    return _head;
+}
+
+std::map<std::string, std::string> const &OggOpusStreamingPart::comments() const {
+    return _comments;
+}
+
+int64_t OggOpusStreamingPart::getSampleCount() const {
+    return _sampleCount;
+}
+
+bool OggOpusStreamingPart::readPacket(uint8_t const *&data, size_t &size) {
+    if (_nextPacket >= _packets.size()) {
+        return false;
+    }
+
+    const auto &packet = _packets[_nextPacket];
+    _nextPacket++;
+
+    data = packetData(packet);
+    size = packet.size;
+    return true;
+}
+
+uint8_t const *OggOpusStreamingPart::packetData(Packet const &packet) const {
+    return packet.isJoined ? _joinedPackets.data() + packet.offset : _data.data() + packet.offset;
+}
+
+bool OggOpusStreamingPart::parsePages() {
+    struct GranulePosition {
+        int64_t granule = 0;
+        // Packets completed up to the end of the page.
+        size_t packetCount = 0;
+    };
+    std::vector<GranulePosition> granulePositions;
+
+    uint8_t const *data = _data.data();
+    const size_t size = _data.size();
+
+    size_t offset = 0;
+    bool hasSerial = false;
+    uint32_t serial = 0;
+    bool isPacketOpen = false;
+    size_t joinedPacketOffset = 0;
+
+    while (offset < size) {
+        if (size - offset < kPageHeaderSize) {
+            return false;
+        }
+        uint8_t const *page = data + offset;
+        if (memcmp(page, "OggS", 4) != 0 || page[4] != 0) {
+            return false;
+        }
+
+        const uint8_t headerType = page[5];
+        const int64_t granule = readInt64(page + 6);
+        const uint32_t pageSerial = readUInt32(page + 14);
+        const size_t segmentCount = page[26];
+        if (size - offset < kPageHeaderSize + segmentCount) {
+            return false;
+        }
+        uint8_t const *lacing = page + kPageHeaderSize;
+        size_t bodySize = 0;
+        for (size_t i = 0; i < segmentCount; i++) {
+            bodySize += lacing[i];
+        }
+        const size_t bodyOffset = offset + kPageHeaderSize + segmentCount;
+        if (size - bodyOffset < bodySize) {
+            return false;
+        }
+
+        if (!hasSerial) {
+            if (!(headerType & kPageBeginsStream)) {
+                return false;
+            }
+            hasSerial = true;
+            serial = pageSerial;
+        } else if (pageSerial != serial) {
+            // Multiplexed streams are left to libavformat
+            return false;
+        }
+        if (((headerType & kPageContinued) != 0) != isPacketOpen) {
+            return false;
+        }
+
+        size_t packetStart = bodyOffset;
+        size_t packetEnd = bodyOffset;
+        for (size_t i = 0; i < segmentCount; i++) {
+            packetEnd += lacing[i];
+            if (lacing[i] == 255) {
+                continue;
+            }
+
+            Packet packet;
+            if (isPacketOpen) {
+                _joinedPackets.insert(_joinedPackets.end(), data + packetStart, data + packetEnd);
+                packet.offset = joinedPacketOffset;
+                packet.size = _joinedPackets.size() - joinedPacketOffset;
+                packet.isJoined = true;
+                isPacketOpen = false;
+            } else {
+                packet.offset = packetStart;
+                packet.size = packetEnd - packetStart;
+            }
+            _packets.push_back(packet);
+            packetStart = packetEnd;
+        }
+        if (packetStart != packetEnd) {
+            // The last packet continues on the next page
+            if (!isPacketOpen) {
+                joinedPacketOffset = _joinedPackets.size();
+                isPacketOpen = true;
+            }
+            _joinedPackets.insert(_joinedPackets.end(), data + packetStart, data + packetEnd);
+        }
+
+        if (granule != -1) {
+            GranulePosition position;
+            position.granule = granule;
+            position.packetCount = _packets.size();
+            granulePositions.push_back(position);
+        }
+
+        offset = bodyOffset + bodySize;
+    }
+
+    if (isPacketOpen || _packets.size() < 2) {
+        return false;
+    }
+    if (!parseHead(packetData(_packets[0]), _packets[0].size) || !parseTags(packetData(_packets[1]), _packets[1].size)) {
+        return false;
+    }
+    _packets.erase(_packets.begin(), _packets.begin() + 2);
+
+    // Samples up to the end of each packet
+    std::vector<int64_t> packetEnds;
+    packetEnds.reserve(_packets.size());
+    int64_t totalSamples = 0;
+    for (const auto &packet : _packets) {
+        const int packetSamples = opusPacketSampleCount(packetData(packet), packet.size);
+        if (packetSamples < 0) {
+            return false;
+        }
+        totalSamples += packetSamples;
+        packetEnds.push_back(totalSamples);
+    }
+
+    // The granule positions of the audio pages may start anywhere, the first
+    // one gives the offset and the last one the end trimming (RFC 7845, 4)
+    int64_t endSample = totalSamples;
+    int64_t startGranule = -1;
+    for (const auto &position : granulePositions) {
+        if (position.packetCount <= 2) {
+            continue;
+        }
+        const int64_t samples = packetEnds[position.packetCount - 3];
+        if (startGranule == -1) {
+            startGranule = position.granule - samples;
+            if (startGranule < 0) {
+                return false;
+            }
+        }
+        endSample = std::min(totalSamples, std::max((int64_t)0, position.granule - startGranule));
+    }
+    _sampleCount = std::max((int64_t)0, endSample - _head.preSkip);
+
+    return true;
+}
+
+bool OggOpusStreamingPart::parseHead(uint8_t const *data, size_t size) {
+    if (size < 19 || memcmp(data, "OpusHead", 8) != 0) {
+        return false;
+    }
+    // Only the major version has to match
+    if ((data[8] >> 4) != 0) {
+        return false;
+    }
+
+    _head.channelCount = data[9];
+    _head.preSkip = readUInt16(data + 10);
+    _head.outputGain = (int16_t)readUInt16(data + 16);
+    _head.mappingFamily = data[18];
+    if (_head.channelCount == 0 || _head.channelCount > 8) {
+        return false;
+    }
+
+    if (_head.mappingFamily == 0) {
+        if (_head.channelCount > 2) {
+            return false;
+        }
+        _head.streamCount = 1;
+        _head.coupledStreamCount = _head.channelCount == 2 ? 1 : 0;
+        return true;
+    }
+    if (_head.mappingFamily != 255) {
+        RTC_LOG(LS_INFO) << "OggOpusStreamingPart: channel mapping family " << _head.mappingFamily << " is left to libavformat";
+        return false;
+    }
+
+    if (size < 21 + (size_t)_head.channelCount) {
+        return false;
+    }
+    _head.streamCount = data[19];
+    _head.coupledStreamCount = data[20];
+    if (_head.streamCount == 0 || _head.coupledStreamCount > _head.streamCount) {
+        return false;
+    }
+    _head.channelMapping.assign(data + 21, data + 21 + _head.channelCount);
+    for (const auto index : _head.channelMapping) {
+        if (index != 255 && index >= _head.streamCount + _head.coupledStreamCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OggOpusStreamingPart::parseTags(uint8_t const *data, size_t size) {
+    if (size < 16 || memcmp(data, "OpusTags", 8) != 0) {
+        return false;
+    }
+
+    size_t offset = 8;
+    const uint32_t vendorLength = readUInt32(data + offset);
+    offset += 4;
+    if (size - offset < (size_t)vendorLength + 4) {
+        return false;
+    }
+    offset += vendorLength;
+
+    const uint32_t commentCount = readUInt32(data + offset);
+    offset += 4;
+    for (uint32_t i = 0; i < commentCount; i++) {
+        if (size - offset < 4) {
+            return false;
+        }
+        const uint32_t commentLength = readUInt32(data + offset);
+        offset += 4;
+        if (size - offset < commentLength) {
+            return false;
+        }
+
+        const std::string comment((char const *)data + offset, commentLength);
+        offset += commentLength;
+
+        const auto separator = comment.find('=');
+        if (separator == std::string::npos) {
+            continue;
+        }
+        // Field names are case-insensitive, as they are for av_dict_get
+        std::string key = comment.substr(0, separator);
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) {
+            return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+        });
+        _comments.insert(std::make_pair(std::move(key), comment.substr(separator + 1)));
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef TGCALLS_OGG_OPUS_STREAMING_PART_H
+#define TGCALLS_OGG_OPUS_STREAMING_PART_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "AVIOContextImpl.h"
+
+namespace tgcalls {
+
+// Fields of the OpusHead packet that affect decoding.
+struct OggOpusHead {
+    int channelCount = 0;
+    int preSkip = 0;
+    // Q7.8 dB.
+    int outputGain = 0;
+    int mappingFamily = 0;
+    int streamCount = 1;
+    int coupledStreamCount = 0;
+    std::vector<uint8_t> channelMapping;
+
+    bool operator==(OggOpusHead const &rhs) const {
+        return channelCount == rhs.channelCount && outputGain == rhs.outputGain && mappingFamily == rhs.mappingFamily && streamCount == rhs.streamCount && coupledStreamCount == rhs.coupledStreamCount && channelMapping == rhs.channelMapping;
+    }
+    bool operator!=(OggOpusHead const &rhs) const {
+        return !(*this == rhs);
+    }
+};
+
+// Reads a broadcast audio part that is a single Ogg stream of Opus packets,
+// without going through libavformat. The part is scanned once when parsed.
+// Packets that lie within one page point into the part, the few spanning
+// pages are joined into a buffer of their own. Not thread-safe.
+class OggOpusStreamingPart {
+public:
+    // nullptr if |data| is not a single Ogg/Opus stream this reader handles,
+    // the caller falls back to libavformat then. Channel mapping families
+    // other than 0 and 255 are left to libavformat as well, because it
+    // reorders their channels.
+    static std::unique_ptr<OggOpusStreamingPart> parse(StreamingPartData data);
+
+    OggOpusHead const &head() const;
+    // Comments of the OpusTags packet, keys in upper case.
+    std::map<std::string, std::string> const &comments() const;
+    // Samples per channel at 48 kHz, without pre-skip and end trimming.
+    int64_t getSampleCount() const;
+
+    // The next audio packet, false at the end. |data| stays valid as long as
+    // this part.
+    bool readPacket(uint8_t const *&data, size_t &size);
+
+private:
+    struct Packet {
+        size_t offset = 0;
+        size_t size = 0;
+        bool isJoined = false;
+    };
+
+    explicit OggOpusStreamingPart(StreamingPartData data);
+
+    bool parsePages();
+    bool parseHead(uint8_t const *data, size_t size);
+    bool parseTags(uint8_t const *data, size_t size);
+    uint8_t const *packetData(Packet const &packet) const;
+
+private:
+    const StreamingPartData _data;
+    std::vector<uint8_t> _joinedPackets;
+    std::vector<Packet> _packets;
+    size_t _nextPacket = 0;
+
+    OggOpusHead _head;
+    std::map<std::string, std::string> _comments;
+    int64_t _sampleCount = 0;
+};
+
+}
+
+#endif
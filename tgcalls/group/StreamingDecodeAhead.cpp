@@ -0,0 +1,424 @@
+#include "StreamingDecodeAhead.h"
+
+#include <algorithm>
+#include <set>
+
+#include "rtc_base/thread.h"
+
+namespace tgcalls {
+
+namespace {
+
+rtc::Thread *decodeThread() {
+    static auto result = [] {
+        auto thread = rtc::Thread::Create();
+        thread->SetName("tgc-broadcast-decode", nullptr);
+        thread->Start();
+        return thread;
+    }();
+    return result.get();
+}
+
+}
+
+DecodedVideoPart::DecodedVideoPart(std::weak_ptr<StreamingDecodeAhead> owner, std::shared_ptr<VideoStreamingPart> part, bool isUnified) :
+_owner(owner),
+_isUnified(isUnified),
+_part(part) {
+    webrtc::MutexLock lock(&_mutex);
+    _activeEndpointId = _part->getActiveEndpointId();
+    _lastActiveEndpointId = _activeEndpointId;
+}
+
+DecodedVideoPart::~DecodedVideoPart() {
+    // Parts waiting for the decoder this one used may continue
+    if (const auto owner = _owner.lock()) {
+        owner->schedulePump();
+    }
+}
+
+absl::optional<VideoStreamingPartFrame> DecodedVideoPart::getFrameAtRelativeTimestamp(double timestamp) {
+    bool didConsume = false;
+    absl::optional<VideoStreamingPartFrame> result;
+    {
+        webrtc::MutexLock lock(&_mutex);
+        _playbackTimestamp = timestamp;
+        if (!_isDemanded) {
+            // More packets to skip
+            didConsume = !_isFinished && timestamp > _skippedTimestamp;
+        }
+        while (_frames.size() >= 2 && timestamp >= _frames[1].pts) {
+            _frames.pop_front();
+            didConsume = true;
+        }
+        if (!_frames.empty()) {
+            result = _frames.front();
+        }
+    }
+
+    if (didConsume) {
+        if (const auto owner = _owner.lock()) {
+            owner->schedulePump();
+        }
+    }
+    return result;
+}
+
+absl::optional<std::string> DecodedVideoPart::getActiveEndpointId() const {
+    webrtc::MutexLock lock(&_mutex);
+    if (!_activeEndpointId && hasQueuedFrames()) {
+        // The decoder is done, playback isn't
+        return _lastActiveEndpointId;
+    }
+    return _activeEndpointId;
+}
+
+bool DecodedVideoPart::hasRemainingFrames() const {
+    webrtc::MutexLock lock(&_mutex);
+    return !_isFinished || hasQueuedFrames();
+}
+
+bool DecodedVideoPart::hasQueuedFrames() const {
+    // The first frame is the one being shown
+    return _frames.size() > 1;
+}
+
+void DecodedVideoPart::setIsDemanded(bool isDemanded) {
+    {
+        webrtc::MutexLock lock(&_mutex);
+        if (_isDemanded == isDemanded) {
+            return;
+        }
+        _isDemanded = isDemanded;
+        if (!isDemanded) {
+            _frames.clear();
+        }
+    }
+
+    if (const auto owner = _owner.lock()) {
+        owner->schedulePump();
+    }
+}
+
+DecodedAudioPart::DecodedAudioPart(std::weak_ptr<StreamingDecodeAhead> owner, std::shared_ptr<AudioStreamingPart> part, std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> &&chunks) :
+_owner(owner),
+_part(part),
+_chunks(std::move(chunks)) {
+    webrtc::MutexLock lock(&_mutex);
+    _undecodedMilliseconds = _part->getRemainingMilliseconds();
+}
+
+DecodedAudioPart::DecodedAudioPart(std::weak_ptr<StreamingDecodeAhead> owner, std::shared_ptr<VideoStreamingPart> unifiedPart, std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> &&chunks) :
+_owner(owner),
+_unifiedPart(unifiedPart),
+_chunks(std::move(chunks)) {
+    webrtc::MutexLock lock(&_mutex);
+    _undecodedMilliseconds = _unifiedPart->getAudioRemainingMilliseconds();
+}
+
+DecodedAudioPart::~DecodedAudioPart() {
+    if (const auto owner = _owner.lock()) {
+        owner->recycleAudioChunks(std::move(_chunks));
+        owner->schedulePump();
+    }
+}
+
+bool DecodedAudioPart::get10msPerChannel(std::vector<AudioStreamingPart::StreamingPartChannel> &channels) {
+    bool needsMore = false;
+    {
+        webrtc::MutexLock lock(&_mutex);
+        if (_chunkCount == 0) {
+            if (!_isFinished) {
+                _underrunCount++;
+            }
+            return false;
+        }
+        // The previous buffers of |channels| take the place of the chunk
+        std::swap(channels, _chunks[_firstChunk]);
+        _firstChunk = (_firstChunk + 1) % _chunks.size();
+        _chunkCount--;
+        // Wake the decode thread once the queue is half empty rather than every 10 ms
+        needsMore = !_isFinished && _chunkCount * 2 < _chunks.size();
+    }
+
+    if (needsMore) {
+        if (const auto owner = _owner.lock()) {
+            owner->schedulePump();
+        }
+    }
+    return true;
+}
+
+int DecodedAudioPart::getRemainingMilliseconds() const {
+    webrtc::MutexLock lock(&_mutex);
+    return (int)_chunkCount * 10 + _undecodedMilliseconds;
+}
+
+bool DecodedAudioPart::hasRemainingFrames() const {
+    webrtc::MutexLock lock(&_mutex);
+    return !_isFinished || _chunkCount != 0;
+}
+
+int DecodedAudioPart::getUnderrunCount() const {
+    webrtc::MutexLock lock(&_mutex);
+    return _underrunCount;
+}
+
+StreamingDecodeAhead::StreamingDecodeAhead(Configuration configuration) :
+_configuration(configuration) {
+}
+
+StreamingDecodeAhead::~StreamingDecodeAhead() {
+}
+
+std::shared_ptr<DecodedVideoPart> StreamingDecodeAhead::addVideoPart(int64_t order, std::shared_ptr<VideoStreamingPart> part, bool isUnified) {
+    const auto weak = std::weak_ptr<StreamingDecodeAhead>(shared_from_this());
+    auto result = std::shared_ptr<DecodedVideoPart>(new DecodedVideoPart(weak, part, isUnified));
+
+    Job job;
+    job.order = order;
+    job.video = result;
+    addJob(std::move(job));
+
+    return result;
+}
+
+std::shared_ptr<DecodedAudioPart> StreamingDecodeAhead::addAudioPart(int64_t order, std::shared_ptr<AudioStreamingPart> part) {
+    const auto weak = std::weak_ptr<StreamingDecodeAhead>(shared_from_this());
+    auto result = std::shared_ptr<DecodedAudioPart>(new DecodedAudioPart(weak, part, takeAudioChunks()));
+
+    Job job;
+    job.order = order;
+    job.audio = result;
+    addJob(std::move(job));
+
+    return result;
+}
+
+std::shared_ptr<DecodedAudioPart> StreamingDecodeAhead::addUnifiedAudioPart(int64_t order, std::shared_ptr<VideoStreamingPart> part) {
+    const auto weak = std::weak_ptr<StreamingDecodeAhead>(shared_from_this());
+    auto result = std::shared_ptr<DecodedAudioPart>(new DecodedAudioPart(weak, part, takeAudioChunks()));
+
+    Job job;
+    job.order = order;
+    job.audio = result;
+    addJob(std::move(job));
+
+    return result;
+}
+
+std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> StreamingDecodeAhead::takeAudioChunks() {
+    {
+        webrtc::MutexLock lock(&_audioChunksMutex);
+        if (!_recycledAudioChunks.empty()) {
+            auto result = std::move(_recycledAudioChunks.back());
+            _recycledAudioChunks.pop_back();
+            return result;
+        }
+    }
+    // One slot more than may be queued, for the chunk being decoded
+    return std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>>(_configuration.maxQueuedAudioMilliseconds / 10 + 1);
+}
+
+void StreamingDecodeAhead::recycleAudioChunks(std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> &&chunks) {
+    webrtc::MutexLock lock(&_audioChunksMutex);
+    _recycledAudioChunks.push_back(std::move(chunks));
+}
+
+void StreamingDecodeAhead::addJob(Job &&job) {
+    const auto weak = std::weak_ptr<StreamingDecodeAhead>(shared_from_this());
+    decodeThread()->PostTask([weak, job = std::move(job)]() mutable {
+        auto strong = weak.lock();
+        if (!strong) {
+            return;
+        }
+
+        // A part replacing an earlier one of its segment goes before later segments
+        const auto position = std::upper_bound(strong->_jobs.begin(), strong->_jobs.end(), job.order, [](int64_t order, Job const &other) {
+            return order < other.order;
+        });
+        strong->_jobs.insert(position, std::move(job));
+
+        strong->pump();
+    });
+}
+
+void StreamingDecodeAhead::schedulePump() {
+    if (_isPumpScheduled.exchange(true)) {
+        return;
+    }
+
+    const auto weak = std::weak_ptr<StreamingDecodeAhead>(shared_from_this());
+    decodeThread()->PostTask([weak]() {
+        auto strong = weak.lock();
+        if (!strong) {
+            return;
+        }
+
+        strong->_isPumpScheduled = false;
+        strong->pump();
+    });
+}
+
+void StreamingDecodeAhead::pump() {
+    std::set<std::string> busyDecoders;
+
+    bool didDecode = true;
+    while (didDecode) {
+        didDecode = false;
+        busyDecoders.clear();
+
+        for (size_t i = 0; i < _jobs.size(); i++) {
+            const auto video = _jobs[i].video.lock();
+            const auto audio = _jobs[i].audio.lock();
+
+            absl::optional<std::string> decoderKey;
+            bool hasRoom = false;
+            bool hasMore = false;
+            if (video) {
+                hasMore = hasMoreToDecode(*video, decoderKey, hasRoom);
+            } else if (audio) {
+                hasMore = hasMoreToDecode(*audio, decoderKey, hasRoom);
+            }
+            if (!hasMore) {
+                // Finished, or the media thread dropped the part
+                _jobs.erase(_jobs.begin() + i);
+                i--;
+                continue;
+            }
+
+            // An earlier part still owns the decoder
+            const bool isBlocked = decoderKey && busyDecoders.find(decoderKey.value()) != busyDecoders.end();
+            if (!isBlocked && hasRoom) {
+                // One step per part and round, so that all parts fill evenly
+                if (video) {
+                    decodeNext(*video);
+                } else {
+                    decodeNext(*audio);
+                }
+                didDecode = true;
+            }
+            if (decoderKey) {
+                busyDecoders.insert(decoderKey.value());
+            }
+        }
+    }
+}
+
+bool StreamingDecodeAhead::hasMoreToDecode(DecodedVideoPart &part, absl::optional<std::string> &decoderKey, bool &hasRoom) {
+    {
+        webrtc::MutexLock lock(&part._mutex);
+        if (part._isFinished) {
+            return false;
+        }
+        if (part._isDemanded) {
+            hasRoom = (int)part._frames.size() < _configuration.maxQueuedVideoFrames;
+        } else {
+            hasRoom = part._playbackTimestamp > part._skippedTimestamp;
+        }
+    }
+
+    if (part._isUnified) {
+        decoderKey = "unified";
+    } else if (const auto endpointId = part._part->getActiveEndpointId()) {
+        decoderKey = "video/" + endpointId.value();
+    }
+    return true;
+}
+
+bool StreamingDecodeAhead::hasMoreToDecode(DecodedAudioPart &part, absl::optional<std::string> &decoderKey, bool &hasRoom) {
+    {
+        webrtc::MutexLock lock(&part._mutex);
+        if (part._isFinished) {
+            return false;
+        }
+        hasRoom = (int)part._chunkCount * 10 < _configuration.maxQueuedAudioMilliseconds;
+    }
+
+    decoderKey = part._unifiedPart ? "unifiedAudio" : "audio";
+    return true;
+}
+
+void StreamingDecodeAhead::decodeNext(DecodedVideoPart &part) {
+    bool isDemanded = true;
+    {
+        webrtc::MutexLock lock(&part._mutex);
+        isDemanded = part._isDemanded;
+    }
+
+    absl::optional<std::string> endpointId;
+    if (part._isUnified) {
+        endpointId = "unified";
+    } else {
+        endpointId = part._part->getActiveEndpointId();
+    }
+
+    std::shared_ptr<VideoStreamingSharedState> sharedState;
+    if (endpointId) {
+        auto it = _sharedVideoStateByEndpointId.find(endpointId.value());
+        if (it != _sharedVideoStateByEndpointId.end()) {
+            sharedState = it->second;
+        } else {
+            sharedState = std::make_shared<VideoStreamingSharedState>();
+            _sharedVideoStateByEndpointId.insert(std::make_pair(endpointId.value(), sharedState));
+        }
+    }
+
+    if (!isDemanded) {
+        const auto skippedTimestamp = part._part->skipNextPacket(sharedState.get());
+        const auto activeEndpointId = part._part->getActiveEndpointId();
+
+        webrtc::MutexLock lock(&part._mutex);
+        if (skippedTimestamp) {
+            part._skippedTimestamp = skippedTimestamp.value();
+        } else {
+            part._isFinished = true;
+        }
+        part._activeEndpointId = activeEndpointId;
+        return;
+    }
+
+    auto frame = part._part->getNextFrame(sharedState.get());
+    const auto activeEndpointId = part._part->getActiveEndpointId();
+
+    webrtc::MutexLock lock(&part._mutex);
+    if (frame) {
+        part._frames.push_back(std::move(frame.value()));
+    } else {
+        part._isFinished = true;
+    }
+    part._activeEndpointId = activeEndpointId;
+    if (activeEndpointId) {
+        part._lastActiveEndpointId = activeEndpointId;
+    }
+}
+
+void StreamingDecodeAhead::decodeNext(DecodedAudioPart &part) {
+    size_t slot = 0;
+    {
+        webrtc::MutexLock lock(&part._mutex);
+        slot = (part._firstChunk + part._chunkCount) % part._chunks.size();
+    }
+    auto &chunk = part._chunks[slot];
+
+    bool didDecode = false;
+    int undecodedMilliseconds = 0;
+    if (part._unifiedPart) {
+        didDecode = part._unifiedPart->getAudio10msPerChannel(_unifiedAudioDecoder, chunk);
+        undecodedMilliseconds = part._unifiedPart->getAudioRemainingMilliseconds();
+    } else {
+        didDecode = part._part->get10msPerChannel(_audioDecoder, chunk);
+        undecodedMilliseconds = part._part->getRemainingMilliseconds();
+    }
+
+    webrtc::MutexLock lock(&part._mutex);
+    if (!didDecode) {
+        part._isFinished = true;
+        part._undecodedMilliseconds = 0;
+    } else {
+        part._chunkCount++;
+        part._undecodedMilliseconds = undecodedMilliseconds;
+    }
+}
+
+}
@@ -0,0 +1,166 @@
+#ifndef TGCALLS_STREAMING_DECODE_AHEAD_H
+#define TGCALLS_STREAMING_DECODE_AHEAD_H
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "rtc_base/synchronization/mutex.h"
+
+#include "AudioStreamingPart.h"
+#include "VideoStreamingPart.h"
+
+namespace tgcalls {
+
+class StreamingDecodeAhead;
+
+// Video frames of one broadcast part, decoded ahead of playback. Read on the
+// media thread.
+class DecodedVideoPart {
+public:
+    ~DecodedVideoPart();
+
+    // The frame to show at |timestamp| among the frames decoded so far, the
+    // frames it replaces are dropped.
+    absl::optional<VideoStreamingPartFrame> getFrameAtRelativeTimestamp(double timestamp);
+    // Both follow playback: they hold while decoded frames after the one
+    // shown are still queued, even though the decoder reached the end.
+    absl::optional<std::string> getActiveEndpointId() const;
+    bool hasRemainingFrames() const;
+    // While nobody shows the frames, packets are dropped undecoded as playback
+    // passes them, and decoding resumes at a keyframe once demanded again.
+    void setIsDemanded(bool isDemanded);
+
+private:
+    friend class StreamingDecodeAhead;
+
+    DecodedVideoPart(std::weak_ptr<StreamingDecodeAhead> owner, std::shared_ptr<VideoStreamingPart> part, bool isUnified);
+
+    // Called with _mutex held.
+    bool hasQueuedFrames() const;
+
+    const std::weak_ptr<StreamingDecodeAhead> _owner;
+    const bool _isUnified = false;
+    // Decode thread only, once added.
+    const std::shared_ptr<VideoStreamingPart> _part;
+
+    mutable webrtc::Mutex _mutex;
+    std::deque<VideoStreamingPartFrame> _frames RTC_GUARDED_BY(_mutex);
+    // Of the decoder, and the last one it had, for the frames still queued.
+    absl::optional<std::string> _activeEndpointId RTC_GUARDED_BY(_mutex);
+    absl::optional<std::string> _lastActiveEndpointId RTC_GUARDED_BY(_mutex);
+    bool _isFinished RTC_GUARDED_BY(_mutex) = false;
+    bool _isDemanded RTC_GUARDED_BY(_mutex) = true;
+    // Last timestamp asked for, and of the last packet skipped.
+    double _playbackTimestamp RTC_GUARDED_BY(_mutex) = -1.0;
+    double _skippedTimestamp RTC_GUARDED_BY(_mutex) = -1.0;
+};
+
+// 10 ms chunks of PCM of one broadcast part, decoded ahead of playback. Read
+// on the media thread.
+class DecodedAudioPart {
+public:
+    ~DecodedAudioPart();
+
+    // Swaps the next 10 ms into |channels|, whose buffers are reused for later
+    // chunks. Returns false if nothing is decoded yet or the part ended.
+    bool get10msPerChannel(std::vector<AudioStreamingPart::StreamingPartChannel> &channels);
+    int getRemainingMilliseconds() const;
+    bool hasRemainingFrames() const;
+    // Times get10msPerChannel() found nothing decoded before the part ended.
+    int getUnderrunCount() const;
+
+private:
+    friend class StreamingDecodeAhead;
+
+    DecodedAudioPart(std::weak_ptr<StreamingDecodeAhead> owner, std::shared_ptr<AudioStreamingPart> part, std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> &&chunks);
+    DecodedAudioPart(std::weak_ptr<StreamingDecodeAhead> owner, std::shared_ptr<VideoStreamingPart> unifiedPart, std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> &&chunks);
+
+    const std::weak_ptr<StreamingDecodeAhead> _owner;
+    // Decode thread only, once added.
+    const std::shared_ptr<AudioStreamingPart> _part;
+    const std::shared_ptr<VideoStreamingPart> _unifiedPart;
+    // Ring of decoded chunks, its size is fixed. Slots outside of the queued
+    // range belong to the decode thread.
+    std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> _chunks;
+
+    mutable webrtc::Mutex _mutex;
+    size_t _firstChunk RTC_GUARDED_BY(_mutex) = 0;
+    size_t _chunkCount RTC_GUARDED_BY(_mutex) = 0;
+    int _undecodedMilliseconds RTC_GUARDED_BY(_mutex) = 0;
+    bool _isFinished RTC_GUARDED_BY(_mutex) = false;
+    int _underrunCount RTC_GUARDED_BY(_mutex) = 0;
+};
+
+// Demuxes and decodes broadcast parts on a dedicated thread, so that rendering
+// on the media thread only picks what's ready. Parts are decoded in the order
+// of their segments, as far ahead as their bounded queues allow. Parts that
+// share a decoder, the video of one endpoint or the audio of either kind of
+// broadcast, are decoded one after another. Decoders outlive the parts, so
+// consecutive segments continue with the same decoder state.
+class StreamingDecodeAhead : public std::enable_shared_from_this<StreamingDecodeAhead> {
+public:
+    struct Configuration {
+        int maxQueuedVideoFrames = 6;
+        int maxQueuedAudioMilliseconds = 500;
+    };
+
+public:
+    explicit StreamingDecodeAhead(Configuration configuration);
+    ~StreamingDecodeAhead();
+
+    // Called on the media thread. Decoding starts right away, |order| is the
+    // timestamp of the segment the part belongs to.
+    std::shared_ptr<DecodedVideoPart> addVideoPart(int64_t order, std::shared_ptr<VideoStreamingPart> part, bool isUnified);
+    std::shared_ptr<DecodedAudioPart> addAudioPart(int64_t order, std::shared_ptr<AudioStreamingPart> part);
+    // |part| may be added with addVideoPart too, once this returned.
+    std::shared_ptr<DecodedAudioPart> addUnifiedAudioPart(int64_t order, std::shared_ptr<VideoStreamingPart> part);
+
+private:
+    friend class DecodedVideoPart;
+    friend class DecodedAudioPart;
+
+    struct Job {
+        int64_t order = 0;
+        std::weak_ptr<DecodedVideoPart> video;
+        std::weak_ptr<DecodedAudioPart> audio;
+    };
+
+    void addJob(Job &&job);
+    void schedulePump();
+    std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> takeAudioChunks();
+    void recycleAudioChunks(std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>> &&chunks);
+
+    // Decode thread only.
+    void pump();
+    // Returns whether the part has more to decode. |decoderKey| is set to the
+    // shared decoder the part continues with, |hasRoom| to whether its queue
+    // takes more.
+    bool hasMoreToDecode(DecodedVideoPart &part, absl::optional<std::string> &decoderKey, bool &hasRoom);
+    bool hasMoreToDecode(DecodedAudioPart &part, absl::optional<std::string> &decoderKey, bool &hasRoom);
+    void decodeNext(DecodedVideoPart &part);
+    void decodeNext(DecodedAudioPart &part);
+
+private:
+    const Configuration _configuration;
+    std::atomic<bool> _isPumpScheduled{false};
+
+    // Chunk rings of finished audio parts with their buffers, for new parts.
+    webrtc::Mutex _audioChunksMutex;
+    std::vector<std::vector<std::vector<AudioStreamingPart::StreamingPartChannel>>> _recycledAudioChunks RTC_GUARDED_BY(_audioChunksMutex);
+
+    // Decode thread only.
+    std::vector<Job> _jobs;
+    std::map<std::string, std::shared_ptr<VideoStreamingSharedState>> _sharedVideoStateByEndpointId;
+    AudioStreamingPartPersistentDecoder _audioDecoder;
+    AudioStreamingPartPersistentDecoder _unifiedAudioDecoder;
+};
+
+}
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "AudioStreamingPart.h"
 #include "VideoStreamingPart.h"
+#include "StreamingDecodeAhead.h"
+#include "utils/AudioKernels.h"
 
 #include "absl/types/optional.h"
 #include "rtc_base/thread.h"
@@ -16,6 +18,9 @@
 #include "api/video/video_sink_interface.h"
 #include "audio/utility/audio_frame_operations.h"
 
+#include <algorithm>
+#include <thread>
+
 namespace tgcalls {
 
 namespace {
@@ -60,7 +65,7 @@ struct PendingMediaSegment {
 
 struct VideoSegment {
     VideoChannelDescription::Quality quality;
-    std::shared_ptr<VideoStreamingPart> part;
+    std::shared_ptr<DecodedVideoPart> part;
     double lastFramePts = -1.0;
     int _displayedFrames = 0;
     bool isPlaying = false;
@@ -68,7 +73,7 @@ struct VideoSegment {
 };
 
 struct UnifiedSegment {
-    std::shared_ptr<VideoStreamingPart> videoPart;
+    std::shared_ptr<DecodedVideoPart> videoPart;
     double lastFramePts = -1.0;
     int _displayedFrames = 0;
     bool isPlaying = false;
@@ -77,13 +82,32 @@ struct UnifiedSegment {
 struct MediaSegment {
     int64_t timestamp = 0;
     int64_t duration = 0;
-    std::shared_ptr<AudioStreamingPart> audio;
-    AudioStreamingPartPersistentDecoder audioDecoder;
-    std::shared_ptr<VideoStreamingPart> unifiedAudio;
+    std::shared_ptr<DecodedAudioPart> audio;
+    std::shared_ptr<DecodedAudioPart> unifiedAudio;
     std::vector<std::shared_ptr<VideoSegment>> video;
     std::vector<std::shared_ptr<UnifiedSegment>> unified;
 };
 
+VideoStreamingDecodePolicy decodePolicyForQuality(VideoChannelDescription::Quality quality) {
+    VideoStreamingDecodePolicy result;
+    switch (quality) {
+        case VideoChannelDescription::Quality::Thumbnail: {
+            // A still per part is enough for a tile
+            result.keyframesOnly = true;
+            break;
+        }
+        case VideoChannelDescription::Quality::Medium: {
+            result.skipNonReferenceLoopFilter = true;
+            break;
+        }
+        case VideoChannelDescription::Quality::Full: {
+            result.threadCount = std::max(1, std::min(4, (int)std::thread::hardware_concurrency()));
+            break;
+        }
+    }
+    return result;
+}
+
 class SampleRingBuffer {
 public:
     SampleRingBuffer(size_t size) {
@@ -244,6 +268,7 @@ public:
     _requestAudioBroadcastPart(arguments.requestAudioBroadcastPart),
     _requestVideoBroadcastPart(arguments.requestVideoBroadcastPart),
     _updateAudioLevel(arguments.updateAudioLevel),
+    _decodeAhead(std::make_shared<StreamingDecodeAhead>(StreamingDecodeAhead::Configuration())),
     _audioRingBuffer(_audioDataRingBufferMaxSize),
     _audioFrameCombiner(false) {
     }
@@ -271,6 +296,13 @@ public:
 
     void render() {
         int64_t absoluteTimestamp = rtc::TimeMillis();
+        const int64_t renderStartTimestampUs = rtc::TimeMicros();
+        if (_lastRenderTimestamp != 0) {
+            _maxRenderIntervalMs = std::max(_maxRenderIntervalMs, absoluteTimestamp - _lastRenderTimestamp);
+        }
+        _lastRenderTimestamp = absoluteTimestamp;
+
+        updateVideoDemand();
 
         while (true) {
             if (_waitForBufferredMillisecondsBeforeRendering) {
@@ -301,20 +333,8 @@ public:
             for (auto &videoSegment : segment->video) {
                 videoSegment->isPlaying = true;
                 cancelPendingVideoQualityUpdate(videoSegment);
-                
-                std::shared_ptr<VideoStreamingSharedState> sharedVideoState;
-                auto endpointId = videoSegment->part->getActiveEndpointId();
-                if (endpointId.has_value()) {
-                    auto it = _sharedVideoStateByEndpointId.find(endpointId.value());
-                    if (it != _sharedVideoStateByEndpointId.end()) {
-                        sharedVideoState = it->second;
-                    } else {
-                        sharedVideoState = std::make_shared<VideoStreamingSharedState>();
-                        _sharedVideoStateByEndpointId.insert(std::make_pair(endpointId.value(), sharedVideoState));
-                    }
-                }
-                
-                auto frame = videoSegment->part->getFrameAtRelativeTimestamp(sharedVideoState.get(), relativeTimestamp);
+
+                auto frame = videoSegment->part->getFrameAtRelativeTimestamp(relativeTimestamp);
                 if (frame) {
                     if (videoSegment->lastFramePts != frame->pts) {
                         videoSegment->lastFramePts = frame->pts;
@@ -335,20 +355,8 @@ public:
 
             for (auto &videoSegment : segment->unified) {
                 videoSegment->isPlaying = true;
-                
-                absl::optional<std::string> endpointId = "unified";
-                std::shared_ptr<VideoStreamingSharedState> sharedVideoState;
-                if (endpointId.has_value()) {
-                    auto it = _sharedVideoStateByEndpointId.find(endpointId.value());
-                    if (it != _sharedVideoStateByEndpointId.end()) {
-                        sharedVideoState = it->second;
-                    } else {
-                        sharedVideoState = std::make_shared<VideoStreamingSharedState>();
-                        _sharedVideoStateByEndpointId.insert(std::make_pair(endpointId.value(), sharedVideoState));
-                    }
-                }
 
-                auto frame = videoSegment->videoPart->getFrameAtRelativeTimestamp(sharedVideoState.get(), relativeTimestamp);
+                auto frame = videoSegment->videoPart->getFrameAtRelativeTimestamp(relativeTimestamp);
                 if (frame) {
                     if (videoSegment->lastFramePts != frame->pts) {
                         videoSegment->lastFramePts = frame->pts;
@@ -376,36 +384,45 @@ public:
                     return result;
                 };
                 while (available()) {
-                    auto audioChannels = segment->audio->get10msPerChannel(segment->audioDecoder);
-                    if (audioChannels.empty()) {
+                    if (!segment->audio->get10msPerChannel(_audioChannels)) {
                         break;
                     }
 
-                    std::vector<webrtc::AudioFrame *> audioFrames;
+                    _audioFramesToMix.clear();
 
-                    for (const auto &audioChannel : audioChannels) {
-                        webrtc::AudioFrame *frame = new webrtc::AudioFrame();
-                        frame->UpdateFrame(0, audioChannel.pcmData.data(), audioChannel.pcmData.size(), 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive);
+                    for (const auto &audioChannel : _audioChannels) {
+                        if (audioChannel.numSamples == 0) {
+                            // Not heard in these 10 ms, only its level goes down
+                            processAudioLevel(audioChannel.ssrc, _silentAudio);
+                            continue;
+                        }
 
+                        double outputGain = 1.0;
                         auto volumeIt = _volumeBySsrc.find(audioChannel.ssrc);
                         if (volumeIt != _volumeBySsrc.end()) {
-                            double outputGain = volumeIt->second;
-                            if (outputGain < 0.99f || outputGain > 1.01f) {
-                                webrtc::AudioFrameOperations::ScaleWithSat(outputGain, frame);
-                            }
+                            outputGain = volumeIt->second;
                         }
-
-                        audioFrames.push_back(frame);
                         processAudioLevel(audioChannel.ssrc, audioChannel.pcmData);
-                    }
+                        if (outputGain <= 0.0) {
+                            continue;
+                        }
+
+                        if (_audioFramePool.size() <= _audioFramesToMix.size()) {
+                            _audioFramePool.push_back(std::make_unique<webrtc::AudioFrame>());
+                        }
+                        webrtc::AudioFrame *frame = _audioFramePool[_audioFramesToMix.size()].get();
+                        frame->UpdateFrame(0, audioChannel.pcmData.data(), audioChannel.pcmData.size(), 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive);
 
-                    webrtc::AudioFrame frameOut;
-                    _audioFrameCombiner.Combine(audioFrames, 1, 48000, audioFrames.size(), &frameOut);
+                        if (outputGain < 0.99f || outputGain > 1.01f) {
+                            webrtc::AudioFrameOperations::ScaleWithSat(outputGain, frame);
+                        }
 
-                    for (webrtc::AudioFrame *frame : audioFrames) {
-                        delete frame;
+                        _audioFramesToMix.push_back(frame);
                     }
 
+                    webrtc::AudioFrame &frameOut = _mixedAudioFrame;
+                    _audioFrameCombiner.Combine(_audioFramesToMix, 1, 48000, _audioFramesToMix.size(), &frameOut);
+
                     _audioDataMutex.Lock();
                     if (frameOut.num_channels() == _audioRingBufferNumChannels) {
                         _audioRingBuffer.write(frameOut.data(), frameOut.samples_per_channel() * frameOut.num_channels());
@@ -413,11 +430,7 @@ public:
                         if (_stereoShuffleBuffer.size() < frameOut.samples_per_channel() * _audioRingBufferNumChannels) {
                             _stereoShuffleBuffer.resize(frameOut.samples_per_channel() * _audioRingBufferNumChannels);
                         }
-                        for (int i = 0; i < frameOut.samples_per_channel(); i++) {
-                            for (int j = 0; j < _audioRingBufferNumChannels; j++) {
-                                _stereoShuffleBuffer[i * _audioRingBufferNumChannels + j] = frameOut.data()[i];
-                            }
-                        }
+                        duplicateChannelsInt16(frameOut.data(), frameOut.samples_per_channel(), _audioRingBufferNumChannels, _stereoShuffleBuffer.data());
                         _audioRingBuffer.write(_stereoShuffleBuffer.data(), frameOut.samples_per_channel() * _audioRingBufferNumChannels);
                     }
                     _audioDataMutex.Unlock();
@@ -431,10 +444,10 @@ public:
                     return result;
                 };
                 while (available()) {
-                    auto audioChannels = segment->unifiedAudio->getAudio10msPerChannel(_persistentAudioDecoder);
-                    if (audioChannels.empty()) {
+                    if (!segment->unifiedAudio->get10msPerChannel(_audioChannels)) {
                         break;
                     }
+                    const auto &audioChannels = _audioChannels;
                     
                     if (audioChannels[0].numSamples < 480) {
                         RTC_LOG(LS_INFO) << "render: got less than 10ms of audio data (" << audioChannels[0].numSamples << " samples)";
@@ -442,7 +455,7 @@ public:
                     
                     int numChannels = std::min(2, (int)audioChannels.size());
 
-                    webrtc::AudioFrame frameOut;
+                    webrtc::AudioFrame &frameOut = _mixedAudioFrame;
                     
                     if (numChannels == 1) {
                         frameOut.UpdateFrame(0, audioChannels[0].pcmData.data(), audioChannels[0].pcmData.size(), 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive, numChannels);
@@ -461,11 +474,8 @@ public:
                         if (_stereoShuffleBuffer.size() < numChannels * numSamples) {
                             _stereoShuffleBuffer.resize(numChannels * numSamples);
                         }
-                        for (int i = 0; i < numSamples; i++) {
-                            for (int j = 0; j < numChannels; j++) {
-                                _stereoShuffleBuffer[i * numChannels + j] = audioChannels[j].pcmData[i];
-                            }
-                        }
+                        const int16_t *channelData[2] = { audioChannels[0].pcmData.data(), audioChannels[1].pcmData.data() };
+                        interleaveInt16(channelData, numChannels, numSamples, _stereoShuffleBuffer.data());
                         frameOut.UpdateFrame(0, _stereoShuffleBuffer.data(), numSamples, 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive, numChannels);
                     } else {
                         bool skipFrame = false;
@@ -482,11 +492,7 @@ public:
                         if (_stereoShuffleBuffer.size() < numChannels * numSamples) {
                             _stereoShuffleBuffer.resize(numChannels * numSamples);
                         }
-                        for (int i = 0; i < numSamples; i++) {
-                            for (int j = 0; j < numChannels; j++) {
-                                _stereoShuffleBuffer[i * numChannels + j] = audioChannels[0].pcmData[i];
-                            }
-                        }
+                        duplicateChannelsInt16(audioChannels[0].pcmData.data(), numSamples, numChannels, _stereoShuffleBuffer.data());
                         frameOut.UpdateFrame(0, _stereoShuffleBuffer.data(), numSamples, 48000, webrtc::AudioFrame::SpeechType::kNormalSpeech, webrtc::AudioFrame::VADActivity::kVadActive, numChannels);
                     }
 
@@ -505,11 +511,7 @@ public:
                         if (_stereoShuffleBuffer.size() < frameOut.samples_per_channel() * _audioRingBufferNumChannels) {
                             _stereoShuffleBuffer.resize(frameOut.samples_per_channel() * _audioRingBufferNumChannels);
                         }
-                        for (int i = 0; i < frameOut.samples_per_channel(); i++) {
-                            for (int j = 0; j < _audioRingBufferNumChannels; j++) {
-                                _stereoShuffleBuffer[i * _audioRingBufferNumChannels + j] = frameOut.data()[i];
-                            }
-                        }
+                        duplicateChannelsInt16(frameOut.data(), frameOut.samples_per_channel(), _audioRingBufferNumChannels, _stereoShuffleBuffer.data());
                         _audioRingBuffer.write(_stereoShuffleBuffer.data(), frameOut.samples_per_channel() * _audioRingBufferNumChannels);
                     }
                     _audioDataMutex.Unlock();
@@ -531,6 +533,7 @@ public:
                     RTC_LOG(LS_INFO) << "render: discarding video frames at the end of a segment (displayed " << segment->unified[0]->_displayedFrames << " frames)";
                 }
 
+                logSegmentRenderStats(*segment);
                 _availableSegments.erase(_availableSegments.begin());
             } else if (
                 _availableSegments.size() > 1 &&
@@ -542,6 +545,7 @@ public:
                 _playbackReferenceTimestamp += segment->duration;
                 _waitForBufferredMillisecondsBeforeRendering = absl::nullopt;
 
+                logSegmentRenderStats(*segment);
                 _availableSegments.erase(_availableSegments.begin());
             }
 
@@ -550,6 +554,22 @@ public:
 
         requestSegmentsIfNeeded();
         checkPendingSegments();
+
+        _maxRenderDurationUs = std::max(_maxRenderDurationUs, rtc::TimeMicros() - renderStartTimestampUs);
+    }
+
+    void logSegmentRenderStats(MediaSegment const &segment) {
+        int audioUnderruns = 0;
+        if (segment.audio) {
+            audioUnderruns += segment.audio->getUnderrunCount();
+        }
+        if (segment.unifiedAudio) {
+            audioUnderruns += segment.unifiedAudio->getUnderrunCount();
+        }
+        RTC_LOG(LS_VERBOSE) << "render: segment " << segment.timestamp << " done, max render interval " << _maxRenderIntervalMs << " ms, max render duration " << _maxRenderDurationUs << " us, audio underruns " << audioUnderruns;
+
+        _maxRenderIntervalMs = 0;
+        _maxRenderDurationUs = 0;
     }
 
     void processAudioLevel(uint32_t ssrc, std::vector<int16_t> const &samples) {
@@ -557,18 +577,20 @@ public:
             return;
         }
 
-        webrtc::AudioBuffer buffer(48000, 1, 48000, 1, 48000, 1);
+        if (!_audioLevelBuffer) {
+            _audioLevelBuffer = std::make_unique<webrtc::AudioBuffer>(48000, 1, 48000, 1, 48000, 1);
+        }
         webrtc::StreamConfig config(48000, 1);
-        buffer.CopyFrom(samples.data(), config);
+        _audioLevelBuffer->CopyFrom(samples.data(), config);
 
         std::pair<float, bool> vadResult = std::make_pair(0.0f, false);
         auto vad = _audioVadMap.find(ssrc);
         if (vad == _audioVadMap.end()) {
             auto newVad = std::make_unique<SparseVad>();
-            vadResult = newVad->update(&buffer);
+            vadResult = newVad->update(_audioLevelBuffer.get());
             _audioVadMap.insert(std::make_pair(ssrc, std::move(newVad)));
         } else {
-            vadResult = vad->second->update(&buffer);
+            vadResult = vad->second->update(_audioLevelBuffer.get());
         }
 
         _updateAudioLevel(ssrc, vadResult.first, vadResult.second);
@@ -590,7 +612,9 @@ public:
         size_t readSamples = _audioRingBuffer.read(buffer, num_samples * _audioRingBufferNumChannels);
         _audioDataMutex.Unlock();
 
-        if (num_channels != _audioRingBufferNumChannels) {
+        if (num_channels == 1) {
+            deinterleaveChannelInt16(_tempAudioBuffer.data(), _audioRingBufferNumChannels, 0, readSamples / _audioRingBufferNumChannels, audio_samples);
+        } else if (num_channels != _audioRingBufferNumChannels) {
             for (size_t sampleIndex = 0; sampleIndex < readSamples / _audioRingBufferNumChannels; sampleIndex++) {
                 for (size_t channelIndex = 0; channelIndex < num_channels; channelIndex++) {
                     audio_samples[sampleIndex * num_channels + channelIndex] = _tempAudioBuffer[sampleIndex * _audioRingBufferNumChannels + 0];
@@ -700,6 +724,9 @@ public:
                 if (channelIdIt == _currentEndpointMapping.end()) {
                     continue;
                 }
+                if (!hasLiveVideoSink(videoChannel.endpoint)) {
+                    continue;
+                }
 
                 int32_t channelId = channelIdIt->second + 1;
 
@@ -759,7 +786,7 @@ public:
 
             const auto weak = std::weak_ptr<StreamingMediaContextPrivate>(shared_from_this());
             const auto weakSegment = std::weak_ptr<VideoSegment>(segment);
-            beginPartTask(video, timestamp, [weak, weakSegment]() {
+            beginPartTask(video, timestamp, [weak, weakSegment, timestamp]() {
                 auto strong = weak.lock();
                 if (!strong) {
                     return;
@@ -776,7 +803,12 @@ public:
 
                 auto result = strongSegment->pendingVideoQualityUpdatePart->result;
                 if (result) {
-                    strongSegment->part = std::make_shared<VideoStreamingPart>(std::move(result->data), VideoStreamingPart::ContentType::Video);
+                    VideoStreamingDecodePolicy decodePolicy;
+                    if (const auto videoData = absl::get_if<PendingVideoSegmentData>(&strongSegment->pendingVideoQualityUpdatePart->typeData)) {
+                        decodePolicy = decodePolicyForQuality(videoData->quality);
+                    }
+                    auto part = std::make_shared<VideoStreamingPart>(std::move(result->data), VideoStreamingPart::ContentType::Video, decodePolicy);
+                    strongSegment->part = strong->_decodeAhead->addVideoPart(timestamp, std::move(part), false);
                 }
 
                 strongSegment->pendingVideoQualityUpdatePart.reset();
@@ -911,25 +943,29 @@ public:
                 for (auto &part : pendingSegment->parts) {
                     const auto typeData = &part->typeData;
                     if (absl::get_if<PendingAudioSegmentData>(typeData)) {
-                        segment->audio = std::make_shared<AudioStreamingPart>(std::move(part->result->data), "ogg", false);
-                        _currentEndpointMapping = segment->audio->getEndpointMapping();
+                        auto audioPart = std::make_shared<AudioStreamingPart>(std::move(part->result->data), "ogg", false);
+                        _currentEndpointMapping = audioPart->getEndpointMapping();
+                        segment->audio = _decodeAhead->addAudioPart(segment->timestamp, std::move(audioPart));
                     } else if (const auto videoData = absl::get_if<PendingVideoSegmentData>(typeData)) {
                         auto videoSegment = std::make_shared<VideoSegment>();
                         videoSegment->quality = videoData->quality;
                         if (part->result->data.empty()) {
                             RTC_LOG(LS_INFO) << "Video part " << segment->timestamp << " is empty";
                         }
-                        videoSegment->part = std::make_shared<VideoStreamingPart>(std::move(part->result->data), VideoStreamingPart::ContentType::Video);
+                        auto videoPart = std::make_shared<VideoStreamingPart>(std::move(part->result->data), VideoStreamingPart::ContentType::Video, decodePolicyForQuality(videoData->quality));
+                        videoSegment->part = _decodeAhead->addVideoPart(segment->timestamp, std::move(videoPart), false);
                         segment->video.push_back(videoSegment);
                     } else if (absl::get_if<PendingUnifiedSegmentData>(typeData)) {
                         auto unifiedSegment = std::make_shared<UnifiedSegment>();
                         if (part->result->data.empty()) {
                             RTC_LOG(LS_INFO) << "Unified part " << segment->timestamp << " is empty";
                         }
-                        std::vector<uint8_t> dataCopy = part->result->data;
-                        unifiedSegment->videoPart = std::make_shared<VideoStreamingPart>(std::move(part->result->data), VideoStreamingPart::ContentType::Video);
+                        // One demuxer feeds both. Audio is added first, its remaining duration is
+                        // read here, before decoding of the shared part starts.
+                        auto unifiedPart = std::make_shared<VideoStreamingPart>(std::move(part->result->data), VideoStreamingPart::ContentType::Unified, decodePolicyForQuality(VideoChannelDescription::Quality::Full));
+                        segment->unifiedAudio = _decodeAhead->addUnifiedAudioPart(segment->timestamp, unifiedPart);
+                        unifiedSegment->videoPart = _decodeAhead->addVideoPart(segment->timestamp, std::move(unifiedPart), true);
                         segment->unified.push_back(unifiedSegment);
-                        segment->unifiedAudio = std::make_shared<VideoStreamingPart>(std::move(dataCopy), VideoStreamingPart::ContentType::Audio);
                     }
                 }
                 _availableSegments.push_back(segment);
@@ -1029,6 +1065,32 @@ public:
         }
     }
 
+    bool hasLiveVideoSink(std::string const &endpointId) {
+        auto it = _videoSinks.find(endpointId);
+        if (it == _videoSinks.end()) {
+            return false;
+        }
+        auto &sinks = it->second;
+        sinks.erase(std::remove_if(sinks.begin(), sinks.end(), [](std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> const &sink) {
+            return sink.expired();
+        }), sinks.end());
+        return !sinks.empty();
+    }
+
+    // Video of endpoints that nobody shows isn't decoded.
+    void updateVideoDemand() {
+        for (const auto &segment : _availableSegments) {
+            for (const auto &videoSegment : segment->video) {
+                if (const auto endpointId = videoSegment->part->getActiveEndpointId()) {
+                    videoSegment->part->setIsDemanded(hasLiveVideoSink(endpointId.value()));
+                }
+            }
+            for (const auto &videoSegment : segment->unified) {
+                videoSegment->videoPart->setIsDemanded(hasLiveVideoSink("unified"));
+            }
+        }
+    }
+
     void addVideoSink(std::string const &endpointId, std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
         auto it = _videoSinks.find(endpointId);
         if (it == _videoSinks.end()) {
@@ -1052,7 +1114,7 @@ private:
 
     absl::optional<int> _waitForBufferredMillisecondsBeforeRendering;
     std::vector<std::shared_ptr<MediaSegment>> _availableSegments;
-    AudioStreamingPartPersistentDecoder _persistentAudioDecoder;
+    std::shared_ptr<StreamingDecodeAhead> _decodeAhead;
 
     std::shared_ptr<BroadcastPartTask> _pendingRequestTimeTask;
     int _pendingRequestTimeDelayTaskId = 0;
@@ -1062,6 +1124,10 @@ private:
 
     int64_t _playbackReferenceTimestamp = 0;
 
+    int64_t _lastRenderTimestamp = 0;
+    int64_t _maxRenderIntervalMs = 0;
+    int64_t _maxRenderDurationUs = 0;
+
     const int _audioRingBufferNumChannels = 2;
     const size_t _audioDataRingBufferMaxSize = 4800 * 8;
     webrtc::Mutex _audioDataMutex;
@@ -1069,11 +1135,17 @@ private:
     std::vector<int16_t> _tempAudioBuffer;
     std::vector<int16_t> _stereoShuffleBuffer;
     webrtc::FrameCombiner _audioFrameCombiner;
+    // Kept across 10 ms ticks, so that steady playback doesn't allocate
+    std::vector<AudioStreamingPart::StreamingPartChannel> _audioChannels;
+    std::vector<std::unique_ptr<webrtc::AudioFrame>> _audioFramePool;
+    std::vector<webrtc::AudioFrame *> _audioFramesToMix;
+    webrtc::AudioFrame _mixedAudioFrame;
+    std::unique_ptr<webrtc::AudioBuffer> _audioLevelBuffer;
+    const std::vector<int16_t> _silentAudio = std::vector<int16_t>(480, 0);
     std::map<uint32_t, std::unique_ptr<SparseVad>> _audioVadMap;
 
     std::map<uint32_t, double> _volumeBySsrc;
     std::vector<StreamingMediaContext::VideoChannel> _activeVideoChannels;
-    std::map<std::string, std::shared_ptr<VideoStreamingSharedState>> _sharedVideoStateByEndpointId;
     std::map<std::string, std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>>> _videoSinks;
 
     std::map<std::string, int32_t> _currentEndpointMapping;
@@ -0,0 +1,64 @@
+#include "StreamingPartDemuxer.h"
+
+namespace tgcalls {
+
+StreamingPartDemuxer::StreamingPartDemuxer(StreamingPartData data, std::string const &container, AVMediaType mediaType) :
+_avIoContext(std::move(data), AVIOContextImpl::Configuration()) {
+    _inputFormatContext = openStreamingPartInput(_avIoContext, container, mediaType);
+}
+
+StreamingPartDemuxer::~StreamingPartDemuxer() {
+    for (auto &it : _queuedPackets) {
+        for (auto packet : it.second) {
+            av_packet_free(&packet);
+        }
+    }
+    if (_inputFormatContext) {
+        avformat_close_input(&_inputFormatContext);
+    }
+}
+
+AVFormatContext *StreamingPartDemuxer::formatContext() const {
+    return _inputFormatContext;
+}
+
+void StreamingPartDemuxer::addReader(int streamIndex) {
+    _queuedPackets[streamIndex];
+}
+
+int StreamingPartDemuxer::readPacket(int streamIndex, AVPacket *packet) {
+    if (!_inputFormatContext) {
+        return AVERROR_EOF;
+    }
+
+    auto queue = _queuedPackets.find(streamIndex);
+    if (queue != _queuedPackets.end() && !queue->second.empty()) {
+        AVPacket *queuedPacket = queue->second.front();
+        queue->second.pop_front();
+        av_packet_move_ref(packet, queuedPacket);
+        av_packet_free(&queuedPacket);
+        return 0;
+    }
+
+    while (true) {
+        int ret = av_read_frame(_inputFormatContext, packet);
+        if (ret < 0) {
+            return ret;
+        }
+        if (packet->stream_index == streamIndex) {
+            return 0;
+        }
+
+        auto otherQueue = _queuedPackets.find(packet->stream_index);
+        if (otherQueue != _queuedPackets.end()) {
+            AVPacket *queuedPacket = av_packet_alloc();
+            if (queuedPacket) {
+                av_packet_move_ref(queuedPacket, packet);
+                otherQueue->second.push_back(queuedPacket);
+            }
+        }
+        av_packet_unref(packet);
+    }
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef TGCALLS_STREAMING_PART_DEMUXER_H
+#define TGCALLS_STREAMING_PART_DEMUXER_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "AVIOContextImpl.h"
+
+namespace tgcalls {
+
+// Demuxes the container of one broadcast part once for several readers, each
+// taking the packets of its own stream. Packets read while looking for one
+// stream are queued for the readers of the others, and dropped if a stream
+// has no reader. Not thread-safe.
+class StreamingPartDemuxer {
+public:
+    // |mediaType| is the type of the streams that will be read, see
+    // openStreamingPartInput, AVMEDIA_TYPE_UNKNOWN for all of them.
+    StreamingPartDemuxer(StreamingPartData data, std::string const &container, AVMediaType mediaType);
+    ~StreamingPartDemuxer();
+
+    StreamingPartDemuxer(const StreamingPartDemuxer&) = delete;
+    StreamingPartDemuxer& operator=(const StreamingPartDemuxer&) = delete;
+
+    // nullptr if the container could not be opened.
+    AVFormatContext *formatContext() const;
+
+    // Packets of |streamIndex| are kept for readPacket() from now on.
+    void addReader(int streamIndex);
+    // Same result as av_read_frame, limited to the packets of |streamIndex|.
+    int readPacket(int streamIndex, AVPacket *packet);
+
+private:
+    AVIOContextImpl _avIoContext;
+    AVFormatContext *_inputFormatContext = nullptr;
+
+    std::map<int, std::deque<AVPacket *>> _queuedPackets;
+};
+
+}
+
+#endif
@@ -3,8 +3,10 @@
 #include "rtc_base/logging.h"
 #include "rtc_base/third_party/base64/base64.h"
 #include "api/video/i420_buffer.h"
+#include "api/make_ref_counted.h"
 
 #include "AVIOContextImpl.h"
+#include "StreamingPartDemuxer.h"
 #include "platform/PlatformInterface.h"
 
 #include <string>
@@ -104,6 +106,69 @@ private:
     AVFrame *_frame = nullptr;
 };
 
+// Planes of a decoded frame, kept alive by a reference to it instead of
+// being copied. Only for the formats laid out as I420.
+class AVFrameI420Buffer : public webrtc::I420BufferInterface {
+public:
+    static webrtc::scoped_refptr<AVFrameI420Buffer> Create(AVFrame const *frame) {
+        if (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P) {
+            return nullptr;
+        }
+        AVFrame *reference = av_frame_alloc();
+        if (!reference) {
+            return nullptr;
+        }
+        if (av_frame_ref(reference, frame) < 0) {
+            av_frame_free(&reference);
+            return nullptr;
+        }
+        return rtc::make_ref_counted<AVFrameI420Buffer>(reference);
+    }
+
+    explicit AVFrameI420Buffer(AVFrame *frame) :
+    _frame(frame) {
+    }
+
+    ~AVFrameI420Buffer() override {
+        av_frame_free(&_frame);
+    }
+
+    int width() const override {
+        return _frame->width;
+    }
+
+    int height() const override {
+        return _frame->height;
+    }
+
+    const uint8_t *DataY() const override {
+        return _frame->data[0];
+    }
+
+    const uint8_t *DataU() const override {
+        return _frame->data[1];
+    }
+
+    const uint8_t *DataV() const override {
+        return _frame->data[2];
+    }
+
+    int StrideY() const override {
+        return _frame->linesize[0];
+    }
+
+    int StrideU() const override {
+        return _frame->linesize[1];
+    }
+
+    int StrideV() const override {
+        return _frame->linesize[2];
+    }
+
+private:
+    AVFrame *_frame = nullptr;
+};
+
 struct VideoStreamEvent {
     int32_t offset = 0;
     std::string endpointId;
@@ -117,7 +182,7 @@ struct VideoStreamInfo {
     std::vector<VideoStreamEvent> events;
 };
 
-absl::optional<int32_t> readInt32(std::vector<uint8_t> const &data, int &offset) {
+absl::optional<int32_t> readInt32(StreamingPartData const &data, int &offset) {
     if (offset + 4 > data.size()) {
         return absl::nullopt;
     }
@@ -129,7 +194,7 @@ absl::optional<int32_t> readInt32(std::vector<uint8_t> const &data, int &offset)
     return value;
 }
 
-absl::optional<uint8_t> readBytesAsInt32(std::vector<uint8_t> const &data, int &offset, int count) {
+absl::optional<uint8_t> readBytesAsInt32(StreamingPartData const &data, int &offset, int count) {
     if (offset + count > data.size()) {
         return absl::nullopt;
     }
@@ -161,7 +226,7 @@ int32_t roundUp(int32_t numToRound, int32_t multiple) {
     return numToRound + multiple - remainder;
 }
 
-absl::optional<std::string> readSerializedString(std::vector<uint8_t> const &data, int &offset) {
+absl::optional<std::string> readSerializedString(StreamingPartData const &data, int &offset) {
     if (const auto tmp = readBytesAsInt32(data, offset, 1)) {
         int paddingBytes = 0;
         int length = 0;
@@ -193,7 +258,7 @@ absl::optional<std::string> readSerializedString(std::vector<uint8_t> const &dat
     }
 }
 
-absl::optional<VideoStreamEvent> readVideoStreamEvent(std::vector<uint8_t> const &data, int &offset) {
+absl::optional<VideoStreamEvent> readVideoStreamEvent(StreamingPartData const &data, int &offset) {
     VideoStreamEvent event;
 
     if (const auto offsetValue = readInt32(data, offset)) {
@@ -223,7 +288,7 @@ absl::optional<VideoStreamEvent> readVideoStreamEvent(std::vector<uint8_t> const
     return event;
 }
 
-absl::optional<VideoStreamInfo> consumeVideoStreamInfo(std::vector<uint8_t> &data) {
+absl::optional<VideoStreamInfo> consumeVideoStreamInfo(StreamingPartData &data) {
     int offset = 0;
     if (const auto signature = readInt32(data, offset)) {
         if (signature.value() != 0xa12e810d) {
@@ -261,7 +326,7 @@ absl::optional<VideoStreamInfo> consumeVideoStreamInfo(std::vector<uint8_t> &dat
         return absl::nullopt;
     }
 
-    data.erase(data.begin(), data.begin() + offset);
+    data = data.slice(offset, data.size() - offset);
 
     return info;
 }
@@ -325,7 +390,8 @@ class VideoStreamingDecoderState {
 public:
     static std::unique_ptr<VideoStreamingDecoderState> create(
         AVCodecParameters const *codecParameters,
-        AVRational pktTimebase
+        AVRational pktTimebase,
+        VideoStreamingDecodePolicy const &decodePolicy
     ) {
         AVCodec const *codec = nullptr;
         if (!codec) {
@@ -341,6 +407,17 @@ public:
             return nullptr;
         } else {
             codecContext->pkt_timebase = pktTimebase;
+
+            codecContext->thread_count = decodePolicy.threadCount;
+            if (decodePolicy.threadCount != 1) {
+                codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            }
+            if (decodePolicy.keyframesOnly) {
+                codecContext->skip_frame = AVDISCARD_NONKEY;
+            }
+            if (decodePolicy.skipNonReferenceLoopFilter) {
+                codecContext->skip_loop_filter = AVDISCARD_NONREF;
+            }
             
             PlatformInterface::SharedInstance()->setupVideoDecoding(codecContext);
             
@@ -354,7 +431,8 @@ public:
         return std::make_unique<VideoStreamingDecoderState>(
             codecContext,
             codecParameters,
-            pktTimebase
+            pktTimebase,
+            decodePolicy
         );
     }
     
@@ -362,12 +440,14 @@ public:
     VideoStreamingDecoderState(
         AVCodecContext *codecContext,
         AVCodecParameters const *codecParameters,
-        AVRational pktTimebase
+        AVRational pktTimebase,
+        VideoStreamingDecodePolicy const &decodePolicy
     ) {
         _codecContext = codecContext;
         _codecParameters = avcodec_parameters_alloc();
         avcodec_parameters_copy(_codecParameters, codecParameters);
         _pktTimebase = pktTimebase;
+        _decodePolicy = decodePolicy;
     }
     
     ~VideoStreamingDecoderState() {
@@ -384,7 +464,8 @@ public:
     
     bool supportsDecoding(
         AVCodecParameters const *codecParameters,
-        AVRational pktTimebase
+        AVRational pktTimebase,
+        VideoStreamingDecodePolicy const &decodePolicy
     ) const {
         if (!areCodecParametersEqual(*_codecParameters, *codecParameters)) {
             return false;
@@ -395,6 +476,9 @@ public:
         if (_pktTimebase.den != pktTimebase.den) {
             return false;
         }
+        if (_decodePolicy != decodePolicy) {
+            return false;
+        }
         return true;
     }
     
@@ -421,6 +505,7 @@ private:
     AVCodecContext *_codecContext = nullptr;
     AVCodecParameters *_codecParameters = nullptr;
     AVRational _pktTimebase;
+    VideoStreamingDecodePolicy _decodePolicy;
 };
 
 }
@@ -435,14 +520,15 @@ public:
     
     void updateDecoderState(
         AVCodecParameters const *codecParameters,
-        AVRational pktTimebase
+        AVRational pktTimebase,
+        VideoStreamingDecodePolicy const &decodePolicy
     ) {
-        if (_decoderState && _decoderState->supportsDecoding(codecParameters, pktTimebase)) {
+        if (_decoderState && _decoderState->supportsDecoding(codecParameters, pktTimebase, decodePolicy)) {
             return;
         }
         
         _decoderState.reset();
-        _decoderState = VideoStreamingDecoderState::create(codecParameters, pktTimebase);
+        _decoderState = VideoStreamingDecoderState::create(codecParameters, pktTimebase, decodePolicy);
     }
     
     int sendFrame(std::shared_ptr<DecodableFrame> frame) {
@@ -480,43 +566,17 @@ VideoStreamingSharedState::~VideoStreamingSharedState() {
 
 class VideoStreamingPartInternal {
 public:
-    VideoStreamingPartInternal(std::string endpointId, webrtc::VideoRotation rotation, std::vector<uint8_t> &&fileData, std::string const &container) :
+    VideoStreamingPartInternal(std::string endpointId, webrtc::VideoRotation rotation, std::shared_ptr<StreamingPartDemuxer> demuxer, VideoStreamingDecodePolicy const &decodePolicy) :
     _endpointId(endpointId),
-    _rotation(rotation) {
-        _avIoContext = std::make_unique<AVIOContextImpl>(std::move(fileData));
-
-        int ret = 0;
-
-#if LIBAVFORMAT_VERSION_MAJOR >= 59
-        const
-#endif
-        AVInputFormat *inputFormat = av_find_input_format(container.c_str());
-        if (!inputFormat) {
-            _didReadToEnd = true;
-            return;
-        }
-
-        _inputFormatContext = avformat_alloc_context();
+    _rotation(rotation),
+    _decodePolicy(decodePolicy),
+    _demuxer(std::move(demuxer)) {
+        _inputFormatContext = _demuxer->formatContext();
         if (!_inputFormatContext) {
             _didReadToEnd = true;
             return;
         }
 
-        _inputFormatContext->pb = _avIoContext->getContext();
-
-        if ((ret = avformat_open_input(&_inputFormatContext, "", inputFormat, nullptr)) < 0) {
-            _didReadToEnd = true;
-            return;
-        }
-
-        if ((ret = avformat_find_stream_info(_inputFormatContext, nullptr)) < 0) {
-            _didReadToEnd = true;
-
-            avformat_close_input(&_inputFormatContext);
-            _inputFormatContext = nullptr;
-            return;
-        }
-
         AVCodecParameters *videoCodecParameters = nullptr;
         AVStream *videoStream = nullptr;
         for (int i = 0; i < _inputFormatContext->nb_streams; i++) {
@@ -528,6 +588,7 @@ public:
             }
             videoCodecParameters = inCodecpar;
             videoStream = inStream;
+            _demuxer->addReader(i);
 
             break;
         }
@@ -567,9 +628,6 @@ public:
         if (_videoCodecParameters) {
             avcodec_parameters_free(&_videoCodecParameters);
         }
-        if (_inputFormatContext) {
-            avformat_close_input(&_inputFormatContext);
-        }
     }
 
     std::string endpointId() {
@@ -580,12 +638,12 @@ public:
         if (_didReadToEnd) {
             return absl::nullopt;
         }
-        if (!_inputFormatContext) {
+        if (!_inputFormatContext || !_videoStream) {
             return absl::nullopt;
         }
 
         MediaDataPacket packet;
-        int result = av_read_frame(_inputFormatContext, packet.packet());
+        int result = _demuxer->readPacket(_videoStream->index, packet.packet());
         if (result < 0) {
             return absl::nullopt;
         }
@@ -596,16 +654,40 @@ public:
     std::shared_ptr<DecodableFrame> readNextDecodableFrame() {
         while (true) {
             absl::optional<MediaDataPacket> packet = readPacket();
-            if (packet) {
-                if (_videoStream && packet->packet()->stream_index == _videoStream->index) {
-                    return std::make_shared<DecodableFrame>(std::move(packet.value()), packet->packet()->pts, packet->packet()->dts);
-                }
-            } else {
+            if (!packet) {
                 return nullptr;
             }
+            if (_needsKeyframe) {
+                if (!(packet->packet()->flags & AV_PKT_FLAG_KEY)) {
+                    continue;
+                }
+                _needsKeyframe = false;
+            }
+            return std::make_shared<DecodableFrame>(std::move(packet.value()), packet->packet()->pts, packet->packet()->dts);
         }
     }
 
+    absl::optional<double> skipNextPacket(VideoStreamingSharedState const *sharedState) {
+        if (!_needsKeyframe) {
+            // Frames still in the decoder belong to what's skipped
+            sharedState->impl()->reset();
+            _finalFrames.clear();
+            _needsKeyframe = true;
+        }
+
+        absl::optional<MediaDataPacket> packet = readPacket();
+        if (!packet) {
+            _didReadToEnd = true;
+            return absl::nullopt;
+        }
+
+        double value = ((double)packet->packet()->pts) * av_q2d(_videoStream->time_base);
+        if (_firstFramePts < 0.0) {
+            _firstFramePts = value;
+        }
+        return value - _firstFramePts;
+    }
+
     absl::optional<VideoStreamingPartFrame> convertCurrentFrame() {
         auto platformFrameBuffer = PlatformInterface::SharedInstance()->createPlatformFrameFromData(_frame.frame());
         if (platformFrameBuffer) {
@@ -616,16 +698,20 @@ public:
 
             return VideoStreamingPartFrame(_endpointId, videoFrame, _frame.pts(_videoStream, _firstFramePts), _frameIndex);
         } else {
-            webrtc::scoped_refptr<webrtc::I420Buffer> i420Buffer = webrtc::I420Buffer::Copy(
-                _frame.frame()->width,
-                _frame.frame()->height,
-                _frame.frame()->data[0],
-                _frame.frame()->linesize[0],
-                _frame.frame()->data[1],
-                _frame.frame()->linesize[1],
-                _frame.frame()->data[2],
-                _frame.frame()->linesize[2]
-            );
+            // The decoder doesn't reuse a buffer that frames still reference
+            webrtc::scoped_refptr<webrtc::I420BufferInterface> i420Buffer = AVFrameI420Buffer::Create(_frame.frame());
+            if (!i420Buffer) {
+                i420Buffer = webrtc::I420Buffer::Copy(
+                    _frame.frame()->width,
+                    _frame.frame()->height,
+                    _frame.frame()->data[0],
+                    _frame.frame()->linesize[0],
+                    _frame.frame()->data[1],
+                    _frame.frame()->linesize[1],
+                    _frame.frame()->data[2],
+                    _frame.frame()->linesize[2]
+                );
+            }
             if (i420Buffer) {
                 auto videoFrame = webrtc::VideoFrame::Builder()
                     .set_video_frame_buffer(i420Buffer)
@@ -647,7 +733,7 @@ public:
             return {};
         }
         
-        sharedState->impl()->updateDecoderState(_videoCodecParameters, _videoStream->time_base);
+        sharedState->impl()->updateDecoderState(_videoCodecParameters, _videoStream->time_base, _decodePolicy);
 
         while (true) {
             if (_didReadToEnd) {
@@ -715,9 +801,11 @@ public:
 private:
     std::string _endpointId;
     webrtc::VideoRotation _rotation = webrtc::VideoRotation::kVideoRotation_0;
+    VideoStreamingDecodePolicy _decodePolicy;
 
-    std::unique_ptr<AVIOContextImpl> _avIoContext;
+    std::shared_ptr<StreamingPartDemuxer> _demuxer;
 
+    // Owned by the demuxer.
     AVFormatContext *_inputFormatContext = nullptr;
     AVStream *_videoStream = nullptr;
     Frame _frame;
@@ -729,11 +817,13 @@ private:
     int _frameIndex = 0;
     double _firstFramePts = -1.0;
     bool _didReadToEnd = false;
+    // Packets were skipped, decoding continues at the next keyframe.
+    bool _needsKeyframe = false;
 };
 
 class VideoStreamingPartState {
 public:
-    VideoStreamingPartState(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType) {
+    VideoStreamingPartState(StreamingPartData data, VideoStreamingPart::ContentType contentType, VideoStreamingDecodePolicy const &decodePolicy) {
         _videoStreamInfo = consumeVideoStreamInfo(data);
         if (!_videoStreamInfo) {
             return;
@@ -755,7 +845,8 @@ public:
             if (endOffset > data.size()) {
                 continue;
             }
-            std::vector<uint8_t> dataSlice(data.begin() + _videoStreamInfo->events[i].offset, data.begin() + endOffset);
+            // References the part, the events are not copied
+            StreamingPartData dataSlice = data.slice(_videoStreamInfo->events[i].offset, endOffset - _videoStreamInfo->events[i].offset);
             webrtc::VideoRotation rotation = webrtc::VideoRotation::kVideoRotation_0;
             switch (_videoStreamInfo->events[i].rotation) {
                 case 0: {
@@ -781,17 +872,27 @@ public:
 
             switch (contentType) {
                 case VideoStreamingPart::ContentType::Audio: {
-                    auto part = std::make_unique<AudioStreamingPart>(std::move(dataSlice), _videoStreamInfo->container, true);
+                    auto demuxer = std::make_shared<StreamingPartDemuxer>(std::move(dataSlice), _videoStreamInfo->container, AVMEDIA_TYPE_AUDIO);
+                    auto part = std::make_unique<AudioStreamingPart>(std::move(demuxer), true);
                     _parsedAudioParts.push_back(std::move(part));
 
                     break;
                 }
                 case VideoStreamingPart::ContentType::Video: {
-                    auto part = std::make_unique<VideoStreamingPartInternal>(_videoStreamInfo->events[i].endpointId, rotation, std::move(dataSlice), _videoStreamInfo->container);
+                    auto demuxer = std::make_shared<StreamingPartDemuxer>(std::move(dataSlice), _videoStreamInfo->container, AVMEDIA_TYPE_VIDEO);
+                    auto part = std::make_unique<VideoStreamingPartInternal>(_videoStreamInfo->events[i].endpointId, rotation, std::move(demuxer), decodePolicy);
                     _parsedVideoParts.push_back(std::move(part));
 
                     break;
                 }
+                case VideoStreamingPart::ContentType::Unified: {
+                    // Both readers take their packets from the same demuxer
+                    auto demuxer = std::make_shared<StreamingPartDemuxer>(std::move(dataSlice), _videoStreamInfo->container, AVMEDIA_TYPE_UNKNOWN);
+                    _parsedVideoParts.push_back(std::make_unique<VideoStreamingPartInternal>(_videoStreamInfo->events[i].endpointId, rotation, demuxer, decodePolicy));
+                    _parsedAudioParts.push_back(std::make_unique<AudioStreamingPart>(std::move(demuxer), true));
+
+                    break;
+                }
                 default: {
                     break;
                 }
@@ -802,39 +903,26 @@ public:
     ~VideoStreamingPartState() {
     }
 
-    absl::optional<VideoStreamingPartFrame> getFrameAtRelativeTimestamp(VideoStreamingSharedState const *sharedState, double timestamp) {
-        while (true) {
-            while (_availableFrames.size() >= 2) {
-                if (timestamp >= _availableFrames[1].pts) {
-                    _availableFrames.erase(_availableFrames.begin());
-                } else {
-                    break;
-                }
-            }
-            
-            if (_availableFrames.size() < 2) {
-                if (!_parsedVideoParts.empty()) {
-                    auto result = _parsedVideoParts[0]->getNextFrame(sharedState);
-                    if (result) {
-                        _availableFrames.push_back(result.value());
-                    } else {
-                        _parsedVideoParts.erase(_parsedVideoParts.begin());
-                    }
-                    continue;
-                }
+    absl::optional<VideoStreamingPartFrame> getNextFrame(VideoStreamingSharedState const *sharedState) {
+        while (!_parsedVideoParts.empty()) {
+            auto result = _parsedVideoParts[0]->getNextFrame(sharedState);
+            if (result) {
+                return result;
             }
+            _parsedVideoParts.erase(_parsedVideoParts.begin());
+        }
+        return absl::nullopt;
+    }
 
-            if (!_availableFrames.empty()) {
-                for (size_t i = 1; i < _availableFrames.size(); i++) {
-                    if (timestamp < _availableFrames[i].pts) {
-                        return _availableFrames[i - 1];
-                    }
-                }
-                return _availableFrames[_availableFrames.size() - 1];
-            } else {
-                return absl::nullopt;
+    absl::optional<double> skipNextPacket(VideoStreamingSharedState const *sharedState) {
+        while (!_parsedVideoParts.empty()) {
+            auto result = _parsedVideoParts[0]->skipNextPacket(sharedState);
+            if (result) {
+                return result;
             }
+            _parsedVideoParts.erase(_parsedVideoParts.begin());
         }
+        return absl::nullopt;
     }
 
     absl::optional<std::string> getActiveEndpointId() const {
@@ -861,29 +949,30 @@ public:
         return 0;
     }
 
-    std::vector<AudioStreamingPart::StreamingPartChannel> getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder) {
+    bool getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<AudioStreamingPart::StreamingPartChannel> &channels) {
         while (!_parsedAudioParts.empty()) {
-            auto firstPartResult = _parsedAudioParts[0]->get10msPerChannel(persistentDecoder);
-            if (firstPartResult.empty()) {
-                _parsedAudioParts.erase(_parsedAudioParts.begin());
-            } else {
-                return firstPartResult;
+            if (_parsedAudioParts[0]->get10msPerChannel(persistentDecoder, channels)) {
+                return true;
             }
+            _parsedAudioParts.erase(_parsedAudioParts.begin());
         }
-        return {};
+        return false;
     }
 
 private:
     absl::optional<VideoStreamInfo> _videoStreamInfo;
     std::vector<std::unique_ptr<VideoStreamingPartInternal>> _parsedVideoParts;
-    std::vector<VideoStreamingPartFrame> _availableFrames;
 
     std::vector<std::unique_ptr<AudioStreamingPart>> _parsedAudioParts;
 };
 
-VideoStreamingPart::VideoStreamingPart(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType) {
-    if (!data.empty()) {
-        _state = new VideoStreamingPartState(std::move(data), contentType);
+VideoStreamingPart::VideoStreamingPart(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType, VideoStreamingDecodePolicy const &decodePolicy) :
+VideoStreamingPart(StreamingPartData(std::move(data)), contentType, decodePolicy) {
+}
+
+VideoStreamingPart::VideoStreamingPart(StreamingPartData data, VideoStreamingPart::ContentType contentType, VideoStreamingDecodePolicy const &decodePolicy) {
+    if (data.size() != 0) {
+        _state = new VideoStreamingPartState(std::move(data), contentType, decodePolicy);
     }
 }
 
@@ -893,9 +982,15 @@ VideoStreamingPart::~VideoStreamingPart() {
     }
 }
 
-absl::optional<VideoStreamingPartFrame> VideoStreamingPart::getFrameAtRelativeTimestamp(VideoStreamingSharedState const *sharedState, double timestamp) {
+absl::optional<VideoStreamingPartFrame> VideoStreamingPart::getNextFrame(VideoStreamingSharedState const *sharedState) {
+    return _state
+        ? _state->getNextFrame(sharedState)
+        : absl::nullopt;
+}
+
+absl::optional<double> VideoStreamingPart::skipNextPacket(VideoStreamingSharedState const *sharedState) {
     return _state
-        ? _state->getFrameAtRelativeTimestamp(sharedState, timestamp)
+        ? _state->skipNextPacket(sharedState)
         : absl::nullopt;
 }
 
@@ -916,10 +1011,10 @@ int VideoStreamingPart::getAudioRemainingMilliseconds() {
         ? _state->getAudioRemainingMilliseconds()
         : 0;
 }
-std::vector<AudioStreamingPart::StreamingPartChannel> VideoStreamingPart::getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder) {
+bool VideoStreamingPart::getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<AudioStreamingPart::StreamingPartChannel> &channels) {
     return _state
-        ? _state->getAudio10msPerChannel(persistentDecoder)
-        : std::vector<AudioStreamingPart::StreamingPartChannel>();
+        ? _state->getAudio10msPerChannel(persistentDecoder, channels)
+        : false;
 }
 
 }
@@ -30,6 +30,22 @@ struct VideoStreamingPartFrame {
     }
 };
 
+// How the video of a part is decoded, chosen by the quality it was requested in.
+struct VideoStreamingDecodePolicy {
+    // More than one also enables frame and slice threading, 0 lets the decoder choose.
+    int threadCount = 1;
+    bool keyframesOnly = false;
+    // Skips the loop filter where no other frame depends on the result.
+    bool skipNonReferenceLoopFilter = false;
+
+    bool operator==(VideoStreamingDecodePolicy const &rhs) const {
+        return threadCount == rhs.threadCount && keyframesOnly == rhs.keyframesOnly && skipNonReferenceLoopFilter == rhs.skipNonReferenceLoopFilter;
+    }
+    bool operator!=(VideoStreamingDecodePolicy const &rhs) const {
+        return !(*this == rhs);
+    }
+};
+
 class VideoStreamingSharedState {
 public:
     VideoStreamingSharedState();
@@ -47,11 +63,15 @@ class VideoStreamingPart {
 public:
     enum class ContentType {
         Audio,
-        Video
+        Video,
+        // Audio and video of the same part, demuxed once
+        Unified
     };
     
 public:
-    explicit VideoStreamingPart(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType);
+    explicit VideoStreamingPart(std::vector<uint8_t> &&data, VideoStreamingPart::ContentType contentType, VideoStreamingDecodePolicy const &decodePolicy);
+    // Events of the part are read in place, as slices of |data|.
+    explicit VideoStreamingPart(StreamingPartData data, VideoStreamingPart::ContentType contentType, VideoStreamingDecodePolicy const &decodePolicy);
     ~VideoStreamingPart();
     
     VideoStreamingPart(const VideoStreamingPart&) = delete;
@@ -62,12 +82,16 @@ public:
     VideoStreamingPart& operator=(const VideoStreamingPart&) = delete;
     VideoStreamingPart& operator=(VideoStreamingPart&&) = delete;
 
-    absl::optional<VideoStreamingPartFrame> getFrameAtRelativeTimestamp(VideoStreamingSharedState const *sharedState, double timestamp);
+    // Decodes the frame following the last one returned, regardless of time.
+    absl::optional<VideoStreamingPartFrame> getNextFrame(VideoStreamingSharedState const *sharedState);
+    // Drops the next video packet undecoded and returns its timestamp, relative
+    // like those of the frames. Decoding resumes at the following keyframe.
+    absl::optional<double> skipNextPacket(VideoStreamingSharedState const *sharedState);
     absl::optional<std::string> getActiveEndpointId() const;
     bool hasRemainingFrames() const;
     
     int getAudioRemainingMilliseconds();
-    std::vector<AudioStreamingPart::StreamingPartChannel> getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder);
+    bool getAudio10msPerChannel(AudioStreamingPartPersistentDecoder &persistentDecoder, std::vector<AudioStreamingPart::StreamingPartChannel> &channels);
     
 private:
     VideoStreamingPartState *_state = nullptr;
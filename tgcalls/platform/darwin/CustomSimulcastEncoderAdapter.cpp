@@ -39,11 +39,17 @@
 #include <string.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 
 #include "absl/algorithm/container.h"
+#include "absl/strings/match.h"
 #include "api/field_trials_view.h"
 #include "api/scoped_refptr.h"
 #include "api/transport/field_trial_based_config.h"
@@ -80,6 +86,22 @@ absl::optional<unsigned int> GetScreenshareBoostedQpValue(
   return qp;
 }
 
+// Returns how many threads may encode layers besides the encoder task queue,
+// 0 if layers are encoded one after another.
+int GetParallelEncodeWorkersCount(const webrtc::FieldTrialsView& field_trials) {
+  std::string experiment_group =
+      field_trials.Lookup("WebRTC-SimulcastEncoderAdapter-ParallelEncode");
+  if (!absl::StartsWith(experiment_group, "Enabled")) {
+    return 0;
+  }
+  int workers_count = 0;
+  if (sscanf(experiment_group.c_str(), "Enabled-%d", &workers_count) != 1 ||
+      workers_count < 1) {
+    workers_count = (int)std::thread::hardware_concurrency() - 1;
+  }
+  return std::max(0, std::min(workers_count, webrtc::kMaxSimulcastStreams - 1));
+}
+
 uint32_t SumStreamMaxBitrate(int streams, const webrtc::VideoCodec& codec) {
   uint32_t bitrate_sum = 0;
   for (int i = 0; i < streams; ++i) {
@@ -175,6 +197,102 @@ std::vector<uint32_t> GetStreamStartBitratesKbps(
 
 namespace webrtc {
 
+// Runs the layer encodes of one frame on a fixed set of threads. The calling
+// thread takes tasks as well, so `workers_count` threads are enough for
+// `workers_count + 1` layers.
+class CustomSimulcastEncoderAdapter::EncodeWorkerPool {
+ public:
+  explicit EncodeWorkerPool(int workers_count) {
+    for (int i = 0; i < workers_count; ++i) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  ~EncodeWorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    tasks_condition_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // Returns once all `tasks` have finished.
+  void Run(std::vector<std::function<void()>>& tasks) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& task : tasks) {
+        pending_tasks_.push_back(&task);
+      }
+      unfinished_tasks_count_ += tasks.size();
+    }
+    tasks_condition_.notify_all();
+
+    while (RunPendingTask()) {
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_condition_.wait(lock, [this] { return unfinished_tasks_count_ == 0; });
+  }
+
+ private:
+  bool RunPendingTask() {
+    std::function<void()>* task = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_tasks_.empty()) {
+        return false;
+      }
+      task = pending_tasks_.front();
+      pending_tasks_.pop_front();
+    }
+    (*task)();
+    FinishTask();
+    return true;
+  }
+
+  void FinishTask() {
+    bool is_finished = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      unfinished_tasks_count_--;
+      is_finished = unfinished_tasks_count_ == 0;
+    }
+    if (is_finished) {
+      finished_condition_.notify_all();
+    }
+  }
+
+  void WorkerLoop() {
+    while (true) {
+      std::function<void()>* task = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        tasks_condition_.wait(lock, [this] {
+          return is_stopping_ || !pending_tasks_.empty();
+        });
+        if (pending_tasks_.empty()) {
+          return;
+        }
+        task = pending_tasks_.front();
+        pending_tasks_.pop_front();
+      }
+      (*task)();
+      FinishTask();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable tasks_condition_;
+  std::condition_variable finished_condition_;
+  std::deque<std::function<void()>*> pending_tasks_;
+  size_t unfinished_tasks_count_ = 0;
+  bool is_stopping_ = false;
+};
+
 CustomSimulcastEncoderAdapter::EncoderContext::EncoderContext(
     std::unique_ptr<VideoEncoder> encoder,
     bool prefer_temporal_support,
@@ -207,7 +325,9 @@ CustomSimulcastEncoderAdapter::StreamContext::StreamContext(
       width_(width),
       height_(height),
       is_keyframe_needed_(false),
-      is_paused_(is_paused) {
+      is_paused_(is_paused),
+      is_hardware_accelerated_(
+          encoder_context_->encoder().GetEncoderInfo().is_hardware_accelerated) {
   if (parent_) {
     encoder_context_->encoder().RegisterEncodeCompleteCallback(this);
   }
@@ -221,7 +341,8 @@ CustomSimulcastEncoderAdapter::StreamContext::StreamContext(StreamContext&& rhs)
       width_(rhs.width_),
       height_(rhs.height_),
       is_keyframe_needed_(rhs.is_keyframe_needed_),
-      is_paused_(rhs.is_paused_) {
+      is_paused_(rhs.is_paused_),
+      is_hardware_accelerated_(rhs.is_hardware_accelerated_) {
   if (parent_) {
     encoder_context_->encoder().RegisterEncodeCompleteCallback(this);
   }
@@ -254,11 +375,44 @@ bool CustomSimulcastEncoderAdapter::StreamContext::ShouldDropFrame(
   return framerate_controller_->ShouldDropFrame(timestamp.us() * 1000);
 }
 
+void CustomSimulcastEncoderAdapter::StreamContext::StartCollectingOutput() {
+  MutexLock lock(&output_mutex_);
+  is_collecting_output_ = true;
+}
+
+void CustomSimulcastEncoderAdapter::StreamContext::FlushCollectedOutput() {
+  RTC_CHECK(parent_);
+  std::vector<CollectedImage> collected_output;
+  {
+    MutexLock lock(&output_mutex_);
+    is_collecting_output_ = false;
+    collected_output.swap(collected_output_);
+  }
+  for (const auto& collected : collected_output) {
+    parent_->OnEncodedImage(stream_idx_, collected.encoded_image,
+                            collected.codec_specific_info
+                                ? &*collected.codec_specific_info
+                                : nullptr);
+  }
+}
+
 EncodedImageCallback::Result
 CustomSimulcastEncoderAdapter::StreamContext::OnEncodedImage(
     const EncodedImage& encoded_image,
     const CodecSpecificInfo* codec_specific_info) {
   RTC_CHECK(parent_);  // If null, this method should never be called.
+  {
+    MutexLock lock(&output_mutex_);
+    if (is_collecting_output_) {
+      // The encoded data is reference counted, so this doesn't copy it.
+      collected_output_.push_back(CollectedImage{
+          encoded_image,
+          codec_specific_info
+              ? absl::optional<CodecSpecificInfo>(*codec_specific_info)
+              : absl::nullopt});
+      return Result(Result::OK);
+    }
+  }
   return parent_->OnEncodedImage(stream_idx_, encoded_image,
                                  codec_specific_info);
 }
@@ -294,7 +448,8 @@ CustomSimulcastEncoderAdapter::CustomSimulcastEncoderAdapter(
           RateControlSettings::ParseFromKeyValueConfig(&field_trials)
               .Vp8BoostBaseLayerQuality()),
       prefer_temporal_support_on_base_layer_(field_trials.IsEnabled(
-          "WebRTC-Video-PreferTemporalSupportOnBaseLayer")) {
+          "WebRTC-Video-PreferTemporalSupportOnBaseLayer")),
+      max_parallel_encode_workers_(GetParallelEncodeWorkersCount(field_trials)) {
   RTC_DCHECK(primary_factory);
 
   // The adapter is typically created on the worker thread, but operated on
@@ -323,6 +478,7 @@ int CustomSimulcastEncoderAdapter::Release() {
     stream_contexts_.pop_back();
   }
 
+  encode_workers_.reset();
   bypass_mode_ = false;
 
   // It's legal to move the encoder to another queue now.
@@ -412,6 +568,11 @@ int CustomSimulcastEncoderAdapter::InitEncode(
   std::vector<uint32_t> stream_start_bitrate_kbps =
       GetStreamStartBitratesKbps(codec_);
 
+  if (max_parallel_encode_workers_ > 0 && active_streams_count > 1) {
+    encode_workers_ = std::make_unique<EncodeWorkerPool>(
+        std::min(max_parallel_encode_workers_, active_streams_count - 1));
+  }
+
   for (int stream_idx = 0; stream_idx < total_streams_count_; ++stream_idx) {
     if (!is_legacy_singlecast && !codec_.simulcastStream[stream_idx].active) {
       continue;
@@ -447,8 +608,10 @@ int CustomSimulcastEncoderAdapter::InitEncode(
 
     // Intercept frame encode complete callback only for upper streams, where
     // we need to set a correct stream index. Set `parent` to nullptr for the
-    // lowest stream to bypass the callback.
-    CustomSimulcastEncoderAdapter* parent = stream_idx > 0 ? this : nullptr;
+    // lowest stream to bypass the callback, unless layers are encoded in
+    // parallel and the output of every stream has to be ordered.
+    CustomSimulcastEncoderAdapter* parent =
+        (stream_idx > 0 || encode_workers_) ? this : nullptr;
 
     bool is_paused = stream_start_bitrate_kbps[stream_idx] == 0;
     stream_contexts_.emplace_back(
@@ -509,11 +672,18 @@ int CustomSimulcastEncoderAdapter::Encode(
     }
   }
 
-  // Temporary thay may hold the result of texture to i420 buffer conversion.
-  rtc::scoped_refptr<VideoFrameBuffer> src_buffer;
-  int src_width = input_image.width();
-  int src_height = input_image.height();
-
+  struct LayerEncode {
+    StreamContext* layer = nullptr;
+    std::vector<VideoFrameType> frame_types;
+    rtc::scoped_refptr<VideoFrameBuffer> buffer;
+    int result = WEBRTC_VIDEO_CODEC_OK;
+  };
+  std::vector<LayerEncode> layer_encodes;
+  layer_encodes.reserve(stream_contexts_.size());
+
+  // Decide on frame types and frame dropping for all layers first. This stays
+  // on the encoder task queue, as do SetRates() calls, so the rate control
+  // state of a layer is never touched while its encoder runs on a worker.
   for (auto& layer : stream_contexts_) {
     // Don't encode frames in resolutions that we don't intend to send.
     if (layer.is_paused()) {
@@ -562,54 +732,133 @@ int CustomSimulcastEncoderAdapter::Encode(
       continue;
     }
 
-    // If scaling isn't required, because the input resolution
-    // matches the destination or the input image is empty (e.g.
-    // a keyframe request for encoders with internal camera
-    // sources) or the source image has a native handle, pass the image on
-    // directly. Otherwise, we'll scale it to match what the encoder expects
-    // (below).
-    // For texture frames, the underlying encoder is expected to be able to
-    // correctly sample/scale the source texture.
-    // TODO(perkj): ensure that works going forward, and figure out how this
-    // affects webrtc:5683.
-    if (layer.width() == src_width && layer.height() == src_height) {
-      int ret = layer.encoder().Encode(input_image, &stream_frame_types);
+    LayerEncode layer_encode;
+    layer_encode.layer = &layer;
+    layer_encode.frame_types = std::move(stream_frame_types);
+    layer_encode.buffer = input_image.video_frame_buffer();
+    layer_encodes.push_back(std::move(layer_encode));
+  }
+
+  // Hardware encoders complete asynchronously and gain nothing from running
+  // on a worker, only software layers are encoded in parallel.
+  size_t parallel_layers_count = 0;
+  if (encode_workers_) {
+    for (const auto& layer_encode : layer_encodes) {
+      if (!layer_encode.layer->is_hardware_accelerated()) {
+        parallel_layers_count++;
+      }
+    }
+  }
+
+  if (parallel_layers_count < 2) {
+    for (auto& layer_encode : layer_encodes) {
+      int ret = EncodeLayer(*layer_encode.layer, input_image,
+                            layer_encode.buffer, layer_encode.frame_types);
       if (ret != WEBRTC_VIDEO_CODEC_OK) {
         return ret;
       }
-    } else {
-      if (src_buffer == nullptr) {
-        src_buffer = input_image.video_frame_buffer();
+    }
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  for (auto& layer_encode : layer_encodes) {
+    StreamContext& layer = *layer_encode.layer;
+    if (layer.is_hardware_accelerated()) {
+      int ret = EncodeLayer(layer, input_image, layer_encode.buffer,
+                            layer_encode.frame_types);
+      if (ret != WEBRTC_VIDEO_CODEC_OK) {
+        return ret;
       }
-      rtc::scoped_refptr<VideoFrameBuffer> dst_buffer =
-          src_buffer->Scale(layer.width(), layer.height());
-      if (!dst_buffer) {
+      continue;
+    }
+
+    // Native buffers may not be safe to scale from several threads at once.
+    if (layer_encode.buffer->type() == VideoFrameBuffer::Type::kNative &&
+        (layer.width() != input_image.width() ||
+         layer.height() != input_image.height())) {
+      layer_encode.buffer =
+          layer_encode.buffer->Scale(layer.width(), layer.height());
+      if (!layer_encode.buffer) {
         RTC_LOG(LS_ERROR) << "Failed to scale video frame";
         return WEBRTC_VIDEO_CODEC_ENCODER_FAILURE;
       }
+    }
+  }
 
-      // UpdateRect is not propagated to lower simulcast layers currently.
-      // TODO(ilnik): Consider scaling UpdateRect together with the buffer.
-      VideoFrame frame(input_image);
-      frame.set_video_frame_buffer(dst_buffer);
-      frame.set_rotation(webrtc::kVideoRotation_0);
-      frame.set_update_rect(
-          VideoFrame::UpdateRect{0, 0, frame.width(), frame.height()});
-      int ret = layer.encoder().Encode(frame, &stream_frame_types);
-      if (ret != WEBRTC_VIDEO_CODEC_OK) {
-        return ret;
-      }
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(parallel_layers_count);
+  for (auto& layer_encode : layer_encodes) {
+    if (layer_encode.layer->is_hardware_accelerated()) {
+      continue;
     }
+    layer_encode.layer->StartCollectingOutput();
+    tasks.push_back([this, &layer_encode, &input_image] {
+      layer_encode.result =
+          EncodeLayer(*layer_encode.layer, input_image, layer_encode.buffer,
+                      layer_encode.frame_types);
+    });
   }
 
-  return WEBRTC_VIDEO_CODEC_OK;
+  encode_workers_->Run(tasks);
+
+  // Deliver the output in stream order, whichever layer finished first.
+  int result = WEBRTC_VIDEO_CODEC_OK;
+  for (auto& layer_encode : layer_encodes) {
+    if (layer_encode.layer->is_hardware_accelerated()) {
+      continue;
+    }
+    layer_encode.layer->FlushCollectedOutput();
+    if (result == WEBRTC_VIDEO_CODEC_OK) {
+      result = layer_encode.result;
+    }
+  }
+  return result;
+}
+
+int CustomSimulcastEncoderAdapter::EncodeLayer(
+    StreamContext& layer,
+    const VideoFrame& input_image,
+    rtc::scoped_refptr<VideoFrameBuffer> buffer,
+    const std::vector<VideoFrameType>& stream_frame_types) {
+  // If scaling isn't required, because the input resolution
+  // matches the destination or the input image is empty (e.g.
+  // a keyframe request for encoders with internal camera
+  // sources) or the source image has a native handle, pass the image on
+  // directly. Otherwise, we'll scale it to match what the encoder expects
+  // (below).
+  // For texture frames, the underlying encoder is expected to be able to
+  // correctly sample/scale the source texture.
+  // TODO(perkj): ensure that works going forward, and figure out how this
+  // affects webrtc:5683.
+  if (layer.width() == input_image.width() &&
+      layer.height() == input_image.height()) {
+    return layer.encoder().Encode(input_image, &stream_frame_types);
+  }
+
+  if (buffer->width() != layer.width() || buffer->height() != layer.height()) {
+    buffer = buffer->Scale(layer.width(), layer.height());
+    if (!buffer) {
+      RTC_LOG(LS_ERROR) << "Failed to scale video frame";
+      return WEBRTC_VIDEO_CODEC_ENCODER_FAILURE;
+    }
+  }
+
+  // UpdateRect is not propagated to lower simulcast layers currently.
+  // TODO(ilnik): Consider scaling UpdateRect together with the buffer.
+  VideoFrame frame(input_image);
+  frame.set_video_frame_buffer(buffer);
+  frame.set_rotation(webrtc::kVideoRotation_0);
+  frame.set_update_rect(
+      VideoFrame::UpdateRect{0, 0, frame.width(), frame.height()});
+  return layer.encoder().Encode(frame, &stream_frame_types);
 }
 
 int CustomSimulcastEncoderAdapter::RegisterEncodeCompleteCallback(
     EncodedImageCallback* callback) {
   RTC_DCHECK_RUN_ON(&encoder_queue_);
   encoded_complete_callback_ = callback;
-  if (!stream_contexts_.empty() && stream_contexts_.front().stream_idx() == 0) {
+  if (!stream_contexts_.empty() && stream_contexts_.front().stream_idx() == 0 &&
+      !encode_workers_) {
     // Bypass frame encode complete callback for the lowest layer since there is
     // no need to override frame's spatial index.
     stream_contexts_.front().encoder().RegisterEncodeCompleteCallback(callback);
@@ -29,6 +29,7 @@
 #include "common_video/framerate_controller.h"
 #include "modules/video_coding/include/video_codec_interface.h"
 #include "rtc_base/experiments/encoder_info_settings.h"
+#include "rtc_base/synchronization/mutex.h"
 #include "rtc_base/system/no_unique_address.h"
 #include "rtc_base/system/rtc_export.h"
 #include "api/field_trials_view.h"
@@ -39,6 +40,11 @@ namespace webrtc {
 // webrtc::VideoEncoder instances with the given VideoEncoderFactory.
 // The object is created and destroyed on the worker thread, but all public
 // interfaces should be called from the encoder task queue.
+// With the "WebRTC-SimulcastEncoderAdapter-ParallelEncode" field trial enabled
+// ("Enabled" or "Enabled-<max workers>"), the layers of a frame are encoded
+// concurrently on a small worker pool. Encode() still returns only after all
+// layers are done, and their output is delivered in stream order from the
+// encoder task queue.
 class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
  public:
   // TODO(bugs.webrtc.org/11000): Remove when downstream usage is gone.
@@ -70,6 +76,8 @@ class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
   EncoderInfo GetEncoderInfo() const override;
 
  private:
+  class EncodeWorkerPool;
+
   class EncoderContext {
    public:
     EncoderContext(std::unique_ptr<VideoEncoder> encoder,
@@ -122,6 +130,7 @@ class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
     void set_is_keyframe_needed() { is_keyframe_needed_ = true; }
     bool is_paused() const { return is_paused_; }
     void set_is_paused(bool is_paused) { is_paused_ = is_paused; }
+    bool is_hardware_accelerated() const { return is_hardware_accelerated_; }
     absl::optional<double> target_fps() const {
       return framerate_controller_ == nullptr
                  ? absl::nullopt
@@ -133,7 +142,17 @@ class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
     void OnKeyframe(Timestamp timestamp);
     bool ShouldDropFrame(Timestamp timestamp);
 
+    // While collecting, encoded images are held back instead of being passed
+    // to the parent, until FlushCollectedOutput() delivers them.
+    void StartCollectingOutput();
+    void FlushCollectedOutput();
+
    private:
+    struct CollectedImage {
+      EncodedImage encoded_image;
+      absl::optional<CodecSpecificInfo> codec_specific_info;
+    };
+
     CustomSimulcastEncoderAdapter* const parent_;
     std::unique_ptr<EncoderContext> encoder_context_;
     std::unique_ptr<FramerateController> framerate_controller_;
@@ -142,6 +161,11 @@ class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
     const uint16_t height_;
     bool is_keyframe_needed_;
     bool is_paused_;
+    bool is_hardware_accelerated_;
+
+    Mutex output_mutex_;
+    bool is_collecting_output_ RTC_GUARDED_BY(output_mutex_) = false;
+    std::vector<CollectedImage> collected_output_ RTC_GUARDED_BY(output_mutex_);
   };
 
   bool Initialized() const;
@@ -167,6 +191,14 @@ class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
 
   void OnDroppedFrame(size_t stream_idx);
 
+  // Encodes `input_image` with the layer's encoder. `buffer` is the frame's
+  // buffer or an already scaled one, it's scaled to the layer's resolution if
+  // it doesn't match yet.
+  int EncodeLayer(StreamContext& layer,
+                  const VideoFrame& input_image,
+                  rtc::scoped_refptr<VideoFrameBuffer> buffer,
+                  const std::vector<VideoFrameType>& stream_frame_types);
+
   void OverrideFromFieldTrial(VideoEncoder::EncoderInfo* info) const;
 
   std::atomic<int> inited_;
@@ -191,6 +223,11 @@ class RTC_EXPORT CustomSimulcastEncoderAdapter : public VideoEncoder {
   const absl::optional<unsigned int> experimental_boosted_screenshare_qp_;
   const bool boost_base_layer_quality_;
   const bool prefer_temporal_support_on_base_layer_;
+  // 0 when layers are encoded one after another.
+  const int max_parallel_encode_workers_;
+  // Created by InitEncode() in multi-encoder mode when parallel encoding is
+  // enabled.
+  std::unique_ptr<EncodeWorkerPool> encode_workers_;
 
   const SimulcastEncoderAdapterEncoderInfoSettings encoder_info_override_;
 };
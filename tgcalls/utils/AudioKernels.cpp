@@ -0,0 +1,504 @@
+#include "utils/AudioKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "rtc_base/system/arch.h"
+#include "system_wrappers/include/cpu_features_wrapper.h"
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define TGCALLS_AUDIO_KERNELS_X86 1
+#elif defined(WEBRTC_HAS_NEON) || defined(WEBRTC_ARCH_ARM64)
+#include <arm_neon.h>
+#define TGCALLS_AUDIO_KERNELS_NEON 1
+#endif
+
+#if defined(TGCALLS_AUDIO_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TGCALLS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TGCALLS_TARGET_AVX2
+#endif
+
+namespace tgcalls {
+namespace {
+
+struct AudioKernels {
+    const char *name = "scalar";
+    int16_t (*peakAbsInt16)(const int16_t *, size_t) = nullptr;
+    float (*peakAbsFloat)(const float *, size_t) = nullptr;
+    void (*deinterleaveStereoInt16)(const int16_t *, size_t, size_t, int16_t *) = nullptr;
+    void (*interleaveStereoInt16)(const int16_t *, const int16_t *, size_t, int16_t *) = nullptr;
+    void (*duplicateToStereoInt16)(const int16_t *, size_t, int16_t *) = nullptr;
+    void (*addClampFloat)(float *, const float *, size_t, float, float) = nullptr;
+    void (*floatToInt16)(const float *, size_t, int16_t *) = nullptr;
+    void (*interleaveStereoFloatToInt16)(const float *, const float *, size_t, int16_t *) = nullptr;
+};
+
+inline int16_t convertFloatSample(float sample) {
+    float scaled = std::min(std::max(sample * 32767.0f, -32768.0f), 32767.0f);
+    return (int16_t)lrintf(scaled);
+}
+
+int16_t peakAbsInt16Scalar(const int16_t *samples, size_t count) {
+    int peak = 0;
+    for (size_t i = 0; i < count; i++) {
+        int sample = samples[i];
+        if (sample < 0) {
+            sample = -sample;
+        }
+        if (peak < sample) {
+            peak = sample;
+        }
+    }
+    return (int16_t)std::min(peak, 32767);
+}
+
+float peakAbsFloatScalar(const float *samples, size_t count) {
+    float peak = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        peak = std::max(std::fabs(samples[i]), peak);
+    }
+    return peak;
+}
+
+void deinterleaveStereoInt16Scalar(const int16_t *interleaved, size_t channelIndex, size_t numSamples, int16_t *out) {
+    for (size_t i = 0; i < numSamples; i++) {
+        out[i] = interleaved[i * 2 + channelIndex];
+    }
+}
+
+void interleaveStereoInt16Scalar(const int16_t *left, const int16_t *right, size_t numSamples, int16_t *out) {
+    for (size_t i = 0; i < numSamples; i++) {
+        out[i * 2] = left[i];
+        out[i * 2 + 1] = right[i];
+    }
+}
+
+void duplicateToStereoInt16Scalar(const int16_t *mono, size_t numSamples, int16_t *out) {
+    for (size_t i = 0; i < numSamples; i++) {
+        out[i * 2] = mono[i];
+        out[i * 2 + 1] = mono[i];
+    }
+}
+
+void addClampFloatScalar(float *inout, const float *samples, size_t count, float minValue, float maxValue) {
+    for (size_t i = 0; i < count; i++) {
+        float sample = samples[i] + inout[i];
+        sample = std::min(sample, maxValue);
+        sample = std::max(sample, minValue);
+        inout[i] = sample;
+    }
+}
+
+void floatToInt16Scalar(const float *samples, size_t count, int16_t *out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = convertFloatSample(samples[i]);
+    }
+}
+
+void interleaveStereoFloatToInt16Scalar(const float *left, const float *right, size_t numSamples, int16_t *out) {
+    for (size_t i = 0; i < numSamples; i++) {
+        out[i * 2] = convertFloatSample(left[i]);
+        out[i * 2 + 1] = convertFloatSample(right[i]);
+    }
+}
+
+#if defined(TGCALLS_AUDIO_KERNELS_X86)
+
+int16_t horizontalMaxInt16(__m128i value) {
+    value = _mm_max_epi16(value, _mm_srli_si128(value, 8));
+    value = _mm_max_epi16(value, _mm_srli_si128(value, 4));
+    value = _mm_max_epi16(value, _mm_srli_si128(value, 2));
+    return (int16_t)_mm_cvtsi128_si32(value);
+}
+
+float horizontalMaxFloat(__m128 value) {
+    value = _mm_max_ps(value, _mm_movehl_ps(value, value));
+    value = _mm_max_ss(value, _mm_shuffle_ps(value, value, 1));
+    return _mm_cvtss_f32(value);
+}
+
+inline __m128i convertFloatSamplesSse2(__m128 first, __m128 second, __m128 scale, __m128 minValue, __m128 maxValue) {
+    first = _mm_min_ps(_mm_max_ps(_mm_mul_ps(first, scale), minValue), maxValue);
+    second = _mm_min_ps(_mm_max_ps(_mm_mul_ps(second, scale), minValue), maxValue);
+    return _mm_packs_epi32(_mm_cvtps_epi32(first), _mm_cvtps_epi32(second));
+}
+
+int16_t peakAbsInt16Sse2(const int16_t *samples, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i peak = zero;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i value = _mm_loadu_si128((const __m128i *)(samples + i));
+        value = _mm_max_epi16(value, _mm_subs_epi16(zero, value));
+        peak = _mm_max_epi16(peak, value);
+    }
+    return std::max(horizontalMaxInt16(peak), peakAbsInt16Scalar(samples + i, count - i));
+}
+
+float peakAbsFloatSse2(const float *samples, size_t count) {
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        peak = _mm_max_ps(peak, _mm_and_ps(_mm_loadu_ps(samples + i), signMask));
+    }
+    return std::max(horizontalMaxFloat(peak), peakAbsFloatScalar(samples + i, count - i));
+}
+
+void deinterleaveStereoInt16Sse2(const int16_t *interleaved, size_t channelIndex, size_t numSamples, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128i first = _mm_loadu_si128((const __m128i *)(interleaved + i * 2));
+        __m128i second = _mm_loadu_si128((const __m128i *)(interleaved + i * 2 + 8));
+        if (channelIndex == 0) {
+            first = _mm_srai_epi32(_mm_slli_epi32(first, 16), 16);
+            second = _mm_srai_epi32(_mm_slli_epi32(second, 16), 16);
+        } else {
+            first = _mm_srai_epi32(first, 16);
+            second = _mm_srai_epi32(second, 16);
+        }
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(first, second));
+    }
+    deinterleaveStereoInt16Scalar(interleaved + i * 2, channelIndex, numSamples - i, out + i);
+}
+
+void interleaveStereoInt16Sse2(const int16_t *left, const int16_t *right, size_t numSamples, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128i l = _mm_loadu_si128((const __m128i *)(left + i));
+        __m128i r = _mm_loadu_si128((const __m128i *)(right + i));
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i *)(out + i * 2 + 8), _mm_unpackhi_epi16(l, r));
+    }
+    interleaveStereoInt16Scalar(left + i, right + i, numSamples - i, out + i * 2);
+}
+
+void duplicateToStereoInt16Sse2(const int16_t *mono, size_t numSamples, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128i value = _mm_loadu_si128((const __m128i *)(mono + i));
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_unpacklo_epi16(value, value));
+        _mm_storeu_si128((__m128i *)(out + i * 2 + 8), _mm_unpackhi_epi16(value, value));
+    }
+    duplicateToStereoInt16Scalar(mono + i, numSamples - i, out + i * 2);
+}
+
+void addClampFloatSse2(float *inout, const float *samples, size_t count, float minValue, float maxValue) {
+    const __m128 minVector = _mm_set1_ps(minValue);
+    const __m128 maxVector = _mm_set1_ps(maxValue);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(inout + i));
+        _mm_storeu_ps(inout + i, _mm_max_ps(_mm_min_ps(sum, maxVector), minVector));
+    }
+    addClampFloatScalar(inout + i, samples + i, count - i, minValue, maxValue);
+}
+
+void floatToInt16Sse2(const float *samples, size_t count, int16_t *out) {
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 minValue = _mm_set1_ps(-32768.0f);
+    const __m128 maxValue = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i result = convertFloatSamplesSse2(_mm_loadu_ps(samples + i), _mm_loadu_ps(samples + i + 4), scale, minValue, maxValue);
+        _mm_storeu_si128((__m128i *)(out + i), result);
+    }
+    floatToInt16Scalar(samples + i, count - i, out + i);
+}
+
+void interleaveStereoFloatToInt16Sse2(const float *left, const float *right, size_t numSamples, int16_t *out) {
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 minValue = _mm_set1_ps(-32768.0f);
+    const __m128 maxValue = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128i l = convertFloatSamplesSse2(_mm_loadu_ps(left + i), _mm_loadu_ps(left + i + 4), scale, minValue, maxValue);
+        __m128i r = convertFloatSamplesSse2(_mm_loadu_ps(right + i), _mm_loadu_ps(right + i + 4), scale, minValue, maxValue);
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i *)(out + i * 2 + 8), _mm_unpackhi_epi16(l, r));
+    }
+    interleaveStereoFloatToInt16Scalar(left + i, right + i, numSamples - i, out + i * 2);
+}
+
+TGCALLS_TARGET_AVX2 int16_t peakAbsInt16Avx2(const int16_t *samples, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i peak = zero;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i value = _mm256_loadu_si256((const __m256i *)(samples + i));
+        value = _mm256_max_epi16(value, _mm256_subs_epi16(zero, value));
+        peak = _mm256_max_epi16(peak, value);
+    }
+    __m128i folded = _mm_max_epi16(_mm256_castsi256_si128(peak), _mm256_extracti128_si256(peak, 1));
+    return std::max(horizontalMaxInt16(folded), peakAbsInt16Sse2(samples + i, count - i));
+}
+
+TGCALLS_TARGET_AVX2 float peakAbsFloatAvx2(const float *samples, size_t count) {
+    const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        peak = _mm256_max_ps(peak, _mm256_and_ps(_mm256_loadu_ps(samples + i), signMask));
+    }
+    __m128 folded = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    return std::max(horizontalMaxFloat(folded), peakAbsFloatSse2(samples + i, count - i));
+}
+
+TGCALLS_TARGET_AVX2 void addClampFloatAvx2(float *inout, const float *samples, size_t count, float minValue, float maxValue) {
+    const __m256 minVector = _mm256_set1_ps(minValue);
+    const __m256 maxVector = _mm256_set1_ps(maxValue);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(inout + i));
+        _mm256_storeu_ps(inout + i, _mm256_max_ps(_mm256_min_ps(sum, maxVector), minVector));
+    }
+    addClampFloatSse2(inout + i, samples + i, count - i, minValue, maxValue);
+}
+
+TGCALLS_TARGET_AVX2 void floatToInt16Avx2(const float *samples, size_t count, int16_t *out) {
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    const __m256 minValue = _mm256_set1_ps(-32768.0f);
+    const __m256 maxValue = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(samples + i), scale), minValue), maxValue);
+        __m256i converted = _mm256_cvtps_epi32(value);
+        __m128i result = _mm_packs_epi32(_mm256_castsi256_si128(converted), _mm256_extracti128_si256(converted, 1));
+        _mm_storeu_si128((__m128i *)(out + i), result);
+    }
+    floatToInt16Scalar(samples + i, count - i, out + i);
+}
+
+#elif defined(TGCALLS_AUDIO_KERNELS_NEON)
+
+int16_t peakAbsInt16Neon(const int16_t *samples, size_t count) {
+    int16x8_t peak = vdupq_n_s16(0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        peak = vmaxq_s16(peak, vqabsq_s16(vld1q_s16(samples + i)));
+    }
+#if defined(WEBRTC_ARCH_ARM64)
+    int16_t result = vmaxvq_s16(peak);
+#else
+    int16x4_t folded = vmax_s16(vget_low_s16(peak), vget_high_s16(peak));
+    folded = vpmax_s16(folded, folded);
+    folded = vpmax_s16(folded, folded);
+    int16_t result = vget_lane_s16(folded, 0);
+#endif
+    return std::max(result, peakAbsInt16Scalar(samples + i, count - i));
+}
+
+float peakAbsFloatNeon(const float *samples, size_t count) {
+    float32x4_t peak = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        peak = vmaxq_f32(peak, vabsq_f32(vld1q_f32(samples + i)));
+    }
+#if defined(WEBRTC_ARCH_ARM64)
+    float result = vmaxvq_f32(peak);
+#else
+    float32x2_t folded = vmax_f32(vget_low_f32(peak), vget_high_f32(peak));
+    folded = vpmax_f32(folded, folded);
+    float result = vget_lane_f32(folded, 0);
+#endif
+    return std::max(result, peakAbsFloatScalar(samples + i, count - i));
+}
+
+void deinterleaveStereoInt16Neon(const int16_t *interleaved, size_t channelIndex, size_t numSamples, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        int16x8x2_t value = vld2q_s16(interleaved + i * 2);
+        vst1q_s16(out + i, channelIndex == 0 ? value.val[0] : value.val[1]);
+    }
+    deinterleaveStereoInt16Scalar(interleaved + i * 2, channelIndex, numSamples - i, out + i);
+}
+
+void interleaveStereoInt16Neon(const int16_t *left, const int16_t *right, size_t numSamples, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        int16x8x2_t value;
+        value.val[0] = vld1q_s16(left + i);
+        value.val[1] = vld1q_s16(right + i);
+        vst2q_s16(out + i * 2, value);
+    }
+    interleaveStereoInt16Scalar(left + i, right + i, numSamples - i, out + i * 2);
+}
+
+void duplicateToStereoInt16Neon(const int16_t *mono, size_t numSamples, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        int16x8x2_t value;
+        value.val[0] = vld1q_s16(mono + i);
+        value.val[1] = value.val[0];
+        vst2q_s16(out + i * 2, value);
+    }
+    duplicateToStereoInt16Scalar(mono + i, numSamples - i, out + i * 2);
+}
+
+void addClampFloatNeon(float *inout, const float *samples, size_t count, float minValue, float maxValue) {
+    const float32x4_t minVector = vdupq_n_f32(minValue);
+    const float32x4_t maxVector = vdupq_n_f32(maxValue);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t sum = vaddq_f32(vld1q_f32(samples + i), vld1q_f32(inout + i));
+        vst1q_f32(inout + i, vmaxq_f32(vminq_f32(sum, maxVector), minVector));
+    }
+    addClampFloatScalar(inout + i, samples + i, count - i, minValue, maxValue);
+}
+
+#if defined(WEBRTC_ARCH_ARM64)
+inline int16x4_t convertFloatSamplesNeon(float32x4_t value) {
+    value = vmulq_n_f32(value, 32767.0f);
+    value = vminq_f32(vmaxq_f32(value, vdupq_n_f32(-32768.0f)), vdupq_n_f32(32767.0f));
+    return vqmovn_s32(vcvtnq_s32_f32(value));
+}
+
+void floatToInt16Neon(const float *samples, size_t count, int16_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t result = vcombine_s16(convertFloatSamplesNeon(vld1q_f32(samples + i)), convertFloatSamplesNeon(vld1q_f32(samples + i + 4)));
+        vst1q_s16(out + i, result);
+    }
+    floatToInt16Scalar(samples + i, count - i, out + i);
+}
+#endif
+
+#endif
+
+AudioKernels selectAudioKernels() {
+    AudioKernels result;
+    result.peakAbsInt16 = peakAbsInt16Scalar;
+    result.peakAbsFloat = peakAbsFloatScalar;
+    result.deinterleaveStereoInt16 = deinterleaveStereoInt16Scalar;
+    result.interleaveStereoInt16 = interleaveStereoInt16Scalar;
+    result.duplicateToStereoInt16 = duplicateToStereoInt16Scalar;
+    result.addClampFloat = addClampFloatScalar;
+    result.floatToInt16 = floatToInt16Scalar;
+    result.interleaveStereoFloatToInt16 = interleaveStereoFloatToInt16Scalar;
+
+#if defined(TGCALLS_AUDIO_KERNELS_X86)
+    if (webrtc::GetCPUInfo(webrtc::kSSE2) != 0) {
+        result.name = "sse2";
+        result.peakAbsInt16 = peakAbsInt16Sse2;
+        result.peakAbsFloat = peakAbsFloatSse2;
+        result.deinterleaveStereoInt16 = deinterleaveStereoInt16Sse2;
+        result.interleaveStereoInt16 = interleaveStereoInt16Sse2;
+        result.duplicateToStereoInt16 = duplicateToStereoInt16Sse2;
+        result.addClampFloat = addClampFloatSse2;
+        result.floatToInt16 = floatToInt16Sse2;
+        result.interleaveStereoFloatToInt16 = interleaveStereoFloatToInt16Sse2;
+
+        if (webrtc::GetCPUInfo(webrtc::kAVX2) != 0) {
+            result.name = "avx2";
+            result.peakAbsInt16 = peakAbsInt16Avx2;
+            result.peakAbsFloat = peakAbsFloatAvx2;
+            result.addClampFloat = addClampFloatAvx2;
+            result.floatToInt16 = floatToInt16Avx2;
+        }
+    }
+#elif defined(TGCALLS_AUDIO_KERNELS_NEON)
+    result.name = "neon";
+    result.peakAbsInt16 = peakAbsInt16Neon;
+    result.peakAbsFloat = peakAbsFloatNeon;
+    result.deinterleaveStereoInt16 = deinterleaveStereoInt16Neon;
+    result.interleaveStereoInt16 = interleaveStereoInt16Neon;
+    result.duplicateToStereoInt16 = duplicateToStereoInt16Neon;
+    result.addClampFloat = addClampFloatNeon;
+#if defined(WEBRTC_ARCH_ARM64)
+    result.floatToInt16 = floatToInt16Neon;
+#endif
+#endif
+
+    return result;
+}
+
+AudioKernels const &audioKernels() {
+    static const AudioKernels kernels = selectAudioKernels();
+    return kernels;
+}
+
+} // namespace
+
+int16_t peakAbsInt16(const int16_t *samples, size_t count) {
+    return audioKernels().peakAbsInt16(samples, count);
+}
+
+float peakAbsFloat(const float *samples, size_t count) {
+    return audioKernels().peakAbsFloat(samples, count);
+}
+
+void deinterleaveChannelInt16(const int16_t *interleaved, size_t numChannels, size_t channelIndex, size_t numSamples, int16_t *out) {
+    if (numChannels == 1) {
+        memcpy(out, interleaved, numSamples * sizeof(int16_t));
+    } else if (numChannels == 2) {
+        audioKernels().deinterleaveStereoInt16(interleaved, channelIndex, numSamples, out);
+    } else {
+        for (size_t i = 0; i < numSamples; i++) {
+            out[i] = interleaved[i * numChannels + channelIndex];
+        }
+    }
+}
+
+void interleaveInt16(const int16_t *const *channels, size_t numChannels, size_t numSamples, int16_t *out) {
+    if (numChannels == 1) {
+        memcpy(out, channels[0], numSamples * sizeof(int16_t));
+    } else if (numChannels == 2) {
+        audioKernels().interleaveStereoInt16(channels[0], channels[1], numSamples, out);
+    } else {
+        for (size_t i = 0; i < numSamples; i++) {
+            for (size_t j = 0; j < numChannels; j++) {
+                out[i * numChannels + j] = channels[j][i];
+            }
+        }
+    }
+}
+
+void duplicateChannelsInt16(const int16_t *mono, size_t numSamples, size_t numChannels, int16_t *out) {
+    if (numChannels == 1) {
+        memcpy(out, mono, numSamples * sizeof(int16_t));
+    } else if (numChannels == 2) {
+        audioKernels().duplicateToStereoInt16(mono, numSamples, out);
+    } else {
+        for (size_t i = 0; i < numSamples; i++) {
+            for (size_t j = 0; j < numChannels; j++) {
+                out[i * numChannels + j] = mono[i];
+            }
+        }
+    }
+}
+
+void addClampFloat(float *inout, const float *samples, size_t count, float minValue, float maxValue) {
+    audioKernels().addClampFloat(inout, samples, count, minValue, maxValue);
+}
+
+void floatToInt16(const float *samples, size_t count, int16_t *out) {
+    audioKernels().floatToInt16(samples, count, out);
+}
+
+void planarFloatToInterleavedInt16(const float *const *planes, size_t numChannels, size_t numSamples, int16_t *out) {
+    if (numChannels == 1) {
+        audioKernels().floatToInt16(planes[0], numSamples, out);
+    } else if (numChannels == 2) {
+        audioKernels().interleaveStereoFloatToInt16(planes[0], planes[1], numSamples, out);
+    } else {
+        for (size_t i = 0; i < numSamples; i++) {
+            for (size_t j = 0; j < numChannels; j++) {
+                out[i * numChannels + j] = convertFloatSample(planes[j][i]);
+            }
+        }
+    }
+}
+
+void planarInt16ToInterleavedInt16(const int16_t *const *planes, size_t numChannels, size_t numSamples, int16_t *out) {
+    interleaveInt16(planes, numChannels, numSamples, out);
+}
+
+const char *audioKernelsImplementationName() {
+    return audioKernels().name;
+}
+
+}
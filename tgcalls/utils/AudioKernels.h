@@ -0,0 +1,37 @@
+#ifndef TGCALLS_UTILS_AUDIO_KERNELS_H
+#define TGCALLS_UTILS_AUDIO_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tgcalls {
+
+// Sample-processing kernels shared by the audio paths. The implementation
+// (AVX2, SSE2, NEON or scalar) is picked once at runtime; every variant
+// produces the same output as the scalar one for finite input.
+
+// Largest absolute value, with -32768 saturated to 32767.
+int16_t peakAbsInt16(const int16_t *samples, size_t count);
+float peakAbsFloat(const float *samples, size_t count);
+
+// Copies channel channelIndex of an interleaved buffer into a mono buffer.
+void deinterleaveChannelInt16(const int16_t *interleaved, size_t numChannels, size_t channelIndex, size_t numSamples, int16_t *out);
+// Interleaves numChannels mono buffers into one.
+void interleaveInt16(const int16_t *const *channels, size_t numChannels, size_t numSamples, int16_t *out);
+// Writes the mono buffer into each of numChannels interleaved channels.
+void duplicateChannelsInt16(const int16_t *mono, size_t numSamples, size_t numChannels, int16_t *out);
+
+// inout[i] = clamp(inout[i] + samples[i], minValue, maxValue)
+void addClampFloat(float *inout, const float *samples, size_t count, float minValue, float maxValue);
+
+// Converts [-1, 1] floats to int16 with round-to-nearest and saturation,
+// matching av_clip_int16(lrint(sample * 32767)).
+void floatToInt16(const float *samples, size_t count, int16_t *out);
+void planarFloatToInterleavedInt16(const float *const *planes, size_t numChannels, size_t numSamples, int16_t *out);
+void planarInt16ToInterleavedInt16(const int16_t *const *planes, size_t numChannels, size_t numSamples, int16_t *out);
+
+const char *audioKernelsImplementationName();
+
+}
+
+#endif // TGCALLS_UTILS_AUDIO_KERNELS_H
@@ -0,0 +1,300 @@
+#include "utils/H26xStartCodes.h"
+
+#include <cstring>
+
+#include "rtc_base/system/arch.h"
+#include "system_wrappers/include/cpu_features_wrapper.h"
+
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define TGCALLS_START_CODES_X86 1
+#elif defined(WEBRTC_HAS_NEON) || defined(WEBRTC_ARCH_ARM64)
+#include <arm_neon.h>
+#define TGCALLS_START_CODES_NEON 1
+#endif
+
+#if defined(TGCALLS_START_CODES_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TGCALLS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TGCALLS_TARGET_AVX2
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace tgcalls {
+namespace {
+
+// A sequence is 00 00 x with kMinThird <= x <= kMaxThird.
+constexpr uint8_t kStartCodeThird = 1;
+constexpr uint8_t kEmulationMaxThird = 3;
+
+struct StartCodeKernels {
+    const char *name = "scalar";
+    size_t (*findStartCode)(const uint8_t *, size_t, size_t) = nullptr;
+    size_t (*findEmulationSequence)(const uint8_t *, size_t, size_t) = nullptr;
+};
+
+inline size_t countTrailingZeros(uint32_t value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index = 0;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return (size_t)__builtin_ctz(value);
+#endif
+}
+
+template <uint8_t kMinThird, uint8_t kMaxThird>
+size_t findSequenceScalar(const uint8_t *data, size_t size, size_t from) {
+    size_t i = from;
+    while (i + 2 < size) {
+        const uint8_t third = data[i + 2];
+        if (third > kMaxThird) {
+            // No sequence can begin at i, i + 1 or i + 2
+            i += 3;
+        } else if (third >= kMinThird && data[i + 1] == 0 && data[i] == 0) {
+            return i;
+        } else {
+            // Only a zero third byte can start the next sequence within reach
+            i += third == 0 ? 1 : 3;
+        }
+    }
+    return size;
+}
+
+#if defined(TGCALLS_START_CODES_X86)
+
+template <uint8_t kMinThird, uint8_t kMaxThird>
+inline __m128i matchThirdSse2(__m128i value) {
+    if constexpr (kMinThird == kMaxThird) {
+        return _mm_cmpeq_epi8(value, _mm_set1_epi8(kMinThird));
+    } else {
+        return _mm_cmpeq_epi8(_mm_min_epu8(value, _mm_set1_epi8(kMaxThird)), value);
+    }
+}
+
+template <uint8_t kMinThird, uint8_t kMaxThird>
+size_t findSequenceSse2(const uint8_t *data, size_t size, size_t from) {
+    static_assert(kMinThird == kMaxThird || kMinThird == 0, "Unsupported range");
+
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = from;
+    for (; i + 2 + 16 <= size; i += 16) {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+        const __m128i third = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 2));
+        const __m128i zeros = _mm_and_si128(_mm_cmpeq_epi8(first, zero), _mm_cmpeq_epi8(second, zero));
+        const int mask = _mm_movemask_epi8(_mm_and_si128(zeros, matchThirdSse2<kMinThird, kMaxThird>(third)));
+        if (mask != 0) {
+            return i + countTrailingZeros((uint32_t)mask);
+        }
+    }
+    return findSequenceScalar<kMinThird, kMaxThird>(data, size, i);
+}
+
+template <uint8_t kMinThird, uint8_t kMaxThird>
+TGCALLS_TARGET_AVX2 inline __m256i matchThirdAvx2(__m256i value) {
+    if constexpr (kMinThird == kMaxThird) {
+        return _mm256_cmpeq_epi8(value, _mm256_set1_epi8(kMinThird));
+    } else {
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(value, _mm256_set1_epi8(kMaxThird)), value);
+    }
+}
+
+template <uint8_t kMinThird, uint8_t kMaxThird>
+TGCALLS_TARGET_AVX2 size_t findSequenceAvx2(const uint8_t *data, size_t size, size_t from) {
+    static_assert(kMinThird == kMaxThird || kMinThird == 0, "Unsupported range");
+
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = from;
+    for (; i + 2 + 32 <= size; i += 32) {
+        const __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 1));
+        const __m256i third = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 2));
+        const __m256i zeros = _mm256_and_si256(_mm256_cmpeq_epi8(first, zero), _mm256_cmpeq_epi8(second, zero));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(zeros, matchThirdAvx2<kMinThird, kMaxThird>(third)));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findSequenceSse2<kMinThird, kMaxThird>(data, size, i);
+}
+
+#elif defined(TGCALLS_START_CODES_NEON)
+
+template <uint8_t kMinThird, uint8_t kMaxThird>
+size_t findSequenceNeon(const uint8_t *data, size_t size, size_t from) {
+    static_assert(kMinThird == kMaxThird || kMinThird == 0, "Unsupported range");
+
+    size_t i = from;
+    for (; i + 2 + 16 <= size; i += 16) {
+        const uint8x16_t first = vld1q_u8(data + i);
+        const uint8x16_t second = vld1q_u8(data + i + 1);
+        const uint8x16_t third = vld1q_u8(data + i + 2);
+        const uint8x16_t zeros = vandq_u8(vceqq_u8(first, vdupq_n_u8(0)), vceqq_u8(second, vdupq_n_u8(0)));
+        uint8x16_t matches;
+        if constexpr (kMinThird == kMaxThird) {
+            matches = vandq_u8(zeros, vceqq_u8(third, vdupq_n_u8(kMinThird)));
+        } else {
+            matches = vandq_u8(zeros, vcleq_u8(third, vdupq_n_u8(kMaxThird)));
+        }
+        const uint8x8_t folded = vorr_u8(vget_low_u8(matches), vget_high_u8(matches));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) != 0) {
+            // Rare, find the exact position within the block
+            return findSequenceScalar<kMinThird, kMaxThird>(data, size, i);
+        }
+    }
+    return findSequenceScalar<kMinThird, kMaxThird>(data, size, i);
+}
+
+#endif
+
+StartCodeKernels selectStartCodeKernels() {
+    StartCodeKernels result;
+    result.findStartCode = findSequenceScalar<kStartCodeThird, kStartCodeThird>;
+    result.findEmulationSequence = findSequenceScalar<0, kEmulationMaxThird>;
+
+#if defined(TGCALLS_START_CODES_X86)
+    if (webrtc::GetCPUInfo(webrtc::kSSE2) != 0) {
+        result.name = "sse2";
+        result.findStartCode = findSequenceSse2<kStartCodeThird, kStartCodeThird>;
+        result.findEmulationSequence = findSequenceSse2<0, kEmulationMaxThird>;
+
+        if (webrtc::GetCPUInfo(webrtc::kAVX2) != 0) {
+            result.name = "avx2";
+            result.findStartCode = findSequenceAvx2<kStartCodeThird, kStartCodeThird>;
+            result.findEmulationSequence = findSequenceAvx2<0, kEmulationMaxThird>;
+        }
+    }
+#elif defined(TGCALLS_START_CODES_NEON)
+    result.name = "neon";
+    result.findStartCode = findSequenceNeon<kStartCodeThird, kStartCodeThird>;
+    result.findEmulationSequence = findSequenceNeon<0, kEmulationMaxThird>;
+#endif
+
+    return result;
+}
+
+StartCodeKernels const &startCodeKernels() {
+    static const StartCodeKernels kernels = selectStartCodeKernels();
+    return kernels;
+}
+
+} // namespace
+
+size_t findH26xStartCode(const uint8_t *data, size_t size, size_t from) {
+    return startCodeKernels().findStartCode(data, size, from);
+}
+
+size_t findH26xEmulationSequence(const uint8_t *data, size_t size, size_t from) {
+    return startCodeKernels().findEmulationSequence(data, size, from);
+}
+
+H26xNaluReader::H26xNaluReader(const uint8_t *data, size_t size) :
+_data(data),
+_size(size),
+// Like FindNaluIndices, don't accept a start code ending at the last byte
+_searchSize(size < 3 ? 0 : size - 1) {
+    _startCode = findH26xStartCode(_data, _searchSize, 0);
+}
+
+bool H26xNaluReader::next(H26xNaluIndex &index) {
+    if (_startCode >= _searchSize) {
+        return false;
+    }
+
+    index.startOffset = _startCode;
+    index.payloadStartOffset = _startCode + 3;
+    if (index.startOffset > 0 && _data[index.startOffset - 1] == 0) {
+        index.startOffset--;
+    }
+
+    _startCode = findH26xStartCode(_data, _searchSize, index.payloadStartOffset);
+    if (_startCode >= _searchSize) {
+        index.payloadSize = _size - index.payloadStartOffset;
+    } else {
+        size_t nextStartOffset = _startCode;
+        if (_data[nextStartOffset - 1] == 0) {
+            nextStartOffset--;
+        }
+        index.payloadSize = nextStartOffset - index.payloadStartOffset;
+    }
+    return true;
+}
+
+size_t escapeH26xEmulation(const uint8_t *data, size_t size, size_t leadingZeros, uint8_t *out) {
+    size_t written = 0;
+    size_t copied = 0;
+    size_t searchFrom = 0;
+
+    const auto insertBefore = [&](size_t position) {
+        memcpy(out + written, data + copied, position - copied);
+        written += position - copied;
+        out[written++] = kEmulationMaxThird;
+        copied = position;
+        searchFrom = position;
+    };
+
+    // Sequences that begin with zeros preceding |data|
+    if (leadingZeros >= 2 && size >= 1 && data[0] <= kEmulationMaxThird) {
+        insertBefore(0);
+    } else if (leadingZeros == 1 && size >= 2 && data[0] == 0 && data[1] <= kEmulationMaxThird) {
+        insertBefore(1);
+    }
+
+    while (true) {
+        const auto found = findH26xEmulationSequence(data, size, searchFrom);
+        if (found == size) {
+            break;
+        }
+        insertBefore(found + 2);
+    }
+
+    memcpy(out + written, data + copied, size - copied);
+    written += size - copied;
+    return written;
+}
+
+size_t unescapeH26xEmulation(const uint8_t *data, size_t size, size_t leadingZeros, uint8_t *out) {
+    size_t written = 0;
+    size_t copied = 0;
+    size_t searchFrom = 0;
+
+    const auto removeAt = [&](size_t position) {
+        memmove(out + written, data + copied, position - copied);
+        written += position - copied;
+        copied = position + 1;
+        searchFrom = position + 1;
+    };
+
+    if (leadingZeros >= 2 && size >= 1 && data[0] == kEmulationMaxThird) {
+        removeAt(0);
+    } else if (leadingZeros == 1 && size >= 2 && data[0] == 0 && data[1] == kEmulationMaxThird) {
+        removeAt(1);
+    }
+
+    while (true) {
+        const auto found = findH26xEmulationSequence(data, size, searchFrom);
+        if (found == size) {
+            break;
+        }
+        if (data[found + 2] == kEmulationMaxThird) {
+            removeAt(found + 2);
+        } else {
+            searchFrom = found + 1;
+        }
+    }
+
+    memmove(out + written, data + copied, size - copied);
+    written += size - copied;
+    return written;
+}
+
+const char *h26xStartCodesImplementationName() {
+    return startCodeKernels().name;
+}
+
+}
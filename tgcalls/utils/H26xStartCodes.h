@@ -0,0 +1,56 @@
+#ifndef TGCALLS_UTILS_H26X_START_CODES_H
+#define TGCALLS_UTILS_H26X_START_CODES_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tgcalls {
+
+// Scanning for H.264/H.265 Annex B start codes and emulation prevention.
+// The search kernels (AVX2, SSE2, NEON or scalar) are picked once at runtime.
+
+// Offset of the first 00 00 01 beginning at or after |from| and ending
+// before |size|, or |size| if there is none.
+size_t findH26xStartCode(const uint8_t *data, size_t size, size_t from = 0);
+// Same for 00 00 0x with x <= 3, the sequences emulation prevention escapes.
+size_t findH26xEmulationSequence(const uint8_t *data, size_t size, size_t from = 0);
+
+struct H26xNaluIndex {
+    size_t startOffset = 0;
+    size_t payloadStartOffset = 0;
+    size_t payloadSize = 0;
+};
+
+// Walks NAL units exactly as webrtc::H264::FindNaluIndices lists them, but
+// without allocating and without scanning beyond the unit last returned.
+class H26xNaluReader {
+public:
+    H26xNaluReader(const uint8_t *data, size_t size);
+
+    bool next(H26xNaluIndex &index);
+
+private:
+    const uint8_t *_data = nullptr;
+    size_t _size = 0;
+    size_t _searchSize = 0;
+    size_t _startCode = 0;
+};
+
+// Escaping grows the data by at most this much.
+inline size_t maxEscapedH26xSize(size_t size) {
+    return size + size / 2 + 1;
+}
+
+// Inserts emulation prevention bytes so that |out| contains no 00 00 0x with
+// x <= 3. |leadingZeros| is the number of zero bytes directly preceding
+// |data| in the stream. |out| needs maxEscapedH26xSize(size) bytes and must
+// not overlap |data|. Returns the number of bytes written.
+size_t escapeH26xEmulation(const uint8_t *data, size_t size, size_t leadingZeros, uint8_t *out);
+// Reverses escapeH26xEmulation. |out| may be equal to |data|.
+size_t unescapeH26xEmulation(const uint8_t *data, size_t size, size_t leadingZeros, uint8_t *out);
+
+const char *h26xStartCodesImplementationName();
+
+}
+
+#endif // TGCALLS_UTILS_H26X_START_CODES_H
@@ -0,0 +1,156 @@
+#include "utils/VideoSinkFanout.h"
+
+#include <algorithm>
+
+#include "api/video/i420_buffer.h"
+#include "rtc_base/time_utils.h"
+
+namespace tgcalls {
+
+namespace {
+
+// A frame arriving this much early still counts, so rates that don't
+// divide the source rate are met on average.
+constexpr int64_t kFrameTimestampToleranceUs = 5000;
+// Pools of target sizes that haven't been used for this many frames are released.
+constexpr int64_t kPoolIdleFrames = 90;
+
+std::pair<int, int> targetSize(webrtc::VideoFrame const &frame, VideoSinkOptions const &options) {
+    const int width = frame.width();
+    const int height = frame.height();
+
+    int maxWidth = options.maxWidth;
+    int maxHeight = options.maxHeight;
+    if (frame.rotation() == webrtc::kVideoRotation_90 || frame.rotation() == webrtc::kVideoRotation_270) {
+        std::swap(maxWidth, maxHeight);
+    }
+
+    double scale = 1.0;
+    if (maxWidth > 0 && width > maxWidth) {
+        scale = std::min(scale, (double)maxWidth / (double)width);
+    }
+    if (maxHeight > 0 && height > maxHeight) {
+        scale = std::min(scale, (double)maxHeight / (double)height);
+    }
+    if (scale >= 1.0) {
+        return std::make_pair(width, height);
+    }
+
+    // Even dimensions keep the chroma planes aligned with the luma plane
+    const int scaledWidth = std::max(2, (int)(width * scale) & ~1);
+    const int scaledHeight = std::max(2, (int)(height * scale) & ~1);
+    return std::make_pair(scaledWidth, scaledHeight);
+}
+
+} // namespace
+
+void VideoSinkFanout::addSink(VideoSinkRegistration const &registration, webrtc::VideoFrame const *lastFrame) {
+    const auto strong = registration.sink.lock();
+    if (!strong) {
+        return;
+    }
+
+    Entry entry;
+    entry.registration = registration;
+    if (lastFrame) {
+        _scaledFrames.clear();
+        strong->OnFrame(adaptedFrame(*lastFrame, registration.options));
+        _scaledFrames.clear();
+    }
+    _entries.push_back(std::move(entry));
+}
+
+std::vector<VideoSinkRegistration> VideoSinkFanout::getSinks() const {
+    std::vector<VideoSinkRegistration> result;
+    result.reserve(_entries.size());
+    for (const auto &entry : _entries) {
+        result.push_back(entry.registration);
+    }
+    return result;
+}
+
+bool VideoSinkFanout::acceptsFrame(Entry &entry, int64_t timestampUs) const {
+    const int maxFramesPerSecond = entry.registration.options.maxFramesPerSecond;
+    if (maxFramesPerSecond <= 0) {
+        return true;
+    }
+    if (timestampUs + kFrameTimestampToleranceUs < entry.nextFrameTimestampUs) {
+        return false;
+    }
+    const int64_t intervalUs = rtc::kNumMicrosecsPerSec / maxFramesPerSecond;
+    // Don't make up for frames missed during a pause
+    entry.nextFrameTimestampUs = std::max(entry.nextFrameTimestampUs, timestampUs - intervalUs) + intervalUs;
+    return true;
+}
+
+webrtc::scoped_refptr<webrtc::VideoFrameBuffer> VideoSinkFanout::scaleBuffer(webrtc::scoped_refptr<webrtc::VideoFrameBuffer> const &buffer, int width, int height) {
+    if (buffer->type() == webrtc::VideoFrameBuffer::Type::kI420) {
+        auto &pool = _pools[std::make_pair(width, height)];
+        pool.lastUsedFrame = _frameCounter;
+        if (const auto scaled = pool.pool.CreateI420Buffer(width, height)) {
+            scaled->ScaleFrom(*buffer->GetI420());
+            return scaled;
+        }
+    }
+    // Native buffers scale themselves, possibly without leaving the GPU
+    return buffer->Scale(width, height);
+}
+
+webrtc::VideoFrame const &VideoSinkFanout::adaptedFrame(webrtc::VideoFrame const &frame, VideoSinkOptions const &options) {
+    const auto size = targetSize(frame, options);
+    if (size.first == frame.width() && size.second == frame.height()) {
+        return frame;
+    }
+
+    for (const auto &scaledFrame : _scaledFrames) {
+        if (scaledFrame.width == size.first && scaledFrame.height == size.second) {
+            return scaledFrame.frame;
+        }
+    }
+
+    webrtc::VideoFrame scaled = frame;
+    scaled.set_video_frame_buffer(scaleBuffer(frame.video_frame_buffer(), size.first, size.second));
+    scaled.set_update_rect(webrtc::VideoFrame::UpdateRect{ 0, 0, size.first, size.second });
+    _scaledFrames.push_back(ScaledFrame{ size.first, size.second, std::move(scaled) });
+    return _scaledFrames.back().frame;
+}
+
+void VideoSinkFanout::onFrame(webrtc::VideoFrame const &frame) {
+    _frameCounter++;
+    _scaledFrames.clear();
+
+    const int64_t timestampUs = frame.timestamp_us() != 0 ? frame.timestamp_us() : rtc::TimeMicros();
+    for (int i = (int)(_entries.size()) - 1; i >= 0; i--) {
+        auto &entry = _entries[i];
+        auto strong = entry.registration.sink.lock();
+        if (!strong) {
+            _entries.erase(_entries.begin() + i);
+        } else if (acceptsFrame(entry, timestampUs)) {
+            strong->OnFrame(adaptedFrame(frame, entry.registration.options));
+        }
+    }
+
+    // Release the scaled buffers so that the pools can reuse them
+    _scaledFrames.clear();
+
+    for (auto it = _pools.begin(); it != _pools.end(); ) {
+        if (it->second.lastUsedFrame < _frameCounter - kPoolIdleFrames) {
+            it = _pools.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void VideoSinkFanout::onDiscardedFrame() {
+    for (int i = (int)(_entries.size()) - 1; i >= 0; i--) {
+        auto strong = _entries[i].registration.sink.lock();
+        if (!strong) {
+            _entries.erase(_entries.begin() + i);
+        } else {
+            strong->OnDiscardedFrame();
+        }
+    }
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef TGCALLS_UTILS_VIDEO_SINK_FANOUT_H
+#define TGCALLS_UTILS_VIDEO_SINK_FANOUT_H
+
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "api/video/video_frame.h"
+#include "api/video/video_sink_interface.h"
+#include "common_video/include/video_frame_buffer_pool.h"
+
+#include "Instance.h"
+
+namespace tgcalls {
+
+struct VideoSinkRegistration {
+    std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink;
+    VideoSinkOptions options;
+};
+
+// Delivers frames to weak sinks, each adapted to the sink's options. A frame
+// is scaled once per distinct target size, into pooled buffers, and the
+// result is shared by all sinks of that size. Frames above a sink's frame
+// rate are dropped by timestamp. Expired sinks are removed on delivery.
+// Not thread-safe.
+class VideoSinkFanout {
+public:
+    // |lastFrame|, if any, is delivered to the new sink right away.
+    void addSink(VideoSinkRegistration const &registration, webrtc::VideoFrame const *lastFrame);
+    std::vector<VideoSinkRegistration> getSinks() const;
+
+    void onFrame(webrtc::VideoFrame const &frame);
+    void onDiscardedFrame();
+
+private:
+    struct Entry {
+        VideoSinkRegistration registration;
+        int64_t nextFrameTimestampUs = 0;
+    };
+
+    struct ScaledFrame {
+        int width = 0;
+        int height = 0;
+        webrtc::VideoFrame frame;
+    };
+
+    struct Pool {
+        webrtc::VideoFrameBufferPool pool;
+        int64_t lastUsedFrame = 0;
+    };
+
+    bool acceptsFrame(Entry &entry, int64_t timestampUs) const;
+    webrtc::VideoFrame const &adaptedFrame(webrtc::VideoFrame const &frame, VideoSinkOptions const &options);
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> scaleBuffer(webrtc::scoped_refptr<webrtc::VideoFrameBuffer> const &buffer, int width, int height);
+
+private:
+    std::vector<Entry> _entries;
+    // Scaled versions of the frame being delivered
+    std::vector<ScaledFrame> _scaledFrames;
+    std::map<std::pair<int, int>, Pool> _pools;
+    int64_t _frameCounter = 0;
+};
+
+}
+
+#endif // TGCALLS_UTILS_VIDEO_SINK_FANOUT_H
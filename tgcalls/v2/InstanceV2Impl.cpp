@@ -52,6 +52,7 @@
 #ifdef WEBRTC_IOS
 #include "platform/darwin/iOS/tgcalls_audio_device_module_ios.h"
 #endif
+#include <mutex>
 #include <random>
 #include <sstream>
 
@@ -64,6 +65,7 @@
 #include "ExternalSignalingConnection.h"
 #include "SignalingSctpConnection.h"
 #include "utils/gzip.h"
+#include "utils/VideoSinkFanout.h"
 
 namespace tgcalls {
 namespace {
@@ -708,41 +710,25 @@ public:
     }
 
     virtual void OnFrame(const webrtc::VideoFrame& frame) override {
+        std::unique_lock<std::mutex> lock{ _mutex };
         //_lastFrame = frame;
-        for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
-            auto strong = _sinks[i].lock();
-            if (!strong) {
-                _sinks.erase(_sinks.begin() + i);
-            } else {
-                strong->OnFrame(frame);
-            }
-        }
+        _fanout.onFrame(frame);
     }
 
     virtual void OnDiscardedFrame() override {
-        for (int i = (int)(_sinks.size()) - 1; i >= 0; i--) {
-            auto strong = _sinks[i].lock();
-            if (!strong) {
-                _sinks.erase(_sinks.begin() + i);
-            } else {
-                strong->OnDiscardedFrame();
-            }
-        }
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _fanout.onDiscardedFrame();
     }
 
-    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl) {
-        _sinks.push_back(impl);
-        if (_lastFrame) {
-            auto strong = impl.lock();
-            if (strong) {
-                strong->OnFrame(_lastFrame.value());
-            }
-        }
+    void addSink(VideoSinkRegistration const &registration) {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _fanout.addSink(registration, _lastFrame ? &_lastFrame.value() : nullptr);
     }
 
 private:
-    std::vector<std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>>> _sinks;
+    VideoSinkFanout _fanout;
     absl::optional<webrtc::VideoFrame> _lastFrame;
+    std::mutex _mutex;
 };
 
 class IncomingV2VideoChannel : public sigslot::has_slots<> {
@@ -843,8 +829,8 @@ public:
         _videoChannel = nullptr;
     }
 
-    void addSink(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> impl) {
-        _videoSink->addSink(impl);
+    void addSink(VideoSinkRegistration const &registration) {
+        _videoSink->addSink(registration);
     }
 
     uint32_t ssrc() const {
@@ -964,7 +950,7 @@ public:
         _outgoingAudioChannel.reset();
         _outgoingVideoChannel.reset();
         _outgoingScreencastChannel.reset();
-        _currentSink.reset();
+        _currentSink = VideoSinkRegistration();
 
         _channelManager.reset();
 
@@ -2032,13 +2018,13 @@ public:
         }
     }
 
-    void setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
-        _currentSink = sink;
+    void setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+        _currentSink = VideoSinkRegistration{ sink, options };
         if (_incomingVideoChannel) {
-            _incomingVideoChannel->addSink(sink);
+            _incomingVideoChannel->addSink(_currentSink);
         }
         if (_incomingScreencastChannel) {
-            _incomingScreencastChannel->addSink(sink);
+            _incomingScreencastChannel->addSink(_currentSink);
         }
     }
 
@@ -2248,7 +2234,7 @@ private:
     std::unique_ptr<IncomingV2VideoChannel> _incomingVideoChannel;
     std::unique_ptr<IncomingV2VideoChannel> _incomingScreencastChannel;
 
-    std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> _currentSink;
+    VideoSinkRegistration _currentSink;
 
     std::shared_ptr<VideoCaptureInterface> _videoCapture;
     std::shared_ptr<VideoCaptureInterface> _screencastCapture;
@@ -2313,7 +2299,13 @@ void InstanceV2Impl::setMuteMicrophone(bool muteMicrophone) {
 
 void InstanceV2Impl::setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) {
     _internal->perform([sink](InstanceV2ImplInternal *internal) {
-        internal->setIncomingVideoOutput(sink);
+        internal->setIncomingVideoOutput(sink, VideoSinkOptions());
+    });
+}
+
+void InstanceV2Impl::setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink, VideoSinkOptions const &options) {
+    _internal->perform([sink, options](InstanceV2ImplInternal *internal) {
+        internal->setIncomingVideoOutput(sink, options);
     });
 }
 
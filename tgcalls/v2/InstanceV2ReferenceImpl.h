@@ -27,6 +27,7 @@ public:
 	bool supportsVideo() override {
 		return true;
 	}
+	using Instance::setIncomingVideoOutput;
 	void setIncomingVideoOutput(std::weak_ptr<rtc::VideoSinkInterface<webrtc::VideoFrame>> sink) override;
 	void setAudioOutputGainControlEnabled(bool enabled) override;
 	void setEchoCancellationStrength(int strength) override;